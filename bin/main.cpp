@@ -1,5 +1,6 @@
-#include <fstream>
 #include <iostream>
+#include <stdexcept>
+#include <string>
 
 #include "interpreter.h"
 
@@ -15,19 +16,40 @@ int main(int argc, char** argv) {
     // std::cout << interpret(input, output) << '\n';
     // std::cout << output.str();
 
+    // --tree-walker: исполнять обходом AST вместо байткода
+    // --stream: исполнять топ-левел выражения по мере разбора
+    // --lazy: разбирать тела функций при первом вызове
+    ExecutionMode mode = ExecutionMode::Bytecode;
+    bool lazyBodies = false;
+    const char* path = nullptr;
+    for (int i = 1; i < argc; ++i) {
+        if (std::string(argv[i]) == "--tree-walker")
+            mode = ExecutionMode::TreeWalker;
+        else if (std::string(argv[i]) == "--stream")
+            mode = ExecutionMode::Streaming;
+        else if (std::string(argv[i]) == "--lazy")
+            lazyBodies = true;
+        else
+            path = argv[i];
+    }
+
     // Пробуем считать из файла, если он подан
-    if (argc == 2) {
-        std::ifstream file(argv[1]);
-        if (!file.is_open()) {
-            std::cerr << "Cannot open file: " << argv[1] << "\n";
+    if (path) {
+        bool ok;
+        try {
+            ok = interpretFile(path, std::cout, mode, lazyBodies);
+        } catch (const std::exception& e) {
+            std::cerr << e.what() << "\n";
             return 1;
         }
-        if (!interpret(file, std::cout))
+        if (!ok)
             return 1;
         return 0;
     }
-    // Иначе из стандартного потока
-    if (!interpret(std::cin, std::cout))
+    // Иначе из стандартного потока. Без синхронизации с stdio у std::cin свой
+    // буфер: потоковый режим видит, сколько текста уже пришло
+    std::ios::sync_with_stdio(false);
+    if (!interpret(std::cin, std::cout, mode, lazyBodies))
         return 1;
     return 0;
 }
@@ -3,23 +3,22 @@
 #include <string>
 #include <vector>
 
-#include "environment.h"
+#include "ast_arena.h"
+#include "scope.h"
+#include "source.h"
 #include "value.h"
 #include "token.h"
 
 static const char* TokenTypeToString(TokenType type);
 
-struct BreakException {};
-struct ContinueException {};
-struct ReturnException {
-    Value value;
-    explicit ReturnException(Value v) : value(std::move(v)) {}
-};
-
 class ExprAST {
    public:
     virtual ~ExprAST() = default;
-    virtual Value eval(Environment& env) const = 0;
+    virtual Value eval(Frame& frame) const = 0;
+
+    // Узлы размещаются в арене модуля, который сейчас разбирается
+    static void* operator new(size_t size) { return AstArena::allocateNode(size); }
+    static void operator delete(void* p) { AstArena::freeNode(p); }
 };
 
 class NumberExprAST : public ExprAST {
@@ -27,76 +26,169 @@ class NumberExprAST : public ExprAST {
 
    public:
     NumberExprAST(double V) : Val(V) {}
-    Value eval(Environment& env) const override {
+    Value eval(Frame& frame) const override {
         return Value(Val);
     }
+    double getValue() const { return Val; }
 };
 
 class VariableExprAST : public ExprAST {
-    std::string Name;
+    Symbol Name;
+    VarSlot Slot;
 
    public:
-    VariableExprAST(const std::string& N) : Name(N) {}
-    Value eval(Environment& env) const override {
-        return env.get(Name);
-    }
-    std::string& getName() {
-        return Name;
+    VariableExprAST(Symbol N) : Name(N) {}
+    Value eval(Frame& frame) const override {
+        return frame.get(Slot);
     }
+    const std::string& getName() const { return Name.name(); }
+    Symbol getSymbol() const { return Name; }
+    const VarSlot& getSlot() const { return Slot; }
+    void setSlot(VarSlot s) { Slot = s; }
 };
 
+// Бинарный оператор, известный на этапе компиляции C++
+template <TokenType Op>
+Value applyOp(const Value& L, const Value& R) {
+    if constexpr (Op == TokenType::Plus) return L + R;
+    else if constexpr (Op == TokenType::Minus) return L - R;
+    else if constexpr (Op == TokenType::Star) return L * R;
+    else if constexpr (Op == TokenType::Slash) return L / R;
+    else if constexpr (Op == TokenType::Percent) return L % R;
+    else if constexpr (Op == TokenType::Caret) return L ^ R;
+    else if constexpr (Op == TokenType::Less) return L < R;
+    else if constexpr (Op == TokenType::LessEqual) return L <= R;
+    else if constexpr (Op == TokenType::Greater) return L > R;
+    else if constexpr (Op == TokenType::GreaterEqual) return L >= R;
+    else if constexpr (Op == TokenType::Equal) return L == R;
+    else if constexpr (Op == TokenType::NotEqual) return L != R;
+    else if constexpr (Op == TokenType::And) return L && R;
+    else return L || R;
+}
+
+// Тот же оператор для двух чисел; для && и || такого пути нет
+template <TokenType Op>
+constexpr bool hasNumberPath = Op != TokenType::And && Op != TokenType::Or;
+
+template <TokenType Op>
+Value applyNumbers(double x, double y) {
+    if constexpr (Op == TokenType::Plus) return Value(x + y);
+    else if constexpr (Op == TokenType::Minus) return Value(x - y);
+    else if constexpr (Op == TokenType::Star) return Value(x * y);
+    else if constexpr (Op == TokenType::Slash || Op == TokenType::Percent) {
+        if (y == 0.0) throw std::runtime_error("Division by zero");
+        return Value(Op == TokenType::Slash ? x / y : std::fmod(x, y));
+    } else if constexpr (Op == TokenType::Caret) return Value(std::pow(x, y));
+    else if constexpr (Op == TokenType::Less) return Value(x < y);
+    else if constexpr (Op == TokenType::LessEqual) return Value(x <= y);
+    else if constexpr (Op == TokenType::Greater) return Value(!(x <= y));
+    else if constexpr (Op == TokenType::GreaterEqual) return Value(!(x < y));
+    else if constexpr (Op == TokenType::Equal) return Value(x == y);
+    else return Value(!(x == y));
+}
+
+// Вызывает F<Op> для оператора, известного только во время исполнения
+template <template <TokenType> class F>
+auto dispatchOp(TokenType op) {
+    switch (op) {
+        case TokenType::Plus: return F<TokenType::Plus>::get();
+        case TokenType::Minus: return F<TokenType::Minus>::get();
+        case TokenType::Star: return F<TokenType::Star>::get();
+        case TokenType::Slash: return F<TokenType::Slash>::get();
+        case TokenType::Percent: return F<TokenType::Percent>::get();
+        case TokenType::Caret: return F<TokenType::Caret>::get();
+        case TokenType::Less: return F<TokenType::Less>::get();
+        case TokenType::LessEqual: return F<TokenType::LessEqual>::get();
+        case TokenType::Greater: return F<TokenType::Greater>::get();
+        case TokenType::GreaterEqual: return F<TokenType::GreaterEqual>::get();
+        case TokenType::Equal: return F<TokenType::Equal>::get();
+        case TokenType::NotEqual: return F<TokenType::NotEqual>::get();
+        case TokenType::And: return F<TokenType::And>::get();
+        case TokenType::Or: return F<TokenType::Or>::get();
+        default: return decltype(F<TokenType::Plus>::get())(nullptr);
+    }
+}
+
+// Узлы с типовой обратной связью (BinaryExprAST, CompoundAssignmentExprAST,
+// IndexExprAST, CallExprAST) хранят указатель на текущую реализацию. Сначала
+// это общая реализация, которая при первом вычислении смотрит на типы
+// операндов и заменяет себя специализированной (два числа, список и число,
+// вызов builtin-а). Специализация проверяет своё условие; если оно не
+// выполнилось, узел навсегда переходит на общую реализацию
+
 class BinaryExprAST : public ExprAST {
+    using Impl = Value (*)(const BinaryExprAST&, const Value&, const Value&);
+
     TokenType Op;
     std::unique_ptr<ExprAST> LHS, RHS;
+    mutable Impl Specialized;
+
+    template <TokenType O>
+    static Value generic(const BinaryExprAST&, const Value& L, const Value& R) {
+        return applyOp<O>(L, R);
+    }
+
+    template <TokenType O>
+    static Value numbers(const BinaryExprAST& self, const Value& L, const Value& R) {
+        if (L.isNumber() && R.isNumber()) [[likely]]
+            return applyNumbers<O>(L.asNumber(), R.asNumber());
+        self.Specialized = generic<O>;
+        return generic<O>(self, L, R);
+    }
+
+    template <TokenType O>
+    static Value uninitialized(const BinaryExprAST& self, const Value& L, const Value& R) {
+        if constexpr (hasNumberPath<O>) {
+            if (L.isNumber() && R.isNumber()) {
+                self.Specialized = numbers<O>;
+                return numbers<O>(self, L, R);
+            }
+        }
+        self.Specialized = generic<O>;
+        return generic<O>(self, L, R);
+    }
+
+    template <TokenType O>
+    struct Initial {
+        static Impl get() { return uninitialized<O>; }
+    };
+
+    template <TokenType O>
+    struct Numbers {
+        static Impl get() {
+            if constexpr (hasNumberPath<O>)
+                return numbers<O>;
+            else
+                return nullptr;
+        }
+    };
+
+    static Value unknown(const BinaryExprAST& self, const Value&, const Value&) {
+        throw std::runtime_error(std::string("Unknown binary operator ") + TokenTypeToString(self.Op));
+    }
 
    public:
     BinaryExprAST(TokenType op,
                   std::unique_ptr<ExprAST> lhs,
                   std::unique_ptr<ExprAST> rhs)
-        : Op(op), LHS(std::move(lhs)), RHS(std::move(rhs)) {}
-
-    Value eval(Environment& env) const override {
-        Value L = LHS->eval(env);
-        Value R = RHS->eval(env);
-        switch (Op) {
-            // арифметика
-            case TokenType::Plus:
-                return L + R;
-            case TokenType::Minus:
-                return L - R;
-            case TokenType::Star:
-                return L * R;
-            case TokenType::Slash:
-                return L / R;
-            case TokenType::Percent:
-                return L % R;
-            case TokenType::Caret:
-                return L ^ R;
-
-            // сравнения
-            case TokenType::Less:
-                return L < R;
-            case TokenType::LessEqual:
-                return L <= R;
-            case TokenType::Greater:
-                return L > R;
-            case TokenType::GreaterEqual:
-                return L >= R;
-            case TokenType::Equal:
-                return L == R;
-            case TokenType::NotEqual:
-                return L != R;
-
-            // Логические
-            case TokenType::And:
-                return L && R;
-            case TokenType::Or:
-                return L || R;
+        : Op(op), LHS(std::move(lhs)), RHS(std::move(rhs)) {
+        Specialized = dispatchOp<Initial>(op);
+        if (!Specialized) Specialized = unknown;
+    }
 
-            default:
-                throw std::runtime_error(std::string("Unknown binary operator ") + TokenTypeToString(Op));
-        }
+    Value eval(Frame& frame) const override {
+        Value L = LHS->eval(frame);
+        if (frame.abrupt()) return L;
+        Value R = RHS->eval(frame);
+        if (frame.abrupt()) return R;
+        return Specialized(*this, L, R);
     }
+
+    TokenType getOp() const { return Op; }
+    const ExprAST* getLHS() const { return LHS.get(); }
+    const ExprAST* getRHS() const { return RHS.get(); }
+    // Узел перешёл на специализацию для двух чисел
+    bool isNumberSpecialized() const { return Specialized == dispatchOp<Numbers>(Op); }
 };
 
 class UnaryExprAST : public ExprAST {
@@ -107,8 +199,9 @@ class UnaryExprAST : public ExprAST {
     UnaryExprAST(char op, std::unique_ptr<ExprAST> operand)
         : Op(op), Operand(std::move(operand)) {}
 
-    Value eval(Environment& env) const override {
-        Value V = Operand->eval(env);
+    Value eval(Frame& frame) const override {
+        Value V = Operand->eval(frame);
+        if (frame.abrupt()) return V;
         switch (Op) {
             case '+':
                 return V;
@@ -120,75 +213,251 @@ class UnaryExprAST : public ExprAST {
                 throw std::runtime_error(std::string("Unknown unary operator ") + Op);
         }
     }
+
+    char getOp() const { return Op; }
+    const ExprAST* getOperand() const { return Operand.get(); }
 };
 
 class CallExprAST : public ExprAST {
+    using Impl = Value (*)(const CallExprAST&, Frame&, const FunctionValue&);
+
     std::unique_ptr<ExprAST> CalleeExpr;
     std::vector<std::unique_ptr<ExprAST>> Args;
+    mutable Impl Specialized = uninitialized;
+    // Функция, под которую специализирован вызов: тело разобрано, число аргументов совпадает
+    mutable const FunctionAST* Target = nullptr;
+
+    static Value uninitialized(const CallExprAST& self, Frame& frame, const FunctionValue& fn);
+    static Value generic(const CallExprAST& self, Frame& frame, const FunctionValue& fn);
+    static Value sameFunction(const CallExprAST& self, Frame& frame, const FunctionValue& fn);
+    static Value builtin(const CallExprAST& self, Frame& frame, const FunctionValue& fn);
+
+    Value callFunction(Frame& frame, const FunctionValue& fn) const;
+    Value callWithWindow(Frame& frame, const FunctionValue& fn) const;
 
    public:
     CallExprAST(std::unique_ptr<ExprAST> callee, std::vector<std::unique_ptr<ExprAST>> args)
         : CalleeExpr(std::move(callee)), Args(std::move(args)) {}
 
-    Value eval(Environment& env) const override {
-        Value calleeVal = CalleeExpr->eval(env);
-        if (!calleeVal.isFunc())
-            throw std::runtime_error("Attempt to call a non-function value");
+    Value eval(Frame& frame) const override;
 
-        std::vector<Value> argVals;
-        for (auto& arg : Args) {
-            argVals.push_back(arg->eval(env));
-        }
-        return calleeVal.asFunc().invoke(argVals);
-    }
+    const ExprAST* getCallee() const { return CalleeExpr.get(); }
+    const std::vector<std::unique_ptr<ExprAST>>& getArgs() const { return Args; }
+    // Вызов специализирован под одну функцию из AST
+    bool isFunctionSpecialized() const { return Specialized == sameFunction; }
+    // Вызов специализирован под builtin
+    bool isBuiltinSpecialized() const { return Specialized == builtin; }
 };
 
 class PrototypeAST {
     std::string Name;
-    std::vector<std::string> Args;
+    std::vector<Symbol> Args;
 
    public:
-    PrototypeAST(const std::string& name, std::vector<std::string> args)
+    PrototypeAST(const std::string& name, std::vector<Symbol> args)
         : Name(name), Args(std::move(args)) {}
 
+    static void* operator new(size_t size) { return AstArena::allocateNode(size); }
+    static void operator delete(void* p) { AstArena::freeNode(p); }
+
     const std::string& getName() const { return Name; }
     void setName(const std::string& newName) { Name = newName; }
-    const std::vector<std::string>& getArgs() const { return Args; }
+    const std::vector<Symbol>& getArgs() const { return Args; }
+};
+
+// Тело функции, которое парсер пропустил, не разбирая: текст от первой
+// лексемы тела до 'end function'. Разбирается при первом вызове
+struct LazyBody {
+    std::vector<Symbol> params;
+    // Текст модуля и границы тела в нём
+    std::shared_ptr<const SourceBuffer> source;
+    uint32_t begin = 0;
+    uint32_t end = 0;
+    int line = 0;
+    // Тело литерала функции, а не именованной функции
+    bool literal = false;
+    // Все имена текста. Резолвер модуля заранее вносит их в глобалы, чтобы
+    // таблица глобалов не менялась после запуска
+    std::vector<Symbol> names;
+
+    std::string_view text() const { return source->text().substr(begin, end - begin); }
 };
 
 class FunctionAST {
+    // Объявлена первой, чтобы освободиться после узлов функции
+    std::shared_ptr<AstArena> Arena;
     std::unique_ptr<PrototypeAST> Proto;
     std::unique_ptr<ExprAST> Body;
+    FunctionScope Scope;
+    std::shared_ptr<const LazyBody> Lazy;
+    GlobalNames* LazyGlobals = nullptr;
+
+    void parseLazyBody() const;
 
    public:
     FunctionAST(std::unique_ptr<PrototypeAST> proto,
                 std::unique_ptr<ExprAST> body)
-        : Proto(std::move(proto)), Body(std::move(body)) {}
+        : Arena(AstArena::current() ? AstArena::current()->shared_from_this() : nullptr),
+          Proto(std::move(proto)),
+          Body(std::move(body)) {}
+
+    FunctionAST(std::unique_ptr<PrototypeAST> proto, std::shared_ptr<const LazyBody> lazy)
+        : Arena(AstArena::current() ? AstArena::current()->shared_from_this() : nullptr),
+          Proto(std::move(proto)),
+          Lazy(std::move(lazy)) {}
 
     const PrototypeAST& getProto() const { return *Proto; }
     PrototypeAST& getProto() { return *Proto; }
     ExprAST& getBody() const { return *Body; }
+    const FunctionScope& getScope() const { return Scope; }
+    void setScope(FunctionScope s) { Scope = std::move(s); }
+    const AstArena* getArena() const { return Arena.get(); }
+
+    bool isLazy() const { return Lazy != nullptr; }
+    const std::shared_ptr<const LazyBody>& getLazyBody() const { return Lazy; }
+    void setLazyGlobals(GlobalNames* globals) { LazyGlobals = globals; }
+    // Разбирает отложенное тело и резолвит тело, резолвинг которого отложен
+    // до первого вызова; вызывается перед каждым вызовом функции
+    void ensureBody() const {
+        if (LazyGlobals) parseLazyBody();
+    }
+};
+
+inline Value CallExprAST::eval(Frame& frame) const {
+    Value calleeVal = CalleeExpr->eval(frame);
+    if (frame.abrupt()) return calleeVal;
+    if (!calleeVal.isFunc())
+        throw std::runtime_error("Attempt to call a non-function value");
+    return Specialized(*this, frame, calleeVal.asFunc());
+}
+
+// Аргументы функции из AST вычисляются прямо в слоты её кадра
+inline Value CallExprAST::callFunction(Frame& frame, const FunctionValue& fn) const {
+    Frame callee(*fn.globals, fn.fnAST->getScope().numLocals, fn.upvalues.get());
+    for (size_t i = 0; i < Args.size(); ++i) {
+        callee.locals[i] = Args[i]->eval(frame);
+        if (frame.abrupt()) return callee.locals[i];
+    }
+    return fn.run(callee);
+}
+
+inline Value CallExprAST::callWithWindow(Frame& frame, const FunctionValue& fn) const {
+    ArgWindow args(Args.size());
+    for (size_t i = 0; i < Args.size(); ++i) {
+        args.data()[i] = Args[i]->eval(frame);
+        if (frame.abrupt()) return args.data()[i];
+    }
+    return fn.isBuiltin ? fn.native(args.span()) : fn.invoke(args.span());
+}
+
+inline Value CallExprAST::generic(const CallExprAST& self, Frame& frame, const FunctionValue& fn) {
+    if (fn.fnAST) fn.fnAST->ensureBody();
+    if (fn.fnAST && fn.fnAST->getScope().numParams == self.Args.size()) return self.callFunction(frame, fn);
+    return self.callWithWindow(frame, fn);
+}
+
+inline Value CallExprAST::sameFunction(const CallExprAST& self, Frame& frame, const FunctionValue& fn) {
+    if (fn.fnAST == self.Target) [[likely]]
+        return self.callFunction(frame, fn);
+    self.Specialized = generic;
+    return generic(self, frame, fn);
+}
+
+inline Value CallExprAST::builtin(const CallExprAST& self, Frame& frame, const FunctionValue& fn) {
+    if (fn.isBuiltin) [[likely]]
+        return self.callWithWindow(frame, fn);
+    self.Specialized = generic;
+    return generic(self, frame, fn);
+}
+
+inline Value CallExprAST::uninitialized(const CallExprAST& self, Frame& frame, const FunctionValue& fn) {
+    if (fn.isBuiltin) {
+        self.Specialized = builtin;
+    } else if (fn.fnAST) {
+        fn.fnAST->ensureBody();
+        if (fn.fnAST->getScope().numParams == self.Args.size()) {
+            self.Target = fn.fnAST;
+            self.Specialized = sameFunction;
+        } else {
+            self.Specialized = generic;
+        }
+    } else {
+        self.Specialized = generic;
+    }
+    return self.Specialized(self, frame, fn);
+}
+
+class FunctionLiteralExprAST : public ExprAST {
+    std::unique_ptr<FunctionAST> FnAST;
+    // Функция без upvalue создаётся один раз на таблицу глобалов
+    mutable Value Shared;
+
+   public:
+    FunctionLiteralExprAST(std::vector<Symbol> A,
+                           std::unique_ptr<ExprAST> B)
+        : FnAST(std::make_unique<FunctionAST>(
+              std::make_unique<PrototypeAST>("", std::move(A)),
+              std::move(B))) {}
+    explicit FunctionLiteralExprAST(std::unique_ptr<FunctionAST> F) : FnAST(std::move(F)) {}
+
+    Value eval(Frame& frame) const override {
+        const auto& descs = FnAST->getScope().upvalues;
+        if (descs.empty()) {
+            if (!Shared.isFunc() || Shared.asFunc().globals != &frame.globals)
+                Shared = Value(FunctionValue{FnAST.get(), nullptr, &frame.globals});
+            return Shared;
+        }
+        auto upvalues = std::make_shared<UpvalueList>();
+        upvalues->reserve(descs.size());
+        bool self = false;
+        for (const auto& d : descs) {
+            if (d.source == UpvalueSource::ParentLocal)
+                upvalues->push_back(std::make_shared<UpvalueCell>(UpvalueCell{frame.locals[d.index]}));
+            else if (d.source == UpvalueSource::ParentUpvalue)
+                upvalues->push_back((*frame.upvalues)[d.index]);
+            else
+                upvalues->push_back(captureOwnUpvalue(frame.globals, d));
+            self |= d.source == UpvalueSource::Self;
+        }
+        Value fn(FunctionValue{FnAST.get(), upvalues, &frame.globals});
+        if (self) fillSelf(descs, *upvalues, fn);
+        return fn;
+    }
+    FunctionAST* getFunctionAST() const { return FnAST.get(); }
 };
 
 class AssignmentExprAST : public ExprAST {
-    std::string VarName;
+    Symbol VarName;
     std::unique_ptr<ExprAST> Expr;
+    VarSlot Slot;
 
    public:
-    AssignmentExprAST(const std::string& name,
+    AssignmentExprAST(Symbol name,
                       std::unique_ptr<ExprAST> expr)
         : VarName(name), Expr(std::move(expr)) {}
 
-    Value eval(Environment& env) const override {
-        Value v = Expr->eval(env);
+    Value eval(Frame& frame) const override {
+        Value v = Expr->eval(frame);
+        if (frame.abrupt()) return v;
+        frame.set(Slot, v);
 
-        env.set(VarName, v);
-        if (v.isFunc()) {
+        // Литерал функции, присвоенный локальной переменной, видит в ней самого себя
+        if (Slot.kind == SlotKind::Local && dynamic_cast<const FunctionLiteralExprAST*>(Expr.get())) {
             FunctionValue fv = v.asFunc();
-            fv.closure->set(VarName, v);
+            const auto& descs = fv.fnAST->getScope().upvalues;
+            for (size_t i = 0; i < descs.size(); ++i) {
+                if (descs[i].source == UpvalueSource::ParentLocal && descs[i].index == Slot.index)
+                    (*fv.upvalues)[i]->value = v;
+            }
         }
         return v;
     }
+
+    const std::string& getVarName() const { return VarName.name(); }
+    Symbol getSymbol() const { return VarName; }
+    const ExprAST* getExpr() const { return Expr.get(); }
+    const VarSlot& getSlot() const { return Slot; }
+    void setSlot(VarSlot s) { Slot = s; }
 };
 
 class StringExprAST : public ExprAST {
@@ -196,9 +465,10 @@ class StringExprAST : public ExprAST {
 
    public:
     StringExprAST(const std::string& V) : Val(V) {}
-    Value eval(Environment& env) const override {
+    Value eval(Frame& frame) const override {
         return Value(Val);
     }
+    const std::string& getValue() const { return Val; }
 };
 
 class BooleanExprAST : public ExprAST {
@@ -206,9 +476,10 @@ class BooleanExprAST : public ExprAST {
 
    public:
     BooleanExprAST(bool V) : Val(V) {}
-    Value eval(Environment& env) const override {
+    Value eval(Frame& frame) const override {
         return Value(Val);
     }
+    bool getValue() const { return Val; }
 };
 
 class ListExprAST : public ExprAST {
@@ -217,29 +488,15 @@ class ListExprAST : public ExprAST {
    public:
     ListExprAST(std::vector<std::unique_ptr<ExprAST>> Elems)
         : Elements(std::move(Elems)) {}
-    Value eval(Environment& env) const override {
+    Value eval(Frame& frame) const override {
         Value::RawList vals;
-        for (auto& E : Elements)
-            vals.push_back(E->eval(env));
+        for (auto& E : Elements) {
+            vals.push_back(E->eval(frame));
+            if (frame.abrupt()) return vals.back();
+        }
         return Value(vals);
     }
-};
-
-class FunctionLiteralExprAST : public ExprAST {
-    std::unique_ptr<FunctionAST> FnAST;
-
-   public:
-    FunctionLiteralExprAST(std::vector<std::string> A,
-                           std::unique_ptr<ExprAST> B)
-        : FnAST(std::make_unique<FunctionAST>(
-              std::make_unique<PrototypeAST>("", std::move(A)),
-              std::move(B))) {}
-
-    Value eval(Environment& env) const override {
-        auto newEnv = std::make_shared<Environment>(env);
-        return Value(FunctionValue{FnAST.get(), std::move(newEnv)});
-    }
-    FunctionAST* getFunctionAST() const { return FnAST.get(); }
+    const std::vector<std::unique_ptr<ExprAST>>& getElements() const { return Elements; }
 };
 
 // Префиксный ++x или --x
@@ -251,15 +508,18 @@ class PrefixExprAST : public ExprAST {
     PrefixExprAST(bool inc, std::unique_ptr<ExprAST> op)
         : IsIncrement(inc), Operand(std::move(op)) {}
 
-    Value eval(Environment& env) const override {
+    Value eval(Frame& frame) const override {
         auto* var = dynamic_cast<VariableExprAST*>(Operand.get());
         if (!var) throw std::runtime_error("Operand of prefix ++/-- must be a variable");
-        Value v = env.get(var->getName());
+        Value v = frame.get(var->getSlot());
         double d = Value::asNumeric(v);
         d += IsIncrement ? 1 : -1;
-        env.set(var->getName(), Value(d));
+        frame.set(var->getSlot(), Value(d));
         return Value(d);
     }
+
+    bool isIncrement() const { return IsIncrement; }
+    const ExprAST* getOperand() const { return Operand.get(); }
 };
 
 // Постфиксный x++ или x--
@@ -271,75 +531,132 @@ class PostfixExprAST : public ExprAST {
     PostfixExprAST(bool inc, std::unique_ptr<ExprAST> op)
         : IsIncrement(inc), Operand(std::move(op)) {}
 
-    Value eval(Environment& env) const override {
+    Value eval(Frame& frame) const override {
         auto* var = dynamic_cast<VariableExprAST*>(Operand.get());
         if (!var) throw std::runtime_error("Operand of postfix ++/-- must be a variable");
-        Value old = env.get(var->getName());
+        Value old = frame.get(var->getSlot());
         double d = Value::asNumeric(old);
         d += IsIncrement ? 1 : -1;
-        env.set(var->getName(), Value(d));
+        frame.set(var->getSlot(), Value(d));
         return old;
     }
+
+    bool isIncrement() const { return IsIncrement; }
+    const ExprAST* getOperand() const { return Operand.get(); }
 };
 
 class CompoundAssignmentExprAST : public ExprAST {
+    using Impl = Value (*)(const CompoundAssignmentExprAST&, const Value&, const Value&);
+
     TokenType Op;
-    std::string VarName;
+    Symbol VarName;
     std::unique_ptr<ExprAST> RHS;
+    VarSlot Slot;
+    mutable Impl Specialized;
+
+    // '%=' в отличие от '%' не проверяет деление на ноль
+    template <TokenType O>
+    static Value generic(const CompoundAssignmentExprAST&, const Value& old, const Value& right) {
+        if constexpr (O == TokenType::Percent)
+            return Value(std::fmod(Value::asNumeric(old), Value::asNumeric(right)));
+        else
+            return applyOp<O>(old, right);
+    }
+
+    template <TokenType O>
+    static Value numbers(const CompoundAssignmentExprAST& self, const Value& old, const Value& right) {
+        if (old.isNumber() && right.isNumber()) [[likely]] {
+            if constexpr (O == TokenType::Percent)
+                return Value(std::fmod(old.asNumber(), right.asNumber()));
+            else
+                return applyNumbers<O>(old.asNumber(), right.asNumber());
+        }
+        self.Specialized = generic<O>;
+        return generic<O>(self, old, right);
+    }
+
+    template <TokenType O>
+    static Value uninitialized(const CompoundAssignmentExprAST& self, const Value& old, const Value& right) {
+        self.Specialized = old.isNumber() && right.isNumber() ? numbers<O> : generic<O>;
+        return self.Specialized(self, old, right);
+    }
+
+    static Value unknown(const CompoundAssignmentExprAST&, const Value&, const Value&) {
+        throw std::runtime_error("Unknown compound assignment operator");
+    }
 
    public:
     CompoundAssignmentExprAST(TokenType op,
-                              std::string name,
+                              Symbol name,
                               std::unique_ptr<ExprAST> rhs)
-        : Op(op), VarName(std::move(name)), RHS(std::move(rhs)) {}
-
-    Value eval(Environment& env) const override {
-        Value old = env.get(VarName);
-        Value right = RHS->eval(env);
-        Value result;
-        switch (Op) {
-            case TokenType::PlusAssign:
-                result = old + right;
-                break;
-            case TokenType::MinusAssign:
-                result = old - right;
-                break;
-            case TokenType::StarAssign:
-                result = old * right;
-                break;
-            case TokenType::SlashAssign:
-                result = old / right;
-                break;
-            case TokenType::PercentAssign: {
-                double a = Value::asNumeric(old),
-                       b = Value::asNumeric(right);
-                result = Value(std::fmod(a, b));
-                break;
-            }
-            case TokenType::CaretAssign:
-                result = old ^ right;
-                break;
-            default:
-                throw std::runtime_error("Unknown compound assignment operator");
+        : Op(op), VarName(name), RHS(std::move(rhs)) {
+        switch (op) {
+            case TokenType::PlusAssign: Specialized = uninitialized<TokenType::Plus>; break;
+            case TokenType::MinusAssign: Specialized = uninitialized<TokenType::Minus>; break;
+            case TokenType::StarAssign: Specialized = uninitialized<TokenType::Star>; break;
+            case TokenType::SlashAssign: Specialized = uninitialized<TokenType::Slash>; break;
+            case TokenType::PercentAssign: Specialized = uninitialized<TokenType::Percent>; break;
+            case TokenType::CaretAssign: Specialized = uninitialized<TokenType::Caret>; break;
+            default: Specialized = unknown;
         }
-        env.set(VarName, result);
+    }
+
+    Value eval(Frame& frame) const override {
+        Value old = frame.get(Slot);
+        Value right = RHS->eval(frame);
+        if (frame.abrupt()) return right;
+        Value result = Specialized(*this, old, right);
+        frame.set(Slot, result);
         return result;
     }
+
+    TokenType getOp() const { return Op; }
+    const std::string& getVarName() const { return VarName.name(); }
+    Symbol getSymbol() const { return VarName; }
+    const ExprAST* getRHS() const { return RHS.get(); }
+    const VarSlot& getSlot() const { return Slot; }
+    void setSlot(VarSlot s) { Slot = s; }
 };
 
 class IndexExprAST : public ExprAST {
+    using Impl = Value (*)(const IndexExprAST&, const Value&, const Value&);
+
     std::unique_ptr<ExprAST> Base, Index;
+    mutable Impl Specialized = uninitialized;
+
+    static Value generic(const IndexExprAST&, const Value& V, const Value& I) {
+        return V.atIndex(static_cast<int64_t>(I.asNumber()));
+    }
+
+    static Value listByNumber(const IndexExprAST& self, const Value& V, const Value& I) {
+        if (V.isList() && I.isNumber()) [[likely]]
+            return V.listAt(static_cast<int64_t>(I.asNumber()));
+        self.Specialized = generic;
+        return generic(self, V, I);
+    }
+
+    static Value uninitialized(const IndexExprAST& self, const Value& V, const Value& I) {
+        self.Specialized = V.isList() && I.isNumber() ? listByNumber : generic;
+        return self.Specialized(self, V, I);
+    }
 
    public:
     IndexExprAST(std::unique_ptr<ExprAST> B,
                  std::unique_ptr<ExprAST> I)
         : Base(std::move(B)), Index(std::move(I)) {}
 
-    Value eval(Environment& env) const override {
-        Value V = Base->eval(env);
-        int i = static_cast<int>(Index->eval(env).asNumber());
-        return V.atIndex(i);
+    Value eval(Frame& frame) const override {
+        Value V = Base->eval(frame);
+        if (frame.abrupt()) return V;
+        Value I = Index->eval(frame);
+        if (frame.abrupt()) return I;
+        return Specialized(*this, V, I);
     }
+
+    const ExprAST* getBase() const { return Base.get(); }
+    const ExprAST* getIndex() const { return Index.get(); }
+    // Узел перешёл на специализацию для списка и числового индекса
+    bool isListSpecialized() const { return Specialized == listByNumber; }
 };
 
 class SliceExprAST : public ExprAST {
@@ -351,19 +668,32 @@ class SliceExprAST : public ExprAST {
                  std::unique_ptr<ExprAST> E)
         : Base(std::move(B)), Start(std::move(S)), End(std::move(E)) {}
 
-    Value eval(Environment& env) const override {
-        Value V = Base->eval(env);
+    Value eval(Frame& frame) const override {
+        Value V = Base->eval(frame);
+        if (frame.abrupt()) return V;
         std::optional<int> b, e;
-        if (Start) b = static_cast<int>(Start->eval(env).asNumber());
-        if (End) e = static_cast<int>(End->eval(env).asNumber());
+        if (Start) {
+            Value S = Start->eval(frame);
+            if (frame.abrupt()) return S;
+            b = static_cast<int>(S.asNumber());
+        }
+        if (End) {
+            Value E = End->eval(frame);
+            if (frame.abrupt()) return E;
+            e = static_cast<int>(E.asNumber());
+        }
         return V.slice(b, e);
     }
+
+    const ExprAST* getBase() const { return Base.get(); }
+    const ExprAST* getStart() const { return Start.get(); }
+    const ExprAST* getEnd() const { return End.get(); }
 };
 
 class NilExprAST : public ExprAST {
    public:
     NilExprAST() {}
-    Value eval(Environment& env) const override {
+    Value eval(Frame& frame) const override {
         return Value();
     }
 };
@@ -381,13 +711,16 @@ class IfExprAST : public ExprAST {
 
     void setElse(std::unique_ptr<ExprAST> E) { Else = std::move(E); }
     ExprAST* getElse() const { return Else.get(); }
-
-    Value eval(Environment& env) const override {
-        bool c = Cond->eval(env).asBool();
-        if (c)
-            return Then->eval(env);
+    const ExprAST* getCond() const { return Cond.get(); }
+    const ExprAST* getThen() const { return Then.get(); }
+
+    Value eval(Frame& frame) const override {
+        Value C = Cond->eval(frame);
+        if (frame.abrupt()) return C;
+        if (C.asBool())
+            return Then->eval(frame);
         else if (Else)
-            return Else->eval(env);
+            return Else->eval(frame);
         return Value();
     }
 };
@@ -399,47 +732,66 @@ class WhileExprAST : public ExprAST {
     WhileExprAST(std::unique_ptr<ExprAST> cond,
                  std::unique_ptr<ExprAST> body)
         : Cond(std::move(cond)), Body(std::move(body)) {}
-    Value eval(Environment& env) const override {
+
+    const ExprAST* getCond() const { return Cond.get(); }
+    const ExprAST* getBody() const { return Body.get(); }
+
+    Value eval(Frame& frame) const override {
         Value result;
-        while (Cond->eval(env).asBool()) {
-            try {
-                result = Body->eval(env);
-            } catch (const ContinueException&) {
+        for (;;) {
+            Value C = Cond->eval(frame);
+            if (frame.abrupt()) return C;
+            if (!C.asBool()) break;
+            Value V = Body->eval(frame);
+            if (frame.completion == Completion::Normal) {
+                result = std::move(V);
                 continue;
-            } catch (const BreakException&) {
-                break;
             }
+            if (frame.completion == Completion::Return) return V;
+            bool stop = frame.completion == Completion::Break;
+            frame.completion = Completion::Normal;
+            if (stop) break;
         }
         return result;
     }
 };
 
 class ForExprAST : public ExprAST {
-    std::string VarName;
+    Symbol VarName;
     std::unique_ptr<ExprAST> SeqExpr, Body;
+    VarSlot Slot;
 
    public:
-    ForExprAST(std::string var,
+    ForExprAST(Symbol var,
                std::unique_ptr<ExprAST> seq,
                std::unique_ptr<ExprAST> body)
-        : VarName(std::move(var)),
+        : VarName(var),
           SeqExpr(std::move(seq)),
           Body(std::move(body)) {}
-    Value eval(Environment& env) const override {
-        Value seqV = SeqExpr->eval(env);
-        if (!seqV.isList())
-            throw std::runtime_error("For: ожидается список в выражении 'in'");
-        auto list = seqV.asList();
-        Value result;
-        for (auto& el : list) {
-            env.set(VarName, el);
-            try {
-                result = Body->eval(env);
-            } catch (const ContinueException&) {
+
+    const std::string& getVarName() const { return VarName.name(); }
+    Symbol getSymbol() const { return VarName; }
+    const ExprAST* getSeq() const { return SeqExpr.get(); }
+    const ExprAST* getBody() const { return Body.get(); }
+    const VarSlot& getSlot() const { return Slot; }
+    void setSlot(VarSlot s) { Slot = s; }
+
+    Value eval(Frame& frame) const override {
+        Value seqV = SeqExpr->eval(frame);
+        if (frame.abrupt()) return seqV;
+        SequenceIterator it(seqV);
+        Value result, el;
+        while (it.next(el)) {
+            frame.set(Slot, el);
+            Value V = Body->eval(frame);
+            if (frame.completion == Completion::Normal) {
+                result = std::move(V);
                 continue;
-            } catch (const BreakException&) {
-                break;
             }
+            if (frame.completion == Completion::Return) return V;
+            bool stop = frame.completion == Completion::Break;
+            frame.completion = Completion::Normal;
+            if (stop) break;
         }
         return result;
     }
@@ -447,15 +799,17 @@ class ForExprAST : public ExprAST {
 
 class BreakExprAST : public ExprAST {
    public:
-    Value eval(Environment&) const override {
-        throw BreakException();
+    Value eval(Frame& frame) const override {
+        frame.completion = Completion::Break;
+        return Value();
     }
 };
 
 class ContinueExprAST : public ExprAST {
    public:
-    Value eval(Environment&) const override {
-        throw ContinueException();
+    Value eval(Frame& frame) const override {
+        frame.completion = Completion::Continue;
+        return Value();
     }
 };
 
@@ -466,11 +820,16 @@ class InExprAST : public ExprAST {
     InExprAST(std::unique_ptr<ExprAST> lhs, std::unique_ptr<ExprAST> rhs)
         : L(std::move(lhs)), R(std::move(rhs)) {}
 
-    Value eval(Environment& env) const override {
-        std::string hay = L->eval(env).asString();
-        std::string needle = R->eval(env).asString();
-        return Value(hay.find(needle) != std::string::npos);
+    Value eval(Frame& frame) const override {
+        Value N = L->eval(frame);
+        if (frame.abrupt()) return N;
+        Value H = R->eval(frame);
+        if (frame.abrupt()) return H;
+        return Value(Value::contains(N, H));
     }
+
+    const ExprAST* getLHS() const { return L.get(); }
+    const ExprAST* getRHS() const { return R.get(); }
 };
 
 class BlockExprAST : public ExprAST {
@@ -479,12 +838,16 @@ class BlockExprAST : public ExprAST {
    public:
     BlockExprAST(std::vector<std::unique_ptr<ExprAST>> stmts)
         : Stmts(std::move(stmts)) {}
-    Value eval(Environment& env) const override {
+    Value eval(Frame& frame) const override {
         Value last;
-        for (auto& s : Stmts)
-            last = s->eval(env);
+        for (auto& s : Stmts) {
+            last = s->eval(frame);
+            if (frame.abrupt()) break;
+        }
         return last;
     }
+
+    const std::vector<std::unique_ptr<ExprAST>>& getStatements() const { return Stmts; }
 };
 
 class ReturnExprAST : public ExprAST {
@@ -494,8 +857,12 @@ class ReturnExprAST : public ExprAST {
     explicit ReturnExprAST(std::unique_ptr<ExprAST> expr)
         : Expr(std::move(expr)) {}
 
-    Value eval(Environment& env) const override {
-        Value v = Expr->eval(env);
-        throw ReturnException(v);
+    Value eval(Frame& frame) const override {
+        Value v = Expr->eval(frame);
+        if (frame.abrupt()) return v;
+        frame.completion = Completion::Return;
+        return v;
     }
+
+    const ExprAST* getExpr() const { return Expr.get(); }
 };
@@ -0,0 +1,70 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <vector>
+
+// Память для узлов AST одного модуля. Узлы выделяются подряд в больших блоках
+// в порядке разбора, а освобождаются все разом вместе с ареной. Арену держат
+// функции модуля, поэтому она живёт, пока жив хотя бы один её узел.
+class AstArena : public std::enable_shared_from_this<AstArena> {
+   public:
+    // Пока объект жив, новые узлы создаются в арене
+    class Scope {
+       public:
+        explicit Scope(AstArena& arena) : saved_(current_) { current_ = &arena; }
+        ~Scope() { current_ = saved_; }
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+       private:
+        AstArena* saved_;
+    };
+
+    static AstArena* current() { return current_; }
+
+    // Узел, созданный вне арены, выделяется отдельно — заголовок хранит, откуда он
+    static void* allocateNode(size_t size) {
+        AstArena* arena = current_;
+        size_t total = size + kHeader;
+        auto* mem = arena ? arena->allocate(total) : static_cast<std::byte*>(::operator new(total));
+        *reinterpret_cast<uint64_t*>(mem) = arena ? 1 : 0;
+        return mem + kHeader;
+    }
+
+    static void freeNode(void* p) {
+        auto* mem = static_cast<std::byte*>(p) - kHeader;
+        if (*reinterpret_cast<uint64_t*>(mem) == 0) ::operator delete(mem);
+    }
+
+    size_t blockCount() const { return blocks_.size(); }
+
+   private:
+    static constexpr size_t kBlockSize = 64 * 1024;
+    // Узлы AST содержат указатели, числа и строки — им достаточно выравнивания 8
+    static constexpr size_t kHeader = 8;
+
+    std::byte* allocate(size_t size) {
+        size = (size + 7) & ~size_t{7};
+        if (size > kBlockSize / 4) {
+            blocks_.push_back(std::make_unique_for_overwrite<std::byte[]>(size));
+            return blocks_.back().get();
+        }
+        if (used_ + size > kBlockSize) {
+            blocks_.push_back(std::make_unique_for_overwrite<std::byte[]>(kBlockSize));
+            block_ = blocks_.back().get();
+            used_ = 0;
+        }
+        std::byte* p = block_ + used_;
+        used_ += size;
+        return p;
+    }
+
+    inline static thread_local AstArena* current_ = nullptr;
+
+    std::vector<std::unique_ptr<std::byte[]>> blocks_;
+    std::byte* block_ = nullptr;  // блок, из которого выделяются узлы
+    size_t used_ = kBlockSize;
+};
@@ -0,0 +1,139 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "value.h"
+
+// Привязка C++-функций к скриптам. По сигнатуре функции на этапе компиляции
+// получается NativeFn: проверка числа аргументов, преобразование аргументов
+// и результата, сообщения об ошибках с именем функции.
+//
+//   double hypot2(double x, double y);
+//   NativeFn a = bindNative<"hypot2", hypot2>();
+//   NativeFn b = bindNative<"sqrt", double(double), std::sqrt>();   // перегруженная функция
+//
+// Параметры: числа, bool, std::string, std::string_view, Value, const Value&
+// и std::span<const Value> (элементы списка). Результат — те же типы, кроме
+// ссылок и span, Value::RawList или void (nil). Число в Value хранится как есть,
+// поэтому числовые аргументы и результат не выделяют память.
+
+// Имя функции для сообщений об ошибках: строковый литерал как параметр шаблона
+template <size_t N>
+struct NativeName {
+    char chars[N];
+
+    constexpr NativeName(const char (&s)[N]) { std::copy_n(s, N, chars); }
+    constexpr std::string_view view() const { return {chars, N - 1}; }
+};
+
+namespace native_detail {
+
+template <class T>
+struct Arg {
+    static_assert(sizeof(T) == 0, "bindNative: unsupported parameter type");
+};
+
+template <class T>
+    requires std::is_arithmetic_v<T> && (!std::is_same_v<T, bool>)
+struct Arg<T> {
+    using type = T;
+    static T from(Value& v) { return static_cast<T>(Value::asNumeric(v)); }
+};
+
+template <>
+struct Arg<bool> {
+    using type = bool;
+    static bool from(Value& v) { return v.asBool(); }
+};
+
+template <>
+struct Arg<std::string> {
+    using type = std::string;
+    static std::string from(Value& v) { return std::string(v.asString()); }
+};
+
+// Строка остаётся в окне аргументов до конца вызова
+template <>
+struct Arg<std::string_view> {
+    using type = std::string_view;
+    static std::string_view from(Value& v) { return v.asString(); }
+};
+
+template <>
+struct Arg<Value> {
+    using type = Value;
+    static Value from(Value& v) { return std::move(v); }
+};
+
+template <>
+struct Arg<const Value&> {
+    using type = const Value&;
+    static const Value& from(Value& v) { return v; }
+};
+
+template <>
+struct Arg<std::span<const Value>> {
+    using type = std::span<const Value>;
+    static std::span<const Value> from(Value& v) { return v.asList(); }
+};
+
+template <class R>
+Value result(R&& r) {
+    using T = std::remove_cvref_t<R>;
+    if constexpr (std::is_same_v<T, Value>)
+        return std::forward<R>(r);
+    else if constexpr (std::is_same_v<T, bool>)
+        return Value(r);
+    else if constexpr (std::is_arithmetic_v<T>)
+        return Value(static_cast<double>(r));
+    else if constexpr (std::is_convertible_v<T, std::string_view>)
+        return Value(std::string_view(r));
+    else if constexpr (std::is_same_v<T, Value::RawList>)
+        return Value(std::forward<R>(r));
+    else
+        static_assert(sizeof(T) == 0, "bindNative: unsupported result type");
+}
+
+[[noreturn]] inline void arityError(std::string_view name, size_t expected, size_t got) {
+    throw std::runtime_error(std::string(name) + ": expected " + std::to_string(expected) +
+                             (expected == 1 ? " argument" : " arguments") + ", got " + std::to_string(got));
+}
+
+template <NativeName Name, auto F, class R, class... Params>
+Value call(std::span<Value> args) {
+    if (args.size() != sizeof...(Params)) arityError(Name.view(), sizeof...(Params), args.size());
+    return [&]<size_t... I>(std::index_sequence<I...>) {
+        // Фигурные скобки задают порядок: аргументы преобразуются слева направо
+        std::tuple<typename Arg<Params>::type...> converted{Arg<Params>::from(args[I])...};
+        if constexpr (std::is_void_v<R>) {
+            std::apply(F, std::move(converted));
+            return Value();
+        } else {
+            return result(std::apply(F, std::move(converted)));
+        }
+    }(std::index_sequence_for<Params...>{});
+}
+
+template <NativeName Name, auto F, class R, class... Params>
+constexpr NativeFn native(R (*)(Params...)) {
+    return &call<Name, F, R, Params...>;
+}
+
+}  // namespace native_detail
+
+template <NativeName Name, auto F>
+constexpr NativeFn bindNative() {
+    return native_detail::native<Name, F>(F);
+}
+
+template <NativeName Name, class Sig, Sig* F>
+constexpr NativeFn bindNative() {
+    return native_detail::native<Name, F>(F);
+}
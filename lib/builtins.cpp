@@ -0,0 +1,442 @@
+#include "builtins.h"
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "bind.h"
+#include "heap.h"
+
+namespace {
+
+// print(something)
+Value builtinPrint(std::span<Value> args) {
+    for (auto& v : args)
+        *HostIO::current().output << v.toString();
+    return Value{};
+}
+
+// println(something)
+Value builtinPrintln(std::span<Value> args) {
+    for (auto& v : args)
+        *HostIO::current().output << v.toString();
+    *HostIO::current().output << '\n';
+    return Value{};
+}
+
+// sqrt(x)
+double sqrtChecked(double x) {
+    if (x < 0)
+        throw std::runtime_error("sqrt: negative argument");
+    return std::sqrt(x);
+}
+
+// rnd([min,] max)
+Value builtinRnd(std::span<Value> args) {
+    static thread_local std::mt19937_64 gen(std::random_device{}());
+
+    if (args.empty()) {
+        std::uniform_real_distribution<double> dist(0.0, 1.0);
+        return Value{dist(gen)};
+    }
+    if (args.size() == 1 && args[0].isNumber()) {
+        long long max = static_cast<long long>(args[0].asNumber());
+        if (max <= 0) return Value{0.0};
+        std::uniform_int_distribution<long long> dist(0, max - 1);
+        return Value{static_cast<double>(dist(gen))};
+    }
+    if (args.size() == 2 && args[0].isNumber() && args[1].isNumber()) {
+        long long a = static_cast<long long>(args[0].asNumber());
+        long long b = static_cast<long long>(args[1].asNumber());
+        if (a > b) std::swap(a, b);
+        if (a == b) return Value{static_cast<double>(a)};
+        std::uniform_int_distribution<long long> dist(a, b - 1);
+        return Value{static_cast<double>(dist(gen))};
+    }
+
+    throw std::runtime_error(
+        "rnd(): expected 0, 1 or 2 numeric arguments");
+}
+
+// max(a,b, ...)
+Value builtinMax(std::span<Value> args) {
+    double max = std::numeric_limits<double>::lowest();
+
+    if (args.size() == 1 && args[0].isList()) {
+        for (size_t i = 0; i < args[0].asList().size(); ++i) {
+            max = std::max(max, Value::asNumeric(args[0].asList()[i]));
+        }
+    } else
+        for (size_t i = 0; i < args.size(); ++i) {
+            max = std::max(max, Value::asNumeric(args[i]));
+        }
+    return Value{max};
+}
+
+// min(a,b, ...)
+Value builtinMin(std::span<Value> args) {
+    double min = std::numeric_limits<double>::max();
+    if (args.size() == 1 && args[0].isList()) {
+        for (size_t i = 0; i < args[0].asList().size(); ++i) {
+            min = std::min(min, Value::asNumeric(args[0].asList()[i]));
+        }
+    } else
+        for (size_t i = 0; i < args.size(); ++i) {
+            min = std::min(min, Value::asNumeric(args[i]));
+        }
+    return Value{min};
+}
+
+// len(s)
+Value builtinLen(std::span<Value> args) {
+    if (args[0].isString()) {
+        return Value(static_cast<double>(args[0].asString().size()));
+    } else if (args[0].isList()) {
+        return Value{static_cast<double>(args[0].listSize())};
+    } else
+        return Value{};
+}
+
+// lower(s)
+std::string lower(std::string s) {
+    for_each(s.begin(), s.end(), [](char& c) {
+        c = std::tolower(c);
+    });
+    return s;
+}
+
+// upper(s)
+std::string upper(std::string s) {
+    for_each(s.begin(), s.end(), [](char& c) {
+        c = std::toupper(c);
+    });
+    return s;
+}
+
+// split(s, delim)
+Value builtinSplit(std::span<Value> args) {
+    if (args.empty()) {
+        return Value{Value::RawList{}};
+    }
+    std::string_view s = args[0].asString();
+    std::string sep;
+    if (args.size() == 2) {
+        sep = args[1].asString();
+    }
+
+    Value::RawList parts;
+    if (sep.empty()) {
+        size_t i = 0, n = s.size();
+        while (i < n) {
+            while (i < n && std::isspace(static_cast<unsigned char>(s[i]))) ++i;
+            if (i >= n) break;
+            size_t j = i;
+            while (j < n && !std::isspace(static_cast<unsigned char>(s[j]))) ++j;
+            parts.emplace_back(s.substr(i, j - i));
+            i = j;
+        }
+    } else {
+        size_t start = 0, pos;
+        while ((pos = s.find(sep, start)) != std::string::npos) {
+            if (pos > start) {
+                parts.emplace_back(s.substr(start, pos - start));
+            }
+            start = pos + sep.size();
+        }
+        if (start < s.size()) {
+            parts.emplace_back(s.substr(start));
+        }
+    }
+    return Value{std::move(parts)};
+}
+
+// parse_num(s)
+Value builtinParseNum(std::span<Value> args) {
+    if (args.empty()) {
+        return Value{};
+    }
+    const Value& x = args[0];
+    if (x.isNumber() || x.isBool()) {
+        return Value{Value::asNumeric(x)};
+    } else if (x.isString()) {
+        std::string str(x.asString());
+        try {
+            size_t idx = 0;
+            double d = std::stod(str, &idx);
+            if (idx == str.size()) {
+                return Value{d};
+            }
+        } catch (...) {
+        }
+    }
+    return Value{};
+}
+
+// range(start, end, step)
+Value builtinRange(std::span<Value> args) {
+    double start, end, step;
+
+    if (args.size() == 1) {
+        start = 0.0;
+        end = Value::asNumeric(args[0]);
+        step = 1.0;
+    } else if (args.size() == 2) {
+        start = Value::asNumeric(args[0]);
+        end = Value::asNumeric(args[1]);
+        step = 1.0;
+    } else if (args.size() == 3) {
+        start = Value::asNumeric(args[0]);
+        end = Value::asNumeric(args[1]);
+        step = Value::asNumeric(args[2]);
+    } else {
+        throw std::runtime_error("range: expected 1 to 3 numeric arguments");
+    }
+
+    return Value::range(start, end, step);
+}
+
+// to_string(something)
+std::string toString(const Value& v) {
+    return v.toString();
+}
+
+// Функции списков
+
+// join(list, delim)
+Value builtinJoin(std::span<Value> args) {
+    auto lst = args[0].asList();
+    std::string delim = " ";
+    if (args.size() == 2)
+        delim = args[1].asString();
+    std::string result;
+    for (size_t i = 0; i < lst.size(); ++i) {
+        result += lst[i].toString();
+        if (i + 1 < lst.size())
+            result += delim;
+    }
+    return Value(result);
+}
+
+// push(list, value)
+Value builtinPush(std::span<Value> args) {
+    if (args.size() != 2 || !args[0].isList()) {
+        throw std::runtime_error("push(list, elem): expected a list and an element");
+    }
+    args[0].mutableList().push_back(args[1]);
+    return Value{};
+}
+
+// insert(list, index, value)
+Value builtinInsert(std::span<Value> args) {
+    if (args.size() != 3 || !args[0].isList() || !args[1].isNumber()) {
+        throw std::runtime_error(
+            "insert(list, index, value): expected (list, number, any)");
+    }
+    auto& list = args[0].mutableList();
+    ptrdiff_t idx = static_cast<ptrdiff_t>(Value::asNumeric(args[1]));
+    if (idx < 0 || static_cast<size_t>(idx) > list.size()) {
+        throw std::out_of_range("insert: index out of range");
+    }
+    list.insert(list.begin() + idx, args[2]);
+    return Value{};
+}
+
+// pop(list)
+Value builtinPop(std::span<Value> args) {
+    if (args.size() != 1 || !args[0].isList()) {
+        throw std::runtime_error("push(list, elem): expected a list");
+    }
+    auto& list = args[0].mutableList();
+    Value v = Value{list.back()};
+    list.pop_back();
+    return v;
+}
+
+// remove(list, index)
+Value builtinRemove(std::span<Value> args) {
+    if (args.size() != 2 || !args[0].isList() || !args[1].isNumber()) {
+        throw std::runtime_error(
+            "remove(list, index): expected (list, number)");
+    }
+    auto& list = args[0].mutableList();
+    ptrdiff_t idx = static_cast<ptrdiff_t>(Value::asNumeric(args[1]));
+    if (idx < 0 || static_cast<size_t>(idx) >= list.size()) {
+        throw std::out_of_range("remove: index out of range");
+    }
+    list.erase(list.begin() + idx);
+    return Value{};
+}
+
+// sort(list): сортирует копию списка “по toString()”
+Value builtinSort(std::span<Value> args) {
+    if (args.size() != 1 || !args[0].isList()) {
+        throw std::runtime_error("sort: expected a single list argument");
+    }
+    auto lst = args[0].asList();
+
+    // Ключи считаются один раз на элемент, сортируются номера элементов
+    std::vector<std::string> keys;
+    keys.reserve(lst.size());
+    for (const Value& v : lst) keys.push_back(v.toString());
+    std::vector<size_t> order(lst.size());
+    for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+    std::sort(order.begin(), order.end(), [&keys](size_t a, size_t b) {
+        return keys[a] < keys[b];
+    });
+
+    Value::RawList vec;
+    vec.reserve(order.size());
+    for (size_t i : order) vec.push_back(lst[i]);
+    return Value(std::move(vec));
+}
+
+// replace(s, old, new)
+Value builtinReplace(std::span<Value> args) {
+    if (args.size() != 3 || !args[0].isString() || !args[1].isString() || !args[2].isString()) {
+        throw std::runtime_error("replace: expected (string, string, string)");
+    }
+    std::string s(args[0].asString());
+    std::string_view old = args[1].asString();
+    std::string_view nw = args[2].asString();
+
+    if (old.empty()) {
+        return args[0];
+    }
+    size_t pos = 0;
+    while ((pos = s.find(old, pos)) != std::string::npos) {
+        s.replace(pos, old.length(), nw);
+        pos += nw.length();
+    }
+    return Value(s);
+}
+
+// read(): читает строку из входного потока и возвращает её как строку
+Value builtinRead(std::span<Value> args) {
+    if (!args.empty()) {
+        throw std::runtime_error("read: expected no arguments");
+    }
+    std::string line;
+    if (!std::getline(*HostIO::current().input, line)) {
+        return Value{};
+    }
+    return Value(line);
+}
+
+// stacktrace(): возвращает список (LAIST) из имён функций, начиная с самого раннего вызова
+Value builtinStacktrace(std::span<Value> args) {
+    if (!args.empty()) {
+        throw std::runtime_error("stacktrace: expected no arguments");
+    }
+    Value::RawList lst;
+    for (const auto& name : g_callStack) {
+        lst.emplace_back(Value(*name));
+    }
+    return Value(std::move(lst));
+}
+
+struct BuiltinDef {
+    std::string_view name;
+    NativeFn fn;
+};
+
+constexpr BuiltinDef builtins[] = {
+    {"print", builtinPrint},
+    {"println", builtinPrintln},
+    {"abs", bindNative<"abs", double(double), std::fabs>()},
+    {"sqrt", bindNative<"sqrt", sqrtChecked>()},
+    {"ceil", bindNative<"ceil", double(double), std::ceil>()},
+    {"floor", bindNative<"floor", double(double), std::floor>()},
+    {"round", bindNative<"round", double(double), std::round>()},
+    {"rnd", builtinRnd},
+    {"max", builtinMax},
+    {"min", builtinMin},
+    {"len", builtinLen},
+    {"lower", bindNative<"lower", lower>()},
+    {"upper", bindNative<"upper", upper>()},
+    {"split", builtinSplit},
+    {"parse_num", builtinParseNum},
+    {"range", builtinRange},
+    {"to_string", bindNative<"to_string", toString>()},
+    {"join", builtinJoin},
+    {"push", builtinPush},
+    {"insert", builtinInsert},
+    {"pop", builtinPop},
+    {"remove", builtinRemove},
+    {"sort", builtinSort},
+    {"replace", builtinReplace},
+    {"read", builtinRead},
+    {"stacktrace", builtinStacktrace},
+};
+
+// Совершенный хеш имён: FNV-1a с затравкой, которую подбирает компилятор так,
+// чтобы все имена попали в разные ячейки. Ячейку задают старшие биты:
+// младшие у FNV зависят только от младших битов символов
+constexpr size_t kSlotBits = 6;
+constexpr size_t kSlots = size_t{1} << kSlotBits;
+
+constexpr uint32_t nameHash(std::string_view name, uint32_t seed) {
+    uint32_t h = seed;
+    for (char c : name) h = (h ^ static_cast<unsigned char>(c)) * 16777619u;
+    return h >> (32 - kSlotBits);
+}
+
+constexpr uint32_t kSeed = [] {
+    for (uint32_t seed = 2166136261u;; ++seed) {
+        std::array<bool, kSlots> used{};
+        bool perfect = true;
+        for (const BuiltinDef& b : builtins) {
+            size_t slot = nameHash(b.name, seed);
+            perfect = perfect && !used[slot];
+            used[slot] = true;
+        }
+        if (perfect) return seed;
+    }
+}();
+
+constexpr std::array<int8_t, kSlots> slots = [] {
+    std::array<int8_t, kSlots> table;
+    table.fill(-1);
+    for (size_t i = 0; i < std::size(builtins); ++i) table[nameHash(builtins[i].name, kSeed)] = static_cast<int8_t>(i);
+    return table;
+}();
+
+thread_local HostIO* t_io = nullptr;
+
+}  // namespace
+
+HostIO& HostIO::current() {
+    static thread_local HostIO standard{&std::cin, &std::cout};
+    return t_io ? *t_io : standard;
+}
+
+HostIO::Scope::Scope(HostIO io) : io_(io), saved_(t_io) {
+    t_io = &io_;
+}
+
+HostIO::Scope::~Scope() {
+    t_io = saved_;
+}
+
+int findBuiltin(std::string_view name) {
+    int id = slots[nameHash(name, kSeed)];
+    return id >= 0 && builtins[id].name == name ? id : -1;
+}
+
+const Value& builtinValue(int id) {
+    // Функции — объекты кучи потока, поэтому у каждого потока свои
+    static thread_local std::array<Value, std::size(builtins)> values;
+    Value& v = values[id];
+    if (v.isNil()) {
+        v = Value(FunctionValue(builtins[id].fn));
+        Heap::local().untrack(v);
+    }
+    return v;
+}
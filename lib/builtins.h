@@ -0,0 +1,41 @@
+#pragma once
+#include <istream>
+#include <ostream>
+#include <string_view>
+
+#include "value.h"
+
+// Потоки, с которыми работают print/println и read
+struct HostIO {
+    std::istream* input;
+    std::ostream* output;
+
+    class Scope;
+
+    // Потоки текущего запуска в этом потоке; вне запусков — std::cin и std::cout
+    static HostIO& current();
+};
+
+// Подменяет потоки на время запуска
+class HostIO::Scope {
+   public:
+    explicit Scope(HostIO io);
+    ~Scope();
+
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+
+   private:
+    HostIO io_;
+    HostIO* saved_;
+};
+
+// Встроенные функции — неизменяемая таблица, собранная при компиляции.
+// Resolver запоминает номер builtin-а для глобала с тем же именем, и таблица
+// глобалов получает функцию без поиска по имени.
+
+// Номер builtin-а или -1, если такого нет
+int findBuiltin(std::string_view name);
+
+// Значение-функция builtin-а; создаётся один раз на поток
+const Value& builtinValue(int id);
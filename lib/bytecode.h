@@ -0,0 +1,145 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "scope.h"
+#include "value.h"
+
+// Регистровый байткод. R[x] — регистр текущего кадра, K[x] — константа,
+// G[x] — глобальная переменная, U[x] — upvalue замыкания.
+// Операнды b/c бинарных операций могут ссылаться на константу (флаги kBConst/kCConst),
+// RK[x] обозначает такой операнд.
+//
+//   LoadNil     R[a] = nil
+//   LoadBool    R[a] = (bool)b
+//   LoadK       R[a] = K[bx]
+//   Move        R[a] = R[b]
+//   GetGlobal   R[a] = G[bx]
+//   SetGlobal   G[bx] = R[a]
+//   GetUpval    R[a] = U[b]
+//   SetUpval    U[b] = R[a]
+//   Add .. Or   R[a] = RK[b] op RK[c]; FMod — остаток для %= (без проверки деления на ноль)
+//   Neg         R[a] = 0 - R[b]
+//   Not         R[a] = !truthy(R[b])
+//   NewList     R[a] = [R[b], ..., R[b + c - 1]]
+//   Index       R[a] = R[b][RK[c]]
+//   Slice       R[a] = R[b][R[c] : R[c + 1]], отсутствующие границы — флаги kNoStart/kNoEnd
+//   In          R[a] = R[b] in R[c]
+//   Closure     R[a] = closure(P[bx])
+//   Call        R[a] = R[a](R[a + 1], ..., R[a + b])
+//   Return      return R[a]
+//   ReturnNil   return nil
+//   Jmp         pc = bx
+//   JmpIfFalse  if !truthy(R[a]) pc = bx
+//   JmpIfTrue   if truthy(R[a]) pc = bx
+//   JmpIfNotXx  if !(RK[b] xx RK[c]) pc = bx следующего слова, иначе слово пропускается
+//   ForPrep     R[a] = снимок списка R[a], R[a + 1] = 0
+//   ForLoop     если в R[a] остался элемент: R[b] = элемент, pc = bx следующего слова,
+//               иначе слово пропускается
+//   Raise       throw runtime_error(K[bx])
+#define ISCRIPT_OPCODES(X) \
+    X(LoadNil)             \
+    X(LoadBool)            \
+    X(LoadK)               \
+    X(Move)                \
+    X(GetGlobal)           \
+    X(SetGlobal)           \
+    X(GetUpval)            \
+    X(SetUpval)            \
+    X(Add)                 \
+    X(Sub)                 \
+    X(Mul)                 \
+    X(Div)                 \
+    X(Mod)                 \
+    X(FMod)                \
+    X(Pow)                 \
+    X(Eq)                  \
+    X(Ne)                  \
+    X(Lt)                  \
+    X(Le)                  \
+    X(Gt)                  \
+    X(Ge)                  \
+    X(And)                 \
+    X(Or)                  \
+    X(Neg)                 \
+    X(Not)                 \
+    X(NewList)             \
+    X(Index)               \
+    X(Slice)               \
+    X(In)                  \
+    X(Closure)             \
+    X(Call)                \
+    X(Return)              \
+    X(ReturnNil)           \
+    X(Jmp)                 \
+    X(JmpIfFalse)          \
+    X(JmpIfTrue)           \
+    X(JmpIfNotEq)          \
+    X(JmpIfNotNe)          \
+    X(JmpIfNotLt)          \
+    X(JmpIfNotLe)          \
+    X(JmpIfNotGt)          \
+    X(JmpIfNotGe)          \
+    X(ForPrep)             \
+    X(ForLoop)             \
+    X(Raise)
+
+enum class OpCode : uint8_t {
+#define ISCRIPT_OPCODE_ENUM(name) name,
+    ISCRIPT_OPCODES(ISCRIPT_OPCODE_ENUM)
+#undef ISCRIPT_OPCODE_ENUM
+};
+
+struct Instruction {
+    static constexpr uint8_t kBConst = 1;
+    static constexpr uint8_t kCConst = 2;
+    static constexpr uint8_t kNoStart = 4;
+    static constexpr uint8_t kNoEnd = 8;
+
+    OpCode op;
+    uint8_t flags = 0;
+    uint16_t a = 0;
+    uint16_t b = 0;
+    uint16_t c = 0;
+
+    uint32_t bx() const { return uint32_t(b) | (uint32_t(c) << 16); }
+    void setBx(uint32_t v) {
+        b = static_cast<uint16_t>(v);
+        c = static_cast<uint16_t>(v >> 16);
+    }
+};
+
+static_assert(sizeof(Instruction) == 8, "Instruction must stay 8 bytes");
+
+// Скомпилированная функция
+struct LazyBody;
+
+struct Proto {
+    std::string name;
+    uint16_t numParams = 0;
+    uint16_t numRegs = 0;
+    std::vector<Instruction> code;
+    std::vector<Value> constants;
+    std::vector<std::unique_ptr<Proto>> children;
+    std::vector<UpvalueDesc> upvalues;
+    // Функция без upvalue не зависит от места создания: все вычисления её
+    // литерала возвращают одно и то же замыкание
+    Value sharedClosure;
+    // Тело, которое парсер отложил: код появится при первом вызове
+    std::shared_ptr<const LazyBody> lazy;
+};
+
+struct Closure {
+    const Proto* proto;
+    std::vector<std::shared_ptr<UpvalueCell>> upvalues;
+};
+
+// Скомпилированный модуль: именованные функции привязываются к глобалам
+// до запуска, затем по порядку исполняются топ-левел выражения.
+struct Program {
+    GlobalNames globals;
+    std::vector<std::pair<uint32_t, std::unique_ptr<Proto>>> definitions;
+    std::vector<std::unique_ptr<Proto>> topLevel;
+};
@@ -0,0 +1,614 @@
+#include "compiler.h"
+
+#include <cstring>
+#include <stdexcept>
+
+#include "resolver.h"
+
+template <class T>
+static const T* as(const ExprAST* e) {
+    return dynamic_cast<const T*>(e);
+}
+
+// Может ли вычисление выражения изменить локальную переменную текущей функции
+static bool mayAssign(const ExprAST* e) {
+    if (!e) return false;
+    if (assignedName(e)) return true;
+    bool result = false;
+    forEachChild(e, [&](const ExprAST* child) { result = result || mayAssign(child); });
+    return result;
+}
+
+// Выражения, которые пишут в регистр назначения только последней инструкцией
+// и поэтому могут вычисляться прямо в регистр присваиваемой переменной.
+static bool writesDestLast(const ExprAST* e) {
+    if (auto* u = as<UnaryExprAST>(e)) return u->getOp() != '+';
+    return as<NumberExprAST>(e) || as<StringExprAST>(e) || as<BooleanExprAST>(e) ||
+           as<NilExprAST>(e) || as<VariableExprAST>(e) || as<BinaryExprAST>(e) ||
+           as<CallExprAST>(e) || as<IndexExprAST>(e) || as<SliceExprAST>(e) ||
+           as<ListExprAST>(e) || as<FunctionLiteralExprAST>(e) || as<InExprAST>(e);
+}
+
+static bool isConstantLiteral(const ExprAST* e) {
+    return as<NumberExprAST>(e) || as<StringExprAST>(e) || as<BooleanExprAST>(e) || as<NilExprAST>(e);
+}
+
+static OpCode binaryOpcode(TokenType op) {
+    switch (op) {
+        case TokenType::Plus:
+            return OpCode::Add;
+        case TokenType::Minus:
+            return OpCode::Sub;
+        case TokenType::Star:
+            return OpCode::Mul;
+        case TokenType::Slash:
+            return OpCode::Div;
+        case TokenType::Percent:
+            return OpCode::Mod;
+        case TokenType::Caret:
+            return OpCode::Pow;
+        case TokenType::Less:
+            return OpCode::Lt;
+        case TokenType::LessEqual:
+            return OpCode::Le;
+        case TokenType::Greater:
+            return OpCode::Gt;
+        case TokenType::GreaterEqual:
+            return OpCode::Ge;
+        case TokenType::Equal:
+            return OpCode::Eq;
+        case TokenType::NotEqual:
+            return OpCode::Ne;
+        case TokenType::And:
+            return OpCode::And;
+        case TokenType::Or:
+            return OpCode::Or;
+        default:
+            throw std::runtime_error("Unknown binary operator");
+    }
+}
+
+static OpCode compoundOpcode(TokenType op) {
+    switch (op) {
+        case TokenType::PlusAssign:
+            return OpCode::Add;
+        case TokenType::MinusAssign:
+            return OpCode::Sub;
+        case TokenType::StarAssign:
+            return OpCode::Mul;
+        case TokenType::SlashAssign:
+            return OpCode::Div;
+        case TokenType::PercentAssign:
+            return OpCode::FMod;
+        case TokenType::CaretAssign:
+            return OpCode::Pow;
+        default:
+            throw std::runtime_error("Unknown compound assignment operator");
+    }
+}
+
+// Переход «если сравнение ложно». Для перехода «если истинно» используется
+// дополнительное сравнение: в value.cpp '>=' — это !(a < b), а '>' — !(a <= b).
+static bool comparisonJump(TokenType op, bool jumpIfTrue, OpCode& out) {
+    switch (op) {
+        case TokenType::Less:
+            out = jumpIfTrue ? OpCode::JmpIfNotGe : OpCode::JmpIfNotLt;
+            return true;
+        case TokenType::LessEqual:
+            out = jumpIfTrue ? OpCode::JmpIfNotGt : OpCode::JmpIfNotLe;
+            return true;
+        case TokenType::Greater:
+            out = jumpIfTrue ? OpCode::JmpIfNotLe : OpCode::JmpIfNotGt;
+            return true;
+        case TokenType::GreaterEqual:
+            out = jumpIfTrue ? OpCode::JmpIfNotLt : OpCode::JmpIfNotGe;
+            return true;
+        case TokenType::Equal:
+            out = jumpIfTrue ? OpCode::JmpIfNotNe : OpCode::JmpIfNotEq;
+            return true;
+        case TokenType::NotEqual:
+            out = jumpIfTrue ? OpCode::JmpIfNotEq : OpCode::JmpIfNotNe;
+            return true;
+        default:
+            return false;
+    }
+}
+
+std::unique_ptr<Program> Compiler::compile(const std::vector<std::unique_ptr<FunctionAST>>& functions,
+                                           const GlobalNames& globals) {
+    auto program = std::make_unique<Program>();
+    program->globals = globals;
+    program_ = program.get();
+    for (auto& fn : functions) {
+        if (fn->getProto().getName() == "__anon_expr") {
+            program->topLevel.push_back(compileFunction(*fn));
+        } else {
+            uint32_t idx = program->globals.intern(fn->getProto().getName());
+            program->definitions.emplace_back(idx, compileFunction(*fn));
+        }
+    }
+    program_ = nullptr;
+    return program;
+}
+
+void Compiler::compileLazy(Proto& proto, const GlobalNames& globals) {
+    auto arena = std::make_shared<AstArena>();
+    AstArena::Scope scope(*arena);
+    FunctionAST fn(std::make_unique<PrototypeAST>(proto.name, proto.lazy->params), proto.lazy);
+    // Upvalue литерала известны с момента компиляции модуля
+    FunctionScope known;
+    known.upvalues = proto.upvalues;
+    fn.setScope(std::move(known));
+    // Резолвер только находит уже внесённые имена и таблицу не меняет
+    fn.setLazyGlobals(const_cast<GlobalNames*>(&globals));
+    fn.ensureBody();
+
+    std::unique_ptr<Proto> compiled = Compiler().compileFunction(fn);
+    proto.numRegs = compiled->numRegs;
+    proto.code = std::move(compiled->code);
+    proto.constants = std::move(compiled->constants);
+    proto.children = std::move(compiled->children);
+    proto.lazy.reset();
+}
+
+static void compileLazyTree(Proto& proto, const GlobalNames& globals) {
+    if (proto.lazy) Compiler::compileLazy(proto, globals);
+    for (auto& child : proto.children) compileLazyTree(*child, globals);
+}
+
+void Compiler::compileLazyBodies(Program& program) {
+    for (auto& [idx, proto] : program.definitions) compileLazyTree(*proto, program.globals);
+    for (auto& proto : program.topLevel) compileLazyTree(*proto, program.globals);
+}
+
+std::unique_ptr<Proto> Compiler::compileFunction(const FunctionAST& fn) {
+    auto proto = std::make_unique<Proto>();
+    const FunctionScope& scope = fn.getScope();
+    proto->name = fn.getProto().getName();
+    proto->numParams = scope.numParams;
+    proto->upvalues = scope.upvalues;
+
+    if (fn.isLazy()) {
+        proto->lazy = fn.getLazyBody();
+        proto->sharedClosure = Value(FunctionValue(std::make_shared<Closure>(Closure{proto.get(), {}})));
+        return proto;
+    }
+
+    FunctionState fs{proto.get()};
+    FunctionState* saved = fs_;
+    fs_ = &fs;
+    for (uint32_t i = 0; i < scope.numLocals; ++i) allocReg();
+
+    compileExpr(&fn.getBody(), kDiscard);
+    emit(OpCode::ReturnNil);
+
+    proto->numRegs = static_cast<uint16_t>(fs.maxReg);
+    fs_ = saved;
+    if (proto->upvalues.empty())
+        proto->sharedClosure = Value(FunctionValue(std::make_shared<Closure>(Closure{proto.get(), {}})));
+    return proto;
+}
+
+void Compiler::compileExpr(const ExprAST* e, int dest) {
+    FunctionState& fs = *fs_;
+    uint32_t savedFree = fs.freeReg;
+
+    if (!e || as<NilExprAST>(e)) {
+        if (dest != kDiscard) emit(OpCode::LoadNil, dest);
+    } else if (auto* n = as<NumberExprAST>(e)) {
+        if (dest != kDiscard) emitBx(OpCode::LoadK, dest, numberConst(n->getValue()));
+    } else if (auto* n = as<StringExprAST>(e)) {
+        if (dest != kDiscard) emitBx(OpCode::LoadK, dest, stringConst(n->getValue()));
+    } else if (auto* n = as<BooleanExprAST>(e)) {
+        if (dest != kDiscard) emit(OpCode::LoadBool, dest, n->getValue() ? 1 : 0);
+    } else if (auto* n = as<VariableExprAST>(e)) {
+        const VarSlot& var = n->getSlot();
+        if (dest != kDiscard) {
+            loadVar(var, dest);
+        } else if (var.kind == SlotKind::Global) {
+            // Чтение неопределённого глобала — ошибка даже без использования значения
+            loadVar(var, allocReg());
+        }
+    } else if (auto* n = as<BinaryExprAST>(e)) {
+        compileBinary(*n, dest);
+    } else if (auto* n = as<UnaryExprAST>(e)) {
+        if (!n->getOperand()) {
+            emitRaise("Missing operand of unary operator");
+        } else if (n->getOp() == '+') {
+            compileExpr(n->getOperand(), dest);
+        } else {
+            uint16_t src = exprToReg(n->getOperand());
+            uint32_t target = dest != kDiscard ? dest : allocReg();
+            emit(n->getOp() == '-' ? OpCode::Neg : OpCode::Not, target, src);
+        }
+    } else if (auto* n = as<CallExprAST>(e)) {
+        compileCall(*n, dest);
+    } else if (auto* n = as<AssignmentExprAST>(e)) {
+        compileAssignment(*n, dest);
+    } else if (auto* n = as<CompoundAssignmentExprAST>(e)) {
+        compileCompound(*n, dest);
+    } else if (auto* n = as<PrefixExprAST>(e)) {
+        compileIncDec(n->getOperand(), n->isIncrement(), true, dest);
+    } else if (auto* n = as<PostfixExprAST>(e)) {
+        compileIncDec(n->getOperand(), n->isIncrement(), false, dest);
+    } else if (auto* n = as<ListExprAST>(e)) {
+        const auto& elements = n->getElements();
+        uint32_t first = fs.freeReg;
+        for (auto& el : elements) compileExpr(el.get(), allocReg());
+        uint32_t target = dest != kDiscard ? dest : allocReg();
+        emit(OpCode::NewList, target, first, elements.size());
+    } else if (auto* n = as<FunctionLiteralExprAST>(e)) {
+        compileClosure(*n, dest);
+    } else if (auto* n = as<IndexExprAST>(e)) {
+        uint16_t base = exprToReg(n->getBase(), mayAssign(n->getIndex()));
+        Operand index = compileOperand(n->getIndex());
+        uint32_t target = dest != kDiscard ? dest : allocReg();
+        emitOperands(OpCode::Index, target, Operand{false, base}, index);
+    } else if (auto* n = as<SliceExprAST>(e)) {
+        bool later = mayAssign(n->getStart()) || mayAssign(n->getEnd());
+        uint16_t base = exprToReg(n->getBase(), later);
+        uint32_t bounds = allocReg();
+        allocReg();
+        uint8_t flags = 0;
+        if (n->getStart())
+            compileExpr(n->getStart(), bounds);
+        else
+            flags |= Instruction::kNoStart;
+        if (n->getEnd())
+            compileExpr(n->getEnd(), bounds + 1);
+        else
+            flags |= Instruction::kNoEnd;
+        uint32_t target = dest != kDiscard ? dest : allocReg();
+        emit(OpCode::Slice, target, base, bounds, flags);
+    } else if (auto* n = as<InExprAST>(e)) {
+        if (!n->getLHS() || !n->getRHS()) {
+            emitRaise("Malformed 'in' expression");
+        } else {
+            uint16_t lhs = exprToReg(n->getLHS(), mayAssign(n->getRHS()));
+            uint16_t rhs = exprToReg(n->getRHS());
+            uint32_t target = dest != kDiscard ? dest : allocReg();
+            emit(OpCode::In, target, lhs, rhs);
+        }
+    } else if (auto* n = as<IfExprAST>(e)) {
+        compileIf(*n, dest);
+    } else if (auto* n = as<WhileExprAST>(e)) {
+        compileWhile(*n, dest);
+    } else if (auto* n = as<ForExprAST>(e)) {
+        compileFor(*n, dest);
+    } else if (auto* n = as<BlockExprAST>(e)) {
+        const auto& stmts = n->getStatements();
+        if (stmts.empty() && dest != kDiscard) emit(OpCode::LoadNil, dest);
+        for (size_t i = 0; i < stmts.size(); ++i)
+            compileExpr(stmts[i].get(), i + 1 == stmts.size() ? dest : kDiscard);
+    } else if (auto* n = as<ReturnExprAST>(e)) {
+        emit(OpCode::Return, exprToReg(n->getExpr()));
+    } else if (as<BreakExprAST>(e)) {
+        if (fs.loops.empty())
+            emitRaise("'break' outside of a loop");
+        else
+            fs.loops.back().breakJumps.push_back(emitJump(OpCode::Jmp));
+    } else if (as<ContinueExprAST>(e)) {
+        if (fs.loops.empty())
+            emitRaise("'continue' outside of a loop");
+        else
+            fs.loops.back().continueJumps.push_back(emitJump(OpCode::Jmp));
+    } else {
+        throw std::runtime_error("Compiler: unsupported expression");
+    }
+
+    fs.freeReg = savedFree;
+}
+
+void Compiler::compileBinary(const BinaryExprAST& e, int dest) {
+    Operand lhs = compileOperand(e.getLHS(), mayAssign(e.getRHS()));
+    Operand rhs = compileOperand(e.getRHS());
+    uint32_t target = dest != kDiscard ? dest : allocReg();
+    emitOperands(binaryOpcode(e.getOp()), target, lhs, rhs);
+}
+
+void Compiler::compileCall(const CallExprAST& e, int dest) {
+    uint32_t base = allocReg();
+    compileExpr(e.getCallee(), base);
+    const auto& args = e.getArgs();
+    for (auto& arg : args) compileExpr(arg.get(), allocReg());
+    emit(OpCode::Call, base, args.size());
+    if (dest != kDiscard) emitMove(dest, base);
+}
+
+void Compiler::compileAssignment(const AssignmentExprAST& e, int dest) {
+    const VarSlot& var = e.getSlot();
+    uint16_t src;
+    if (var.kind == SlotKind::Local) {
+        src = static_cast<uint16_t>(var.index);
+        if (writesDestLast(e.getExpr())) {
+            // Литерал функции, собранный прямо в регистр переменной, захватывает
+            // сам себя — так работают рекурсивные локальные функции.
+            compileExpr(e.getExpr(), src);
+        } else {
+            uint16_t tmp = exprToReg(e.getExpr(), true);
+            emitMove(src, tmp);
+        }
+    } else {
+        src = exprToReg(e.getExpr());
+        storeVar(var, src);
+    }
+    if (dest != kDiscard) emitMove(dest, src);
+}
+
+void Compiler::compileCompound(const CompoundAssignmentExprAST& e, int dest) {
+    const VarSlot& var = e.getSlot();
+    OpCode op = compoundOpcode(e.getOp());
+    uint16_t target;
+    if (var.kind == SlotKind::Local) {
+        target = static_cast<uint16_t>(var.index);
+        uint16_t old = target;
+        if (mayAssign(e.getRHS())) {
+            old = allocReg();
+            emitMove(old, target);
+        }
+        Operand rhs = compileOperand(e.getRHS());
+        emitOperands(op, target, Operand{false, old}, rhs);
+    } else {
+        target = allocReg();
+        loadVar(var, target);
+        Operand rhs = compileOperand(e.getRHS());
+        emitOperands(op, target, Operand{false, target}, rhs);
+        storeVar(var, target);
+    }
+    if (dest != kDiscard) emitMove(dest, target);
+}
+
+void Compiler::compileIncDec(const ExprAST* operand, bool increment, bool prefix, int dest) {
+    auto* var = as<VariableExprAST>(operand);
+    if (!var) {
+        emitRaise(prefix ? "Operand of prefix ++/-- must be a variable"
+                         : "Operand of postfix ++/-- must be a variable");
+        return;
+    }
+    OpCode op = increment ? OpCode::Add : OpCode::Sub;
+    Operand one{true, static_cast<uint16_t>(numberConst(1.0))};
+    const VarSlot& ref = var->getSlot();
+
+    uint16_t reg;
+    if (ref.kind == SlotKind::Local) {
+        reg = static_cast<uint16_t>(ref.index);
+    } else {
+        reg = allocReg();
+        loadVar(ref, reg);
+    }
+    if (!prefix && dest != kDiscard) emitMove(dest, reg);
+    uint16_t result = reg;
+    if (ref.kind != SlotKind::Local && !prefix && dest != kDiscard && static_cast<uint32_t>(dest) == reg) {
+        result = allocReg();
+    }
+    emitOperands(op, result, Operand{false, reg}, one);
+    if (ref.kind != SlotKind::Local) storeVar(ref, result);
+    if (prefix && dest != kDiscard) emitMove(dest, result);
+}
+
+void Compiler::compileIf(const IfExprAST& e, int dest) {
+    std::vector<size_t> toElse = compileCondJump(e.getCond(), false);
+    compileExpr(e.getThen(), dest);
+    if (e.getElse() || dest != kDiscard) {
+        size_t toEnd = emitJump(OpCode::Jmp);
+        for (size_t j : toElse) patchJump(j, here());
+        compileExpr(e.getElse(), dest);
+        patchJump(toEnd, here());
+    } else {
+        for (size_t j : toElse) patchJump(j, here());
+    }
+}
+
+void Compiler::compileWhile(const WhileExprAST& e, int dest) {
+    FunctionState& fs = *fs_;
+    if (dest != kDiscard) emit(OpCode::LoadNil, dest);
+
+    // Условие проверяется в конце цикла: одна инструкция перехода на итерацию
+    size_t toCheck = emitJump(OpCode::Jmp);
+    size_t bodyStart = here();
+    fs.loops.emplace_back();
+    if (dest != kDiscard) {
+        uint16_t tmp = allocReg();
+        compileExpr(e.getBody(), tmp);
+        emitMove(dest, tmp);
+        fs.freeReg--;
+    } else {
+        compileExpr(e.getBody(), kDiscard);
+    }
+    LoopInfo loop = std::move(fs.loops.back());
+    fs.loops.pop_back();
+
+    size_t check = here();
+    patchJump(toCheck, check);
+    for (size_t j : loop.continueJumps) patchJump(j, check);
+    for (size_t j : compileCondJump(e.getCond(), true)) patchJump(j, bodyStart);
+    for (size_t j : loop.breakJumps) patchJump(j, here());
+}
+
+void Compiler::compileFor(const ForExprAST& e, int dest) {
+    FunctionState& fs = *fs_;
+    uint32_t iter = allocReg();
+    allocReg();
+    uint32_t element = allocReg();
+    compileExpr(e.getSeq(), iter);
+    emit(OpCode::ForPrep, iter);
+    if (dest != kDiscard) emit(OpCode::LoadNil, dest);
+
+    const VarSlot& var = e.getSlot();
+    uint32_t target = var.kind == SlotKind::Local ? var.index : element;
+
+    size_t toCheck = emitJump(OpCode::Jmp);
+    size_t bodyStart = here();
+    if (var.kind != SlotKind::Local) storeVar(var, element);
+    fs.loops.emplace_back();
+    if (dest != kDiscard) {
+        uint16_t tmp = allocReg();
+        compileExpr(e.getBody(), tmp);
+        emitMove(dest, tmp);
+        fs.freeReg--;
+    } else {
+        compileExpr(e.getBody(), kDiscard);
+    }
+    LoopInfo loop = std::move(fs.loops.back());
+    fs.loops.pop_back();
+
+    size_t check = here();
+    patchJump(toCheck, check);
+    for (size_t j : loop.continueJumps) patchJump(j, check);
+    emit(OpCode::ForLoop, iter, target);
+    patchJump(emitJump(OpCode::Jmp), bodyStart);
+    for (size_t j : loop.breakJumps) patchJump(j, here());
+}
+
+void Compiler::compileClosure(const FunctionLiteralExprAST& e, int dest) {
+    if (dest == kDiscard) return;
+    Proto* proto = fs_->proto;
+    proto->children.push_back(compileFunction(*e.getFunctionAST()));
+    emitBx(OpCode::Closure, dest, static_cast<uint32_t>(proto->children.size() - 1));
+}
+
+std::vector<size_t> Compiler::compileCondJump(const ExprAST* cond, bool jumpIfTrue) {
+    if (auto* b = as<BooleanExprAST>(cond)) {
+        if (b->getValue() == jumpIfTrue) return {emitJump(OpCode::Jmp)};
+        return {};
+    }
+    if (auto* u = as<UnaryExprAST>(cond); u && u->getOp() == '!' && u->getOperand()) {
+        return compileCondJump(u->getOperand(), !jumpIfTrue);
+    }
+    uint32_t savedFree = fs_->freeReg;
+    std::vector<size_t> jumps;
+    OpCode op;
+    if (auto* b = as<BinaryExprAST>(cond); b && comparisonJump(b->getOp(), jumpIfTrue, op)) {
+        Operand lhs = compileOperand(b->getLHS(), mayAssign(b->getRHS()));
+        Operand rhs = compileOperand(b->getRHS());
+        emitOperands(op, 0, lhs, rhs);
+        jumps.push_back(emitJump(OpCode::Jmp));
+    } else {
+        uint16_t reg = exprToReg(cond);
+        jumps.push_back(emitJump(jumpIfTrue ? OpCode::JmpIfTrue : OpCode::JmpIfFalse, reg));
+    }
+    fs_->freeReg = savedFree;
+    return jumps;
+}
+
+Compiler::Operand Compiler::compileOperand(const ExprAST* e, bool forceTemp) {
+    if (isConstantLiteral(e)) {
+        uint32_t k;
+        if (auto* n = as<NumberExprAST>(e))
+            k = numberConst(n->getValue());
+        else if (auto* s = as<StringExprAST>(e))
+            k = stringConst(s->getValue());
+        else if (auto* b = as<BooleanExprAST>(e))
+            k = valueConst(Value(b->getValue()));
+        else
+            k = valueConst(Value());
+        if (k <= UINT16_MAX) return Operand{true, static_cast<uint16_t>(k)};
+    }
+    return Operand{false, exprToReg(e, forceTemp)};
+}
+
+uint16_t Compiler::exprToReg(const ExprAST* e, bool forceTemp) {
+    if (!forceTemp) {
+        if (auto* v = as<VariableExprAST>(e)) {
+            if (v->getSlot().kind == SlotKind::Local) return static_cast<uint16_t>(v->getSlot().index);
+        }
+    }
+    uint16_t reg = allocReg();
+    compileExpr(e, reg);
+    return reg;
+}
+
+uint16_t Compiler::allocReg() {
+    FunctionState& fs = *fs_;
+    if (fs.freeReg >= UINT16_MAX) throw std::runtime_error("Function '" + fs.proto->name + "' needs too many registers");
+    uint32_t reg = fs.freeReg++;
+    if (fs.freeReg > fs.maxReg) fs.maxReg = fs.freeReg;
+    return static_cast<uint16_t>(reg);
+}
+
+void Compiler::storeVar(const VarSlot& var, uint16_t src) {
+    switch (var.kind) {
+        case SlotKind::Local:
+            emitMove(var.index, src);
+            break;
+        case SlotKind::Upvalue:
+            emit(OpCode::SetUpval, src, var.index);
+            break;
+        case SlotKind::Global:
+            emitBx(OpCode::SetGlobal, src, var.index);
+            break;
+    }
+}
+
+void Compiler::loadVar(const VarSlot& var, uint16_t dest) {
+    switch (var.kind) {
+        case SlotKind::Local:
+            emitMove(dest, var.index);
+            break;
+        case SlotKind::Upvalue:
+            emit(OpCode::GetUpval, dest, var.index);
+            break;
+        case SlotKind::Global:
+            emitBx(OpCode::GetGlobal, dest, var.index);
+            break;
+    }
+}
+
+uint32_t Compiler::numberConst(double d) {
+    uint64_t bits;
+    std::memcpy(&bits, &d, sizeof bits);
+    auto [it, inserted] = fs_->numberConsts.try_emplace(bits, 0);
+    if (inserted) it->second = valueConst(Value(d));
+    return it->second;
+}
+
+uint32_t Compiler::stringConst(const std::string& s) {
+    auto [it, inserted] = fs_->stringConsts.try_emplace(s, 0);
+    if (inserted) it->second = valueConst(Value(s));
+    return it->second;
+}
+
+uint32_t Compiler::valueConst(Value v) {
+    auto& constants = fs_->proto->constants;
+    constants.push_back(std::move(v));
+    return static_cast<uint32_t>(constants.size() - 1);
+}
+
+size_t Compiler::emit(OpCode op, uint32_t a, uint32_t b, uint32_t c, uint8_t flags) {
+    Instruction ins{op, flags, static_cast<uint16_t>(a), static_cast<uint16_t>(b), static_cast<uint16_t>(c)};
+    fs_->proto->code.push_back(ins);
+    return fs_->proto->code.size() - 1;
+}
+
+size_t Compiler::emitBx(OpCode op, uint32_t a, uint32_t bx) {
+    size_t at = emit(op, a);
+    fs_->proto->code[at].setBx(bx);
+    return at;
+}
+
+size_t Compiler::emitJump(OpCode op, uint32_t a) {
+    return emit(op, a);
+}
+
+void Compiler::emitOperands(OpCode op, uint32_t a, Operand b, Operand c) {
+    uint8_t flags = 0;
+    if (b.isConst) flags |= Instruction::kBConst;
+    if (c.isConst) flags |= Instruction::kCConst;
+    emit(op, a, b.index, c.index, flags);
+}
+
+void Compiler::emitMove(uint32_t dest, uint32_t src) {
+    if (dest != src) emit(OpCode::Move, dest, src);
+}
+
+void Compiler::emitRaise(const std::string& message) {
+    emitBx(OpCode::Raise, 0, stringConst(message));
+}
+
+void Compiler::patchJump(size_t at, size_t target) {
+    fs_->proto->code[at].setBx(static_cast<uint32_t>(target));
+}
+
+size_t Compiler::here() const {
+    return fs_->proto->code.size();
+}
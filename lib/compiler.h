@@ -0,0 +1,84 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "AST.h"
+#include "bytecode.h"
+#include "scope.h"
+
+// Компилирует список FunctionAST, построенный Parser::parseModule и размеченный
+// Resolver, в регистровый байткод. Локальные слоты функции становятся её первыми регистрами.
+class Compiler {
+   public:
+    std::unique_ptr<Program> compile(const std::vector<std::unique_ptr<FunctionAST>>& functions,
+                                     const GlobalNames& globals);
+
+    // Разбирает и компилирует отложенное тело функции на месте. Имена тела
+    // уже внесены в globals резолвером модуля. Синтаксическая ошибка — std::runtime_error
+    static void compileLazy(Proto& proto, const GlobalNames& globals);
+    // Компилирует все отложенные тела программы, например перед сохранением в кеш
+    static void compileLazyBodies(Program& program);
+
+   private:
+    static constexpr int kDiscard = -1;
+
+    struct Operand {
+        bool isConst;
+        uint16_t index;
+    };
+
+    struct LoopInfo {
+        std::vector<size_t> breakJumps;
+        std::vector<size_t> continueJumps;
+    };
+
+    struct FunctionState {
+        Proto* proto = nullptr;
+        std::unordered_map<uint64_t, uint32_t> numberConsts = {};
+        std::unordered_map<std::string, uint32_t> stringConsts = {};
+        std::vector<LoopInfo> loops = {};
+        uint32_t freeReg = 0;
+        uint32_t maxReg = 0;
+    };
+
+    std::unique_ptr<Proto> compileFunction(const FunctionAST& fn);
+
+    void compileExpr(const ExprAST* e, int dest);
+    void compileBinary(const BinaryExprAST& e, int dest);
+    void compileCall(const CallExprAST& e, int dest);
+    void compileAssignment(const AssignmentExprAST& e, int dest);
+    void compileCompound(const CompoundAssignmentExprAST& e, int dest);
+    void compileIncDec(const ExprAST* operand, bool increment, bool prefix, int dest);
+    void compileIf(const IfExprAST& e, int dest);
+    void compileWhile(const WhileExprAST& e, int dest);
+    void compileFor(const ForExprAST& e, int dest);
+    void compileClosure(const FunctionLiteralExprAST& e, int dest);
+
+    // Переходы, выполняемые, когда условие ложно (jumpIfTrue == false) или истинно
+    std::vector<size_t> compileCondJump(const ExprAST* cond, bool jumpIfTrue);
+
+    Operand compileOperand(const ExprAST* e, bool forceTemp = false);
+    uint16_t exprToReg(const ExprAST* e, bool forceTemp = false);
+    uint16_t allocReg();
+    void storeVar(const VarSlot& var, uint16_t src);
+    void loadVar(const VarSlot& var, uint16_t dest);
+
+    uint32_t numberConst(double d);
+    uint32_t stringConst(const std::string& s);
+    uint32_t valueConst(Value v);
+
+    size_t emit(OpCode op, uint32_t a = 0, uint32_t b = 0, uint32_t c = 0, uint8_t flags = 0);
+    size_t emitBx(OpCode op, uint32_t a, uint32_t bx);
+    size_t emitJump(OpCode op, uint32_t a = 0);
+    void emitOperands(OpCode op, uint32_t a, Operand b, Operand c);
+    void emitMove(uint32_t dest, uint32_t src);
+    void emitRaise(const std::string& message);
+    void patchJump(size_t at, size_t target);
+    size_t here() const;
+
+    FunctionState* fs_ = nullptr;
+    Program* program_ = nullptr;
+};
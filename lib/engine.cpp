@@ -0,0 +1,89 @@
+#include "engine.h"
+
+#include <stdexcept>
+
+#include "builtins.h"
+#include "compiler.h"
+#include "parser.h"
+#include "program_cache.h"
+#include "resolver.h"
+#include "vm.h"
+
+std::unique_ptr<Program> compileModule(Lexer& lexer, bool lazyBodies) {
+    Parser parser(lexer, lazyBodies);
+    std::vector<std::unique_ptr<FunctionAST>> functions;
+    if (!parser.parseModule(functions))
+        return nullptr;
+
+    GlobalNames names;
+    Resolver(names).resolve(functions);
+    return Compiler().compile(functions, names);
+}
+
+ScriptState::ScriptState(std::shared_ptr<const Script> script)
+    : script_(std::move(script)), globals_(script_->program().globals) {}
+
+const Value& ScriptState::get(std::string_view name) const {
+    const GlobalNames& names = script_->program().globals;
+    auto it = names.index.find(Symbol::intern(name));
+    if (it == names.index.end()) throw std::runtime_error("Undefined variable '" + std::string(name) + "'");
+    return globals_.get(it->second);
+}
+
+void ScriptState::set(std::string_view name, Value v) {
+    const GlobalNames& names = script_->program().globals;
+    auto it = names.index.find(Symbol::intern(name));
+    if (it != names.index.end()) globals_.set(it->second, std::move(v));
+}
+
+Script::Script(std::unique_ptr<Program> program, uint64_t hash) : program_(std::move(program)), hash_(hash) {}
+
+std::unique_ptr<ScriptState> Script::newState() const {
+    return std::unique_ptr<ScriptState>(new ScriptState(shared_from_this()));
+}
+
+void Script::run(ScriptState& state, std::ostream& output, std::istream& input) const {
+    if (state.script_.get() != this) throw std::runtime_error("Script state belongs to another script");
+    HostIO::Scope io({&input, &output});
+    VM vm(*program_, state.globals_);
+    vm.run();
+}
+
+void Script::run(std::ostream& output, std::istream& input) const {
+    auto state = newState();
+    run(*state, output, input);
+}
+
+Engine::Engine(size_t cacheCapacity, bool lazyBodies) : capacity_(cacheCapacity), lazyBodies_(lazyBodies) {}
+
+std::shared_ptr<const Script> Engine::compile(std::string_view source) {
+    uint64_t hash = hashSource(source);
+    auto cached = index_.find(hash);
+    if (cached != index_.end() && cached->second->source == source) {
+        lru_.splice(lru_.begin(), lru_, cached->second);
+        return cached->second->script;
+    }
+
+    Lexer lexer(source);
+    auto program = compileModule(lexer, lazyBodies_);
+    if (!program) throw std::runtime_error("Syntax error");
+    std::shared_ptr<const Script> script(new Script(std::move(program), hash));
+    if (capacity_ == 0) return script;
+
+    // Тот же хеш у другого текста: старую запись вытесняем
+    if (cached != index_.end()) {
+        lru_.erase(cached->second);
+        index_.erase(cached);
+    }
+    lru_.push_front(CacheEntry{std::string(source), script});
+    index_[hash] = lru_.begin();
+    if (lru_.size() > capacity_) {
+        index_.erase(lru_.back().script->hash());
+        lru_.pop_back();
+    }
+    return script;
+}
+
+void Engine::run(std::string_view source, std::ostream& output, std::istream& input) {
+    compile(source)->run(output, input);
+}
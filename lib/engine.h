@@ -0,0 +1,100 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <list>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "bytecode.h"
+#include "lexer.h"
+#include "scope.h"
+
+// API для встраивания: скрипт компилируется один раз и исполняется многократно.
+//
+//   Engine engine;
+//   auto script = engine.compile(source);   // повторная компиляция того же текста берётся из кеша
+//   auto state = script->newState();
+//   script->run(*state, output);            // глобалы переживают запуск
+//   script->run(output);                    // запуск со свежими глобалами
+//
+// Движок и его скрипты используются из одного потока: значения программы
+// считают ссылки неатомарно.
+
+// Разбирает и компилирует модуль. nullptr — синтаксическая ошибка (парсер уже
+// вывел её в stderr), прочие ошибки бросаются как std::runtime_error.
+// С lazyBodies тела функций верхнего уровня разбираются и компилируются при
+// первом вызове: синтаксическая ошибка в теле обнаружится только тогда
+std::unique_ptr<Program> compileModule(Lexer& lexer, bool lazyBodies = false);
+
+class Script;
+
+// Глобальные переменные скрипта вместе с builtin-ами. Передавая одно состояние
+// в несколько запусков, хост сохраняет значения глобалов между ними
+class ScriptState {
+   public:
+    // Значение глобала; std::runtime_error, если он не задан
+    const Value& get(std::string_view name) const;
+    // Задаёт глобал до запуска. Имена, которых в скрипте нет, игнорируются
+    void set(std::string_view name, Value v);
+
+   private:
+    friend class Script;
+    explicit ScriptState(std::shared_ptr<const Script> script);
+
+    std::shared_ptr<const Script> script_;
+    GlobalTable globals_;
+};
+
+// Скомпилированный скрипт; после компиляции меняется только досборкой отложенных тел
+class Script : public std::enable_shared_from_this<Script> {
+   public:
+    const Program& program() const { return *program_; }
+    // Хеш исходника, по которому скрипт лежит в кеше движка
+    uint64_t hash() const { return hash_; }
+
+    std::unique_ptr<ScriptState> newState() const;
+
+    // Исполняет топ-левел выражения; ошибки исполнения — std::runtime_error.
+    // print пишет в output, read читает из input
+    void run(ScriptState& state, std::ostream& output, std::istream& input = std::cin) const;
+    void run(std::ostream& output, std::istream& input = std::cin) const;
+
+   private:
+    friend class Engine;
+    friend class ScriptState;
+    Script(std::unique_ptr<Program> program, uint64_t hash);
+
+    std::unique_ptr<Program> program_;
+    uint64_t hash_;
+};
+
+class Engine {
+   public:
+    // cacheCapacity — сколько скомпилированных скриптов хранить; 0 — не кешировать.
+    // lazyBodies — откладывать разбор тел функций до первого вызова (см. compileModule)
+    explicit Engine(size_t cacheCapacity = 256, bool lazyBodies = false);
+
+    // Компилирует исходник или берёт недавний результат из кеша.
+    // Ошибка компиляции — std::runtime_error
+    std::shared_ptr<const Script> compile(std::string_view source);
+
+    // Компилирует (с кешем) и исполняет со свежими глобалами
+    void run(std::string_view source, std::ostream& output, std::istream& input = std::cin);
+
+    size_t cachedScripts() const { return lru_.size(); }
+
+   private:
+    struct CacheEntry {
+        std::string source;
+        std::shared_ptr<const Script> script;
+    };
+
+    size_t capacity_;
+    bool lazyBodies_;
+    // В начале — недавно использованные скрипты
+    std::list<CacheEntry> lru_;
+    std::unordered_map<uint64_t, std::list<CacheEntry>::iterator> index_;
+};
@@ -4,6 +4,7 @@
 #include <string>
 #include <unordered_map>
 
+#include "symbol.h"
 #include "value.h"
 
 class Environment {
@@ -13,45 +14,65 @@ class Environment {
     Environment(std::shared_ptr<Environment> parentEnv)
         : parent(std::move(parentEnv)) {}
 
-    void set(const std::string& name, Value v) {
-        if (vars_.find(name) != vars_.end()) {
-            vars_[name] = std::move(v);
-            return;
-        }
-        if (parent) {
-            try {
-                parent->get(name);
-                parent->set(name, std::move(v));
-                return;
-            } catch (std::runtime_error&) {
-            }
+    // Результат поиска имени: окружение-владелец и позиция переменной в нём
+    struct Lookup {
+        Environment* scope = nullptr;
+        std::unordered_map<Symbol, Value>::iterator it;
+
+        explicit operator bool() const { return scope != nullptr; }
+    };
+
+    // Ищет имя в этом окружении и его родителях за один проход, без исключений
+    Lookup lookup(Symbol name) {
+        for (Environment* env = this; env; env = env->parent.get()) {
+            auto it = env->vars_.find(name);
+            if (it != env->vars_.end()) return Lookup{env, it};
         }
-        vars_[name] = std::move(v);
+        return Lookup{};
     }
 
-    Value& get(const std::string& name) {
-        auto it = vars_.find(name);
-        if (it != vars_.end()) {
-            return it->second;
-        }
-        if (parent) {
-            return parent->get(name);
-        }
-        throw std::runtime_error("Undefined variable '" + name + "'");
+    Value* find(Symbol name) {
+        Lookup found = lookup(name);
+        return found ? &found.it->second : nullptr;
     }
 
-    const Value& get(const std::string& name) const {
-        auto it = vars_.find(name);
-        if (it != vars_.end()) {
-            return it->second;
-        }
-        if (parent) {
-            return parent->get(name);
+    const Value* find(Symbol name) const {
+        return const_cast<Environment*>(this)->find(name);
+    }
+
+    void set(Symbol name, Value v) {
+        if (Lookup found = lookup(name)) {
+            found.it->second = std::move(v);
+            return;
         }
-        throw std::runtime_error("Undefined variable '" + name + "'");
+        vars_.emplace(name, std::move(v));
+    }
+
+    Value& get(Symbol name) {
+        if (Value* v = find(name)) return *v;
+        throw std::runtime_error("Undefined variable '" + name.name() + "'");
+    }
+
+    const Value& get(Symbol name) const {
+        if (const Value* v = find(name)) return *v;
+        throw std::runtime_error("Undefined variable '" + name.name() + "'");
+    }
+
+    // Те же операции по строковому имени
+    Lookup lookup(std::string_view name) { return lookup(Symbol::intern(name)); }
+    Value* find(std::string_view name) { return find(Symbol::intern(name)); }
+    const Value* find(std::string_view name) const { return find(Symbol::intern(name)); }
+    void set(std::string_view name, Value v) { set(Symbol::intern(name), std::move(v)); }
+    Value& get(std::string_view name) { return get(Symbol::intern(name)); }
+    const Value& get(std::string_view name) const { return get(Symbol::intern(name)); }
+
+    // Обходит переменные этого окружения (без родителей)
+    template <class F>
+    void forEach(F&& f) const {
+        for (const auto& [name, value] : vars_) f(name, value);
     }
 
    private:
-    std::unordered_map<std::string, Value> vars_;
+    std::unordered_map<Symbol, Value> vars_;
     std::shared_ptr<Environment> parent;
 };
@@ -0,0 +1,163 @@
+#include "heap.h"
+
+#include <algorithm>
+#include <iterator>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "bytecode.h"
+#include "scope.h"
+
+namespace {
+
+// Узлы графа ссылок. Кроме самих списков и функций это разделяемые ими
+// буферы, списки upvalue и замыкания VM — через них тоже проходят циклы
+enum class NodeKind : uint8_t { Object, Buffer, Upvalues, Closure, Cell };
+
+struct Node {
+    NodeKind kind;
+    long refs;  // ссылки на узел, не найденные внутри кучи
+    bool reachable = false;
+};
+
+using NodeMap = std::unordered_map<const void*, Node>;
+
+}  // namespace
+
+Heap& Heap::local() {
+    static thread_local constinit Heap heap;
+    return heap;
+}
+
+TrackedObject::TrackedObject(Type t) : HeapObject(t) { Heap::local().track(this); }
+
+TrackedObject::~TrackedObject() { Heap::local().untrack(this); }
+
+void Heap::track(TrackedObject* obj) {
+    // Объект ещё не зарегистрирован и не попадёт в сборку, начатую здесь
+    if (!collecting_ && count_ >= threshold_) {
+        collect();
+        threshold_ = std::max(kMinThreshold, count_ * 2);
+    }
+    obj->gcPrev = nullptr;
+    obj->gcNext = head_;
+    if (head_) head_->gcPrev = obj;
+    head_ = obj;
+    ++count_;
+}
+
+void Heap::untrack(TrackedObject* obj) {
+    if (!obj->gcPrev && head_ != obj) return;
+    if (obj->gcPrev)
+        obj->gcPrev->gcNext = obj->gcNext;
+    else
+        head_ = obj->gcNext;
+    if (obj->gcNext) obj->gcNext->gcPrev = obj->gcPrev;
+    obj->gcPrev = obj->gcNext = nullptr;
+    --count_;
+}
+
+void Heap::untrack(const Value& v) {
+    if (v.isList() || v.isFunc()) untrack(static_cast<TrackedObject*>(v.object()));
+}
+
+size_t Heap::collect() {
+    if (collecting_) return 0;
+    collecting_ = true;
+    size_t before = count_;
+
+    auto objectOf = [](const Value& v) -> const TrackedObject* {
+        if (!v.isList() && !v.isFunc()) return nullptr;
+        return static_cast<const TrackedObject*>(v.object());
+    };
+
+    // Вызывает f(kind, ptr, refs) для каждой ссылки узла на другие узлы
+    auto forEachEdge = [&](NodeKind kind, const void* ptr, auto&& f) {
+        auto value = [&](const Value& v) {
+            if (auto* obj = objectOf(v)) f(NodeKind::Object, obj, static_cast<long>(obj->refCount));
+        };
+        auto cell = [&](const std::shared_ptr<UpvalueCell>& c) {
+            if (c) f(NodeKind::Cell, c.get(), c.use_count());
+        };
+        switch (kind) {
+            case NodeKind::Object: {
+                auto* obj = static_cast<const TrackedObject*>(ptr);
+                if (obj->type == HeapObject::Type::List) {
+                    auto* list = static_cast<const ListObject*>(obj);
+                    if (list->buffer) f(NodeKind::Buffer, list->buffer, static_cast<long>(list->buffer->refCount));
+                } else {
+                    const FunctionValue& fn = static_cast<const FunctionObject*>(obj)->fn;
+                    if (fn.upvalues) f(NodeKind::Upvalues, fn.upvalues.get(), fn.upvalues.use_count());
+                    if (fn.compiled) f(NodeKind::Closure, fn.compiled.get(), fn.compiled.use_count());
+                }
+                break;
+            }
+            case NodeKind::Buffer:
+                for (const Value& v : static_cast<const ListBuffer*>(ptr)->items) value(v);
+                break;
+            case NodeKind::Upvalues:
+                for (const auto& c : *static_cast<const UpvalueList*>(ptr)) cell(c);
+                break;
+            case NodeKind::Closure:
+                for (const auto& c : static_cast<const Closure*>(ptr)->upvalues) cell(c);
+                break;
+            case NodeKind::Cell:
+                value(static_cast<const UpvalueCell*>(ptr)->value);
+                break;
+        }
+    };
+
+    // Узлы, достижимые из зарегистрированных объектов
+    NodeMap nodes;
+    std::vector<std::pair<const void*, NodeKind>> stack;
+    auto discover = [&](NodeKind kind, const void* ptr, long refs) {
+        if (nodes.emplace(ptr, Node{kind, refs}).second) stack.emplace_back(ptr, kind);
+    };
+    for (TrackedObject* obj = head_; obj; obj = obj->gcNext) discover(NodeKind::Object, obj, obj->refCount);
+    while (!stack.empty()) {
+        auto [ptr, kind] = stack.back();
+        stack.pop_back();
+        forEachEdge(kind, ptr, discover);
+    }
+
+    // Вычитаем ссылки изнутри кучи: у корней остаются внешние ссылки
+    for (auto& [ptr, node] : nodes)
+        forEachEdge(node.kind, ptr, [&](NodeKind, const void* child, long) { --nodes.at(child).refs; });
+
+    for (auto& [ptr, node] : nodes) {
+        if (node.refs <= 0 || node.reachable) continue;
+        node.reachable = true;
+        stack.emplace_back(ptr, node.kind);
+        while (!stack.empty()) {
+            auto [from, kind] = stack.back();
+            stack.pop_back();
+            forEachEdge(kind, from, [&](NodeKind childKind, const void* child, long) {
+                Node& n = nodes.at(child);
+                if (!n.reachable) {
+                    n.reachable = true;
+                    stack.emplace_back(child, childKind);
+                }
+            });
+        }
+    }
+
+    // Значения хранят только буферы и ячейки: опустошив недостижимые, разрываем
+    // все циклы. Значения освобождаются после обхода, когда граф уже не нужен
+    std::vector<Value> garbage;
+    for (auto& [ptr, node] : nodes) {
+        if (node.reachable) continue;
+        if (node.kind == NodeKind::Buffer) {
+            auto& items = const_cast<ListBuffer*>(static_cast<const ListBuffer*>(ptr))->items;
+            std::move(items.begin(), items.end(), std::back_inserter(garbage));
+            items.clear();
+        } else if (node.kind == NodeKind::Cell) {
+            garbage.push_back(std::move(const_cast<UpvalueCell*>(static_cast<const UpvalueCell*>(ptr))->value));
+        }
+    }
+    nodes.clear();
+    garbage.clear();
+
+    collecting_ = false;
+    return before - count_;
+}
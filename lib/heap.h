@@ -0,0 +1,39 @@
+#pragma once
+#include <cstddef>
+
+#include "value.h"
+
+// Списки и функции текущего потока и сборщик циклических ссылок.
+//
+// Подсчёт ссылок освобождает объекты сразу, но не справляется с циклами:
+// рекурсивное замыкание хранит себя в своём upvalue, список может содержать сам
+// себя. Сборщик считает, сколько ссылок на каждый объект приходит от других
+// объектов кучи (списков, их буферов, замыканий и ячеек upvalue). Объекты,
+// у которых есть и другие ссылки (из регистров VM, кадров, глобалов), — корни;
+// всё, что от них недостижимо, — мусор, и сборщик разрывает его ссылки.
+class Heap {
+   public:
+    static Heap& local();
+
+    void track(TrackedObject* obj);
+    // Повторный вызов ничего не делает
+    void untrack(TrackedObject* obj);
+    // Убирает объект значения из кучи. Так живут builtin-ы: они существуют до
+    // конца потока и не ссылаются на другие объекты, поэтому сборщику не нужны
+    void untrack(const Value& v);
+
+    // Освобождает недостижимые циклы, возвращает число освобождённых объектов
+    size_t collect();
+
+    // Сколько списков и функций сейчас живо
+    size_t size() const { return count_; }
+
+   private:
+    // Сборка запускается, когда число объектов вырастает вдвое с прошлой сборки
+    static constexpr size_t kMinThreshold = 10000;
+
+    TrackedObject* head_ = nullptr;
+    size_t count_ = 0;
+    size_t threshold_ = kMinThreshold;
+    bool collecting_ = false;
+};
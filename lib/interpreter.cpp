@@ -1,451 +1,217 @@
 #include "interpreter.h"
 
-#include <environment.h>
-
-#include <limits>
+#include <cerrno>
+#include <cstdio>
+#include <fstream>
 #include <random>
 
+#if defined(__unix__) || defined(__APPLE__)
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define ISCRIPT_HAVE_MKSTEMP 1
+#endif
+
+#include "builtins.h"
+#include "compiler.h"
+#include "engine.h"
+#include "heap.h"
 #include "parser.h"
 #include "lexer.h"
+#include "program_cache.h"
+#include "resolver.h"
+#include "vm.h"
 
-static void registerBuiltins(Environment& globals, std::ostream& out) {
-    // print(something)
-    globals.set("print",
-                Value{FunctionValue{
-                    [&out](std::vector<Value> args) -> Value {
-                        for (auto& v : args)
-                            out << v.toString();
-                        return Value{};
-                    }}});
-
-    // println(something)
-    globals.set("println",
-                Value{FunctionValue{
-                    [&out](std::vector<Value> args) -> Value {
-                        for (auto& v : args)
-                            out << v.toString();
-                        out << '\n';
-                        return Value{};
-                    }}});
-
-    // abs(x)
-    globals.set("abs",
-                Value{FunctionValue{
-                    [](std::vector<Value> args) -> Value {
-                        double x = Value::asNumeric(args[0]);
-                        return Value{std::fabs(x)};
-                    }}});
-
-    // sqrt(x)
-    globals.set("sqrt",
-                Value{FunctionValue{
-                    [](std::vector<Value> args) -> Value {
-                        double x = Value::asNumeric(args[0]);
-                        if (x < 0)
-                            throw std::runtime_error("sqrt: negative argument");
-                        return Value{std::sqrt(x)};
-                    }}});
-
-    // ceil(x)
-    globals.set("ceil",
-                Value{FunctionValue{
-                    [](std::vector<Value> args) -> Value {
-                        double x = Value::asNumeric(args[0]);
-                        return Value{std::ceil(x)};
-                    }}});
-
-    // floor(x)
-    globals.set("floor",
-                Value{FunctionValue{
-                    [](std::vector<Value> args) -> Value {
-                        double x = Value::asNumeric(args[0]);
-                        return Value{std::floor(x)};
-                    }}});
-
-    // round(x)
-    globals.set("round",
-                Value{FunctionValue{
-                    [](std::vector<Value> args) -> Value {
-                        double x = Value::asNumeric(args[0]);
-                        return Value{std::round(x)};
-                    }}});
-
-    // rnd([min,] max)
-    globals.set("rnd",
-                Value{FunctionValue{
-                    [](std::vector<Value> args) -> Value {
-                        static thread_local std::mt19937_64 gen(std::random_device{}());
-
-                        if (args.empty()) {
-                            std::uniform_real_distribution<double> dist(0.0, 1.0);
-                            return Value{dist(gen)};
-                        }
-                        if (args.size() == 1 && args[0].isNumber()) {
-                            long long max = static_cast<long long>(args[0].asNumber());
-                            if (max <= 0) return Value{0.0};
-                            std::uniform_int_distribution<long long> dist(0, max - 1);
-                            return Value{static_cast<double>(dist(gen))};
-                        }
-                        if (args.size() == 2 && args[0].isNumber() && args[1].isNumber()) {
-                            long long a = static_cast<long long>(args[0].asNumber());
-                            long long b = static_cast<long long>(args[1].asNumber());
-                            if (a > b) std::swap(a, b);
-                            if (a == b) return Value{static_cast<double>(a)};
-                            std::uniform_int_distribution<long long> dist(a, b - 1);
-                            return Value{static_cast<double>(dist(gen))};
-                        }
-
-                        throw std::runtime_error(
-                            "rnd(): expected 0, 1 or 2 numeric arguments");
-                    }}});
-
-    // max(a,b, ...)
-    globals.set("max",
-                Value{FunctionValue{
-                    [](std::vector<Value> args) -> Value {
-                        double max = std::numeric_limits<double>::min();
-
-                        if (args.size() == 1 && args[0].isList()) {
-                            for (size_t i = 0; i < args[0].asList().size(); ++i) {
-                                double a = Value::asNumeric(args[0].asList()[i]);
-                                max = std::max(max, Value::asNumeric(args[0].asList()[i]));
-                            }
-                        } else
-                            for (size_t i = 0; i < args.size(); ++i) {
-                                double a = Value::asNumeric(args[i]);
-                                max = std::max(max, Value::asNumeric(args[i]));
-                            }
-                        return Value{max};
-                    }}});
-
-    // min(a,b, ...)
-    globals.set("min",
-                Value{FunctionValue{
-                    [](std::vector<Value> args) -> Value {
-                        double min = std::numeric_limits<double>::max();
-                        if (args.size() == 1 && args[0].isList()) {
-                            for (size_t i = 0; i < args[0].asList().size(); ++i) {
-                                double a = Value::asNumeric(args[0].asList()[i]);
-                                min = std::min(min, Value::asNumeric(args[0].asList()[i]));
-                            }
-                        } else
-                            for (size_t i = 0; i < args.size(); ++i) {
-                                double a = Value::asNumeric(args[i]);
-                                min = std::min(min, Value::asNumeric(args[i]));
-                            }
-                        return Value{min};
-                    }}});
-
-    // len(s)
-    globals.set("len",
-                Value{FunctionValue{
-                    [](std::vector<Value> args) -> Value {
-                        if (args[0].isString()) {
-                            const std::string s = args[0].asString();
-                            return Value(static_cast<double>(s.length()));
-                        } else if (args[0].isList()) {
-                            return Value{static_cast<double>(args[0].asList().size())};
-                        } else
-                            return Value{};
-                    }}});
-
-    // lower(s)
-    globals.set("lower",
-                Value{FunctionValue{
-                    [](std::vector<Value> args) -> Value {
-                        std::string s = args[0].asString();
-                        for_each(s.begin(), s.end(), [](char& c) {
-                            c = std::tolower(c);
-                        });
-                        return Value(s);
-                    }}});
-
-    // upper(s)
-    globals.set("upper",
-                Value{FunctionValue{
-                    [](std::vector<Value> args) -> Value {
-                        std::string s = args[0].asString();
-                        for_each(s.begin(), s.end(), [](char& c) {
-                            c = std::toupper(c);
-                        });
-                        return Value(s);
-                    }}});
-
-    // split(s, delim)
-    globals.set("split",
-                Value{FunctionValue{
-                    [](std::vector<Value> args) -> Value {
-                        if (args.empty()) {
-                            return Value{Value::RawList{}};
-                        }
-                        const std::string& s = args[0].asString();
-                        std::string sep;
-                        if (args.size() == 2) {
-                            sep = args[1].asString();
-                        }
-
-                        Value::RawList parts;
-                        if (sep.empty()) {
-                            size_t i = 0, n = s.size();
-                            while (i < n) {
-                                while (i < n && std::isspace(static_cast<unsigned char>(s[i]))) ++i;
-                                if (i >= n) break;
-                                size_t j = i;
-                                while (j < n && !std::isspace(static_cast<unsigned char>(s[j]))) ++j;
-                                parts.emplace_back(s.substr(i, j - i));
-                                i = j;
-                            }
-                        } else {
-                            size_t start = 0, pos;
-                            while ((pos = s.find(sep, start)) != std::string::npos) {
-                                if (pos > start) {
-                                    parts.emplace_back(s.substr(start, pos - start));
-                                }
-                                start = pos + sep.size();
-                            }
-                            if (start < s.size()) {
-                                parts.emplace_back(s.substr(start));
-                            }
-                        }
-                        return Value{std::move(parts)};
-                    }}});
-
-    // parse_num(s)
-    globals.set("parse_num",
-                Value{FunctionValue{
-                    [](std::vector<Value> args) -> Value {
-                        if (args.empty()) {
-                            return Value{};
-                        }
-                        const Value& x = args[0];
-                        if (x.isNumber() || x.isBool()) {
-                            return Value{Value::asNumeric(x)};
-                        } else if (x.isString()) {
-                            const auto& str = x.asString();
-                            try {
-                                size_t idx = 0;
-                                double d = std::stod(str, &idx);
-                                if (idx == str.size()) {
-                                    return Value{d};
-                                }
-                            } catch (...) {
-                            }
-                        }
-                        return Value{};
-                    }}});
-
-    // range(start, end, step)
-    globals.set("range",
-                Value{FunctionValue{
-                    [](std::vector<Value> args) -> Value {
-                        double start, end, step;
-
-                        if (args.size() == 1) {
-                            start = 0.0;
-                            end = Value::asNumeric(args[0]);
-                            step = 1.0;
-                        } else if (args.size() == 2) {
-                            start = Value::asNumeric(args[0]);
-                            end = Value::asNumeric(args[1]);
-                            step = 1.0;
-                        } else if (args.size() == 3) {
-                            start = Value::asNumeric(args[0]);
-                            end = Value::asNumeric(args[1]);
-                            step = Value::asNumeric(args[2]);
-                        } else {
-                            throw std::runtime_error("range: expected 1 to 3 numeric arguments");
-                        }
-
-                        if (step == 0.0) {
-                            throw std::runtime_error("range: step cannot be zero");
-                        }
-
-                        Value::RawList result;
-                        if (step > 0) {
-                            for (double v = start; v < end; v += step) {
-                                result.emplace_back(v);
-                            }
-                        } else {
-                            for (double v = start; v > end; v += step) {
-                                result.emplace_back(v);
-                            }
-                        }
-                        return Value{std::move(result)};
-                    }}});
-
-    // to_string(something)
-    globals.set("to_string",
-                Value{FunctionValue{
-                    [](std::vector<Value> args) -> Value {
-                        return Value(args[0].toString());
-                    }}});
-
-    // Функции списков
-
-    // join(list, delim)
-    globals.set("join",
-                Value{FunctionValue{
-                    [](std::vector<Value> args) -> Value {
-                        auto lst = args[0].asList();
-                        std::string delim = " ";
-                        if (args.size() == 2)
-                            delim = args[1].asString();
-                        std::string result;
-                        for (size_t i = 0; i < lst.size(); ++i) {
-                            result += lst[i].toString();
-                            if (i + 1 < lst.size())
-                                result += delim;
-                        }
-                        return Value(result);
-                    }}});
-
-    // push(list, value)
-    globals.set("push",
-                Value{FunctionValue{
-                    [](std::vector<Value> args) -> Value {
-                        if (args.size() != 2 || !args[0].isList()) {
-                            throw std::runtime_error("push(list, elem): expected a list and an element");
-                        }
-                        args[0].asList().push_back(args[1]);
-                        return Value{};
-                    }}});
+// Разбирает и компилирует модуль. nullptr — ошибка: синтаксическую парсер
+// уже вывел в stderr, остальные выводятся в output
+static std::unique_ptr<Program> compile(Lexer& lexer, std::ostream& output, bool lazyBodies) {
+    try {
+        return compileModule(lexer, lazyBodies);
+    } catch (std::exception& e) {
+        output << "Error: " << e.what();
+        return nullptr;
+    }
+}
 
-    // insert(list, index, value)
-    globals.set("insert",
-                Value{FunctionValue{
-                    [](std::vector<Value> args) -> Value {
-                        if (args.size() != 3 || !args[0].isList() || !args[1].isNumber()) {
-                            throw std::runtime_error(
-                                "insert(list, index, value): expected (list, number, any)");
-                        }
-                        auto& list = args[0].asList();
-                        ptrdiff_t idx = static_cast<ptrdiff_t>(Value::asNumeric(args[1]));
-                        if (idx < 0 || static_cast<size_t>(idx) > list.size()) {
-                            throw std::out_of_range("insert: index out of range");
-                        }
-                        list.insert(list.begin() + idx, args[2]);
-                        return Value{};
-                    }}});
+static bool execute(const Program& program, std::ostream& output) {
+    try {
+        HostIO::Scope io({&std::cin, &output});
+        VM vm(program);
+        vm.run();
+        return true;
+    } catch (std::exception& e) {
+        output << "Error: " << e.what();
+        return false;
+    }
+}
 
-    // pop(list)
-    globals.set("pop",
-                Value{FunctionValue{
-                    [](std::vector<Value> args) -> Value {
-                        if (args.size() != 1 || !args[0].isList()) {
-                            throw std::runtime_error("push(list, elem): expected a list");
-                        }
-                        Value v = Value{args[0].asList().back()};
-                        args[0].asList().pop_back();
-                        return v;
-                    }}});
+static void bindDefinitions(const std::vector<std::unique_ptr<FunctionAST>>& functions, GlobalNames& names,
+                            GlobalTable& globals) {
+    for (auto& fn : functions) {
+        auto const& proto = fn->getProto();
+        if (proto.getName() != "__anon_expr")
+            globals.set(names.intern(proto.getName()), Value(FunctionValue{fn.get(), nullptr, &globals}));
+    }
+}
 
-    // remove(list, index)
-    globals.set("remove",
-                Value{FunctionValue{
-                    [](std::vector<Value> args) -> Value {
-                        if (args.size() != 2 || !args[0].isList() || !args[1].isNumber()) {
-                            throw std::runtime_error(
-                                "remove(list, index): expected (list, number)");
-                        }
-                        auto& list = args[0].asList();
-                        ptrdiff_t idx = static_cast<ptrdiff_t>(Value::asNumeric(args[1]));
-                        if (idx < 0 || static_cast<size_t>(idx) >= list.size()) {
-                            throw std::out_of_range("remove: index out of range");
-                        }
-                        list.erase(list.begin() + idx);
-                        return Value{};
-                    }}});
+static void evalTopLevel(const FunctionAST& fn, GlobalTable& globals) {
+    Frame frame(globals, 0, nullptr);
+    fn.getBody().eval(frame);
+    frame.checkNoLoopEscape();
+}
 
-    // sort(list): сортирует копию списка “по toString()”
-    globals.set("sort",
-                Value{FunctionValue{
-                    [](std::vector<Value> args) -> Value {
-                        if (args.size() != 1 || !args[0].isList()) {
-                            throw std::runtime_error("sort: expected a single list argument");
-                        }
-                        auto vec = args[0].asList();
+static bool stream(Lexer& lexer, std::ostream& output, bool lazyBodies) {
+    Parser parser(lexer, lazyBodies);
+    try {
+        std::vector<std::unique_ptr<FunctionAST>> definitions;
+        if (!parser.parseDefinitions(definitions))
+            return false;
 
-                        std::sort(vec.begin(), vec.end(), [](const Value& a, const Value& b) {
-                            const std::string sa = a.toString();
-                            const std::string sb = b.toString();
-                            return sa < sb;
-                        });
+        HostIO::Scope io({&std::cin, &output});
+
+        // Все имена модуля известны заранее: таблица глобалов не растёт,
+        // пока выражения разбираются по одному. Глобалы, которым присваивают
+        // выражения, известны только по мере разбора, поэтому тела функций
+        // резолвятся при первом вызове
+        GlobalNames names;
+        for (Symbol name : parser.identifiers()) names.intern(name);
+        Resolver resolver(names);
+        for (auto& fn : definitions) resolver.resolveOnFirstCall(*fn);
+
+        GlobalTable globals(names);
+        bindDefinitions(definitions, names, globals);
+
+        std::vector<std::unique_ptr<FunctionAST>> retained;
+        std::unique_ptr<FunctionAST> fn;
+        while (true) {
+            size_t literals = parser.functionLiterals();
+            if (!parser.parseNext(fn)) return false;
+            if (!fn) return true;
+            resolver.resolve(*fn);
+            evalTopLevel(*fn, globals);
+            output.flush();
+            // Значения-функции ссылаются на узлы дерева, поэтому выражение
+            // с литералом функции остаётся жить до конца запуска
+            if (parser.functionLiterals() != literals) retained.push_back(std::move(fn));
+        }
+    } catch (std::exception& e) {
+        output << "Error: " << e.what();
+        return false;
+    }
+}
 
-                        return Value(Value::RawList(std::move(vec)));
-                    }}});
+// Печатает синтаксическую ошибку, найденную тихим разбором text
+static void reportSyntaxError(std::string_view text, int firstLine, bool lazyBodies) {
+    Lexer lexer(text, firstLine);
+    Parser parser(lexer, lazyBodies);
+    std::unique_ptr<FunctionAST> fn;
+    while (parser.parseNext(fn) && fn) {
+    }
+}
 
-    // replace(s, old, new)
-    globals.set("replace",
-                Value{FunctionValue{
-                    [](std::vector<Value> args) -> Value {
-                        if (args.size() != 3 || !args[0].isString() || !args[1].isString() || !args[2].isString()) {
-                            throw std::runtime_error("replace: expected (string, string, string)");
-                        }
-                        std::string s = args[0].asString();
-                        std::string old = args[1].asString();
-                        std::string nw = args[2].asString();
+// Потоковое исполнение поступающего текста. Поток читается по строкам,
+// непрочитанный остаток модуля неизвестен: определение функции становится
+// доступно, когда прочитано. Выражение исполняется, как только после него
+// пришёл следующий токен, — до этого дописанный текст может его продолжить.
+// В памяти держится только текст недоразобранного выражения
+static bool streamInput(std::istream& input, std::ostream& output, bool lazyBodies) {
+    // Строки, которые поток отдаёт без ожидания, копятся до этого размера и
+    // разбираются вместе. Недоразобранный текст длиннее разбирается заново,
+    // только когда вырастет вдвое: длинное определение не разбирается
+    // квадратичное число раз
+    constexpr size_t kEagerParse = 4096;
 
-                        if (old.empty()) {
-                            return Value(s);
-                        }
-                        size_t pos = 0;
-                        while ((pos = s.find(old, pos)) != std::string::npos) {
-                            s.replace(pos, old.length(), nw);
-                            pos += nw.length();
-                        }
-                        return Value(s);
-                    }}});
+    try {
+        HostIO::Scope io({&std::cin, &output});
+
+        GlobalNames names;
+        Resolver resolver(names);
+        GlobalTable globals(names);
+        std::vector<std::unique_ptr<FunctionAST>> retained;
+
+        std::string pending;
+        int pendingLine = 1;
+        size_t nextParse = 0;
+        std::string line;
+        bool more = true;
+        while (more) {
+            more = static_cast<bool>(std::getline(input, line));
+            if (more) {
+                pending += line;
+                pending += '\n';
+                if (pending.size() < nextParse) continue;
+                if (pending.size() < kEagerParse && input.rdbuf()->in_avail() > 0) continue;
+            }
 
-    // read(): читает строку из std::cin и возвращает её как строку
-    globals.set("read",
-                Value{FunctionValue{
-                    [](std::vector<Value> args) -> Value {
-                        if (!args.empty()) {
-                            throw std::runtime_error("read: expected no arguments");
-                        }
-                        std::string line;
-                        if (!std::getline(std::cin, line)) {
-                            return Value{};
-                        }
-                        return Value(line);
-                    }}});
+            Lexer lexer(pending, pendingLine);
+            Parser parser(lexer, lazyBodies);
+            parser.setQuiet(more);
+            size_t consumed = 0;
+            int consumedLine = pendingLine;
+            std::unique_ptr<FunctionAST> fn;
+            while (true) {
+                size_t literals = parser.functionLiterals();
+                bool ok = parser.parseNext(fn);
+                if (ok && !fn) break;
+                if (more && parser.atEnd()) break;
+                if (!ok) {
+                    if (more) reportSyntaxError(std::string_view(pending).substr(consumed), consumedLine, lazyBodies);
+                    return false;
+                }
+
+                bool expression = fn->getProto().getName() == "__anon_expr";
+                if (expression)
+                    resolver.resolve(*fn);
+                else
+                    resolver.resolveOnFirstCall(*fn);
+                globals.grow();
+                if (expression) {
+                    evalTopLevel(*fn, globals);
+                    output.flush();
+                    // Значения-функции ссылаются на узлы дерева
+                    if (parser.functionLiterals() != literals) retained.push_back(std::move(fn));
+                } else {
+                    uint32_t idx = names.intern(fn->getProto().getName());
+                    globals.set(idx, Value(FunctionValue{fn.get(), nullptr, &globals}));
+                    retained.push_back(std::move(fn));
+                }
+                consumed = parser.offset();
+                consumedLine = parser.line();
+            }
 
-    // stacktrace(): возвращает список (LAIST) из имён функций, начиная с самого раннего вызова
-    globals.set("stacktrace",
-                Value{FunctionValue{
-                    [](std::vector<Value> args) -> Value {
-                        if (!args.empty()) {
-                            throw std::runtime_error("stacktrace: expected no arguments");
-                        }
-                        Value::RawList lst;
-                        for (const auto& name : g_callStack) {
-                            lst.emplace_back(Value(name));
-                        }
-                        return Value(std::move(lst));
-                    }}});
+            pending.erase(0, consumed);
+            pendingLine = consumedLine;
+            nextParse = consumed || pending.size() < kEagerParse ? 0 : pending.size() * 2;
+        }
+        return true;
+    } catch (std::exception& e) {
+        output << "Error: " << e.what();
+        return false;
+    }
 }
 
-bool interpret(std::istream& input, std::ostream& output) {
-    Lexer lexer(input);
-    Parser parser(lexer);
+static bool run(Lexer& lexer, std::ostream& output, ExecutionMode mode, bool lazyBodies) {
+    if (mode == ExecutionMode::Bytecode) {
+        auto program = compile(lexer, output, lazyBodies);
+        return program && execute(*program, output);
+    }
+    if (mode == ExecutionMode::Streaming) return stream(lexer, output, lazyBodies);
+
+    Parser parser(lexer, lazyBodies);
     try {
         std::vector<std::unique_ptr<FunctionAST>> functions;
         if (!parser.parseModule(functions))
             return false;
 
-        Environment globals;
-        registerBuiltins(globals, output);
+        HostIO::Scope io({&std::cin, &output});
 
-        auto globalsPtr = std::make_shared<Environment>(globals);
-        for (auto& fn : functions) {
-            auto const& proto = fn->getProto();
-            globalsPtr->set(proto.getName(), Value(FunctionValue{fn.get(), globalsPtr}));
-        }
+        GlobalNames names;
+        Resolver(names).resolve(functions);
 
+        GlobalTable globals(names);
+        bindDefinitions(functions, names, globals);
         for (auto& fn : functions) {
-            if (fn->getProto().getName() == "__anon_expr") {
-                fn->getBody().eval(*globalsPtr);
-            }
+            if (fn->getProto().getName() == "__anon_expr") evalTopLevel(*fn, globals);
         }
 
         return true;
@@ -454,3 +220,84 @@ bool interpret(std::istream& input, std::ostream& output) {
         return false;
     }
 }
+
+bool interpret(SourceBuffer source, std::ostream& output, ExecutionMode mode, bool lazyBodies) {
+    bool ok;
+    {
+        Lexer lexer(std::move(source));
+        ok = run(lexer, output, mode, lazyBodies);
+    }
+    // Программа и её глобалы уже уничтожены: остались только циклы между объектами
+    Heap::local().collect();
+    return ok;
+}
+
+bool interpret(std::istream& input, std::ostream& output, ExecutionMode mode, bool lazyBodies) {
+    if (mode != ExecutionMode::Streaming) return interpret(SourceBuffer::read(input), output, mode, lazyBodies);
+    bool ok = streamInput(input, output, lazyBodies);
+    Heap::local().collect();
+    return ok;
+}
+
+// Кеш пишется во временный файл и переименовывается: параллельный запуск
+// того же скрипта видит либо старый файл, либо новый целиком. Имя временного
+// файла уникально, иначе два запуска пишут в один файл и переименовывают смесь
+static void writeProgramCache(const std::string& path, const std::string& data) {
+#ifdef ISCRIPT_HAVE_MKSTEMP
+    std::string tmp = path + ".XXXXXX";
+    int fd = ::mkstemp(tmp.data());
+    if (fd < 0) return;
+    ::fchmod(fd, 0644);
+    bool ok = true;
+    for (size_t done = 0; ok && done < data.size();) {
+        ssize_t n = ::write(fd, data.data() + done, data.size() - done);
+        if (n < 0 && errno == EINTR) continue;
+        ok = n > 0;
+        if (ok) done += static_cast<size_t>(n);
+    }
+    ok = ::close(fd) == 0 && ok;
+#else
+    std::string tmp = path + "." + std::to_string(std::random_device{}()) + ".tmp";
+    bool ok;
+    {
+        std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+        ok = static_cast<bool>(out.write(data.data(), static_cast<std::streamsize>(data.size())));
+    }
+#endif
+    if (!ok || std::rename(tmp.c_str(), path.c_str()) != 0) std::remove(tmp.c_str());
+}
+
+bool interpretFile(const std::string& path, std::ostream& output, ExecutionMode mode, bool lazyBodies) {
+    SourceBuffer source = SourceBuffer::open(path);
+    if (mode != ExecutionMode::Bytecode) return interpret(std::move(source), output, mode, lazyBodies);
+
+    bool ok;
+    {
+        uint64_t hash = hashSource(source.text());
+        std::string cachePath = programCachePath(path);
+        std::unique_ptr<Program> program;
+        try {
+            program = deserializeProgram(SourceBuffer::open(cachePath).text(), hash);
+        } catch (const std::runtime_error&) {
+            // Кеша ещё нет
+        }
+        bool compiled = !program;
+        if (compiled) {
+            Lexer lexer(std::move(source));
+            program = compile(lexer, output, lazyBodies);
+        }
+        ok = program && execute(*program, output);
+        // Кеш пишется после запуска: тела, отложенные парсером, дособираются
+        // только теперь. Синтаксическая ошибка в теле или недоступный для записи
+        // каталог — просто работаем без кеша
+        if (compiled && program) {
+            try {
+                Compiler::compileLazyBodies(*program);
+                writeProgramCache(cachePath, serializeProgram(*program, hash));
+            } catch (const std::runtime_error&) {
+            }
+        }
+    }
+    Heap::local().collect();
+    return ok;
+}
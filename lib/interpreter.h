@@ -1,6 +1,30 @@
+#pragma once
 #include "lexer.h"
 #include "value.h"
 #include <iostream>
+#include <string>
 #include <vector>
 
-bool interpret(std::istream& input, std::ostream& output);
\ No newline at end of file
+// Bytecode — компиляция в регистровый байткод и исполнение на VM,
+// TreeWalker — прямой обход AST,
+// Streaming — обход AST, при котором каждое топ-левел выражение исполняется
+// сразу после разбора, а его дерево освобождается. Выражения до синтаксической
+// ошибки успевают исполниться. Текст модуля целиком (SourceBuffer, файл)
+// сначала просматривается, и именованные функции доступны с начала модуля.
+// Поток читается и исполняется по мере поступления: функция доступна
+// выражениям, прочитанным после её определения
+enum class ExecutionMode { Bytecode, TreeWalker, Streaming };
+
+// lazyBodies — разбирать тела функций верхнего уровня при первом вызове.
+// Запуск быстрее, но синтаксическая ошибка в теле, которое так и не вызвали,
+// не будет обнаружена
+bool interpret(std::istream& input, std::ostream& output, ExecutionMode mode = ExecutionMode::Bytecode,
+               bool lazyBodies = false);
+// Текст модуля целиком, например файл, отображённый через SourceBuffer::open
+bool interpret(SourceBuffer source, std::ostream& output, ExecutionMode mode = ExecutionMode::Bytecode,
+               bool lazyBodies = false);
+// Исполняет файл. В режиме байткода скомпилированный модуль сохраняется рядом
+// с исходником (script.is -> script.isc) и при следующих запусках загружается
+// оттуда, пока не изменится исходник. Бросает std::runtime_error, если файла нет
+bool interpretFile(const std::string& path, std::ostream& output, ExecutionMode mode = ExecutionMode::Bytecode,
+                   bool lazyBodies = false);
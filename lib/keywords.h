@@ -1,10 +1,16 @@
 #pragma once
-#include <string>
-#include <unordered_map>
+#include <array>
+#include <cstddef>
+#include <string_view>
 
 #include "token.h"
 
-static const std::unordered_map<std::string, TokenType> keywords = {
+struct Keyword {
+    std::string_view text;
+    TokenType type = TokenType::Identifier;
+};
+
+inline constexpr std::array<Keyword, 17> keywords = {{
     {"if", TokenType::If},
     {"then", TokenType::Then},
     {"else", TokenType::Else},
@@ -25,4 +31,31 @@ static const std::unordered_map<std::string, TokenType> keywords = {
     {"or", TokenType::Or},
     {"not", TokenType::Not},
     {"nil", TokenType::Nil},
-};
+}};
+
+// Совершенная хеш-функция для ключевых слов: длина, первая и последняя буква.
+// Коэффициенты подобраны так, что у всех слов разные ячейки, — это проверяет
+// static_assert ниже, поэтому при добавлении слова их, возможно, придётся сменить
+constexpr size_t keywordSlot(std::string_view word) {
+    return (word.size() + static_cast<unsigned char>(word.front()) * 5 +
+            static_cast<unsigned char>(word.back()) * 27) &
+           31;
+}
+
+inline constexpr std::array<Keyword, 32> keywordTable = [] {
+    std::array<Keyword, 32> table{};
+    for (const Keyword& k : keywords) table[keywordSlot(k.text)] = k;
+    return table;
+}();
+
+static_assert([] {
+    for (const Keyword& k : keywords)
+        if (keywordTable[keywordSlot(k.text)].text != k.text) return false;
+    return true;
+}(), "keywordSlot has collisions");
+
+// Тип ключевого слова или Identifier, если слово не ключевое
+constexpr TokenType keywordType(std::string_view word) {
+    const Keyword& k = keywordTable[keywordSlot(word)];
+    return k.text == word ? k.type : TokenType::Identifier;
+}
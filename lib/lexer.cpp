@@ -1,37 +1,35 @@
 #include "lexer.h"
 
-#include <cctype>
+#include <charconv>
 #include <cstdlib>
+#include <cstring>
 #include <string>
 
-void Lexer::rawAdvance() {
-    int c = input.get();
-    if (c == '\n') {
-        ++line;
-    }
+Lexer::Lexer(SourceBuffer source) : buffer(std::make_shared<const SourceBuffer>(std::move(source))) {
+    std::string_view text = buffer->text();
+    begin_ = start = current = text.data();
+    end_ = begin_ + text.size();
+}
+
+Lexer::Lexer(std::string_view text, int firstLine) : line(firstLine) {
+    begin_ = start = current = text.data();
+    end_ = begin_ + text.size();
 }
 
 char Lexer::advance() {
-    char c = input.get();
+    char c = *current++;
     if (c == '\n') {
         ++line;
     }
-    currentLexeme.push_back(c);
     return c;
 }
 
 char Lexer::peek() const {
-    int c = input.peek();
-    return c == EOF ? '\0' : static_cast<char>(c);
+    return current < end_ ? *current : '\0';
 }
 
 char Lexer::peekNext() const {
-    int first = input.peek();
-    if (first == EOF) return '\0';
-    char c = input.get();
-    int next = input.peek();
-    input.unget();
-    return next == EOF ? '\0' : static_cast<char>(next);
+    return end_ - current > 1 ? current[1] : '\0';
 }
 
 bool Lexer::match(char expected) {
@@ -46,16 +44,10 @@ bool Lexer::isAtEnd() const {
 
 void Lexer::skipWhitespace() {
     while (true) {
-        char c = peek();
-        char c2 = peekNext();
-        if (c == '/' && c2 == '/') {
-            rawAdvance();
-            rawAdvance();
-            while (peek() != '\n' && !isAtEnd()) {
-                rawAdvance();
-            }
-        } else if (c == ' ' || c == '\t' || c == '\r' || c == '\n') {
-            rawAdvance();
+        current = scan.spaceEnd(current, end_, line);
+        if (peek() == '/' && peekNext() == '/') {
+            auto* newline = static_cast<const char*>(std::memchr(current, '\n', end_ - current));
+            current = newline ? newline : end_;
         } else {
             break;
         }
@@ -63,19 +55,85 @@ void Lexer::skipWhitespace() {
 }
 
 Token Lexer::nextToken() {
-    currentLexeme.clear();
+    TokenType type = scanToken();
+    Token token{type, std::string(lexeme()), {}, line, {}};
+    if (errorMessage) {
+        if (token.lexeme.empty()) token.lexeme = errorMessage;
+        token.literal = std::string(errorMessage);
+        return token;
+    }
+    switch (type) {
+        case TokenType::Number:
+            token.literal = number;
+            break;
+        case TokenType::Boolean:
+            token.literal = boolean;
+            break;
+        case TokenType::String:
+            token.literal = std::move(text);
+            break;
+        case TokenType::Identifier:
+            token.symbol = symbol;
+            break;
+        default:
+            break;
+    }
+    return token;
+}
+
+TokenStream Lexer::tokenize() {
+    TokenStream out;
+    out.source = source();
+    out.buffer = buffer;
+    // В обычном коде токен занимает в среднем несколько байт текста
+    size_t expected = out.source.size() / 4 + 1;
+    out.types.reserve(expected);
+    out.offsets.reserve(expected);
+    out.lengths.reserve(expected);
+    out.lines.reserve(expected);
+    out.payloads.reserve(expected);
+    while (true) {
+        TokenType type = scanToken();
+        uint32_t payload = TokenStream::kNoPayload;
+        if (errorMessage) {
+            payload = static_cast<uint32_t>(out.strings.size());
+            out.strings.emplace_back(errorMessage);
+        } else if (type == TokenType::Number) {
+            payload = static_cast<uint32_t>(out.numbers.size());
+            out.numbers.push_back(number);
+        } else if (type == TokenType::Boolean) {
+            payload = boolean;
+        } else if (type == TokenType::String) {
+            payload = static_cast<uint32_t>(out.strings.size());
+            out.strings.push_back(std::move(text));
+        } else if (type == TokenType::Identifier) {
+            payload = static_cast<uint32_t>(out.symbols.size());
+            out.symbols.push_back(symbol);
+        }
+        out.types.push_back(type);
+        out.offsets.push_back(static_cast<uint32_t>(start - begin_));
+        out.lengths.push_back(static_cast<uint32_t>(current - start));
+        out.lines.push_back(static_cast<uint32_t>(line));
+        out.payloads.push_back(payload);
+        if (type == TokenType::EndOfFile) break;
+    }
+    return out;
+}
+
+TokenType Lexer::scanToken() {
+    errorMessage = nullptr;
     skipWhitespace();
     start = current;
 
     if (isAtEnd()) {
-        return makeToken(TokenType::EndOfFile);
+        return TokenType::EndOfFile;
     }
 
     char c = peek();
-    if (std::isdigit(c)) {
+    if (isDigitChar(c)) {
         return scanNumber();
     }
-    if (std::isalpha(c) || c == '_') {
+    if (isIdentStart(c)) {
         return scanIdentifier();
     }
     if (c == '"') {
@@ -84,15 +142,10 @@ Token Lexer::nextToken() {
     return scanOperator();
 }
 
-Token Lexer::scanNumber() {
-    while (std::isdigit(peek())) {
-        advance();
-    }
-    if (peek() == '.' && std::isdigit(peekNext())) {
-        advance();
-        while (std::isdigit(peek())) {
-            advance();
-        }
+TokenType Lexer::scanNumber() {
+    current = scan.digitsEnd(current, end_);
+    if (peek() == '.' && isDigitChar(peekNext())) {
+        current = scan.digitsEnd(current + 1, end_);
     }
 
     //  Обработка экспоненциальной части: e или E, потом [+|-] и степень
@@ -101,40 +154,42 @@ Token Lexer::scanNumber() {
         if (peek() == '+' || peek() == '-') {
             advance();
         }
-        if (!std::isdigit(peek())) {
-            return errorToken("Malformed number literal: expected digits after exponent");
-        }
-        while (std::isdigit(peek())) {
-            advance();
+        if (!isDigitChar(peek())) {
+            return error("Malformed number literal: expected digits after exponent");
         }
+        current = scan.digitsEnd(current, end_);
     }
 
-    double value = std::strtod(currentLexeme.c_str(), nullptr);
-    Token token = makeToken(TokenType::Number);
-    token.literal = value;
-    return token;
+    // Текст не обязан заканчиваться нулём, поэтому разбираем строго в границах лексемы
+    auto [end, ec] = std::from_chars(start, current, number);
+    if (ec == std::errc::result_out_of_range) {
+        number = std::strtod(std::string(lexeme()).c_str(), nullptr);
+    }
+    return TokenType::Number;
 }
 
-Token Lexer::scanString() {
+TokenType Lexer::scanString() {
     advance();
-    while (!isAtEnd()) {
-        if (peek() == '\\') {
-            advance();
-            if (!isAtEnd())
-                advance();
-        } else if (peek() == '"') {
-            break;
-        } else {
-            advance();
+    bool escaped = false;
+    while (true) {
+        current = scan.quoteOrBackslash(current, end_, line);
+        if (current == end_) {
+            return error("Unclosed string");
         }
-    }
-    if (isAtEnd()) {
-        return errorToken("Unclosed string");
+        if (*current == '"') break;
+        escaped = true;
+        advance();
+        if (current != end_)
+            advance();
     }
     advance();
 
-    std::string raw = currentLexeme.substr(1, currentLexeme.size() - 2);
-    std::string text;
+    std::string_view raw = lexeme().substr(1, current - start - 2);
+    if (!escaped) {
+        text.assign(raw);
+        return TokenType::String;
+    }
+    text.clear();
     text.reserve(raw.size());
     for (size_t i = 0; i < raw.size(); ++i) {
         if (raw[i] == '\\' && i + 1 < raw.size()) {
@@ -160,31 +215,25 @@ Token Lexer::scanString() {
             text.push_back(raw[i]);
         }
     }
-    Token token = makeToken(TokenType::String);
-    token.literal = text;
-    return token;
+    return TokenType::String;
 }
 
-Token Lexer::scanIdentifier() {
-    while (std::isalnum(peek()) || peek() == '_') {
-        advance();
-    }
-    auto it = keywords.find(currentLexeme);
-    if (it != keywords.end()) {
-        TokenType type = it->second;
-        Token token = makeToken(type);
+TokenType Lexer::scanIdentifier() {
+    current = scan.identEnd(current + 1, end_);
+    TokenType type = keywordType(lexeme());
+    if (type != TokenType::Identifier) {
         if (type == TokenType::Boolean) {
-            token.literal = (currentLexeme == "true");
+            boolean = lexeme() == "true";
         }
-        return token;
+        return type;
     }
-    return makeToken(TokenType::Identifier);
+    symbol = Symbol::intern(lexeme());
+    return TokenType::Identifier;
 }
 
-Token Lexer::scanOperator() {
-    advance();
+TokenType Lexer::scanOperator() {
     TokenType type;
-    switch (currentLexeme[0]) {
+    switch (advance()) {
         case '+':
             if (match('+'))
                 type = TokenType::PlusPlus;
@@ -274,15 +323,12 @@ Token Lexer::scanOperator() {
             type = TokenType::Colon;
             break;
         default:
-            return errorToken("Unknown operator");
+            return error("Unknown operator");
     }
-    return makeToken(type);
+    return type;
 }
 
-Token Lexer::makeToken(TokenType type) const {
-    return Token{type, currentLexeme, {}, line};
+TokenType Lexer::error(const char* message) {
+    errorMessage = message;
+    return TokenType::EndOfFile;
 }
-
-Token Lexer::errorToken(const std::string& message) const {
-    return Token{TokenType::EndOfFile, currentLexeme.empty() ? message : currentLexeme, std::string(message), line};
-}
\ No newline at end of file
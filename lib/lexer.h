@@ -1,34 +1,63 @@
 #pragma once
 #include <istream>
+#include <memory>
+#include <string_view>
 
 #include "keywords.h"
+#include "scan.h"
+#include "source.h"
 #include "token.h"
 
+// Лексер работает над непрерывным текстом: поток читается целиком при создании,
+// файл можно отобразить в память через SourceBuffer::open.
 class Lexer {
    public:
-    explicit Lexer(std::istream& input_) : input(input_), line(1) {
-    }
+    explicit Lexer(std::istream& input_) : Lexer(SourceBuffer::read(input_)) {}
+    explicit Lexer(SourceBuffer source);
+    // Текст не копируется и должен пережить лексер и его токены.
+    // firstLine — номер строки, с которой начинается текст
+    explicit Lexer(std::string_view text, int firstLine = 1);
+
+    Lexer(const Lexer&) = delete;
+    Lexer& operator=(const Lexer&) = delete;
 
     Token nextToken();
+    // Все оставшиеся токены, последний — EndOfFile (или ошибка)
+    TokenStream tokenize();
+
+    std::string_view source() const { return {begin_, static_cast<size_t>(end_ - begin_)}; }
+
     bool isAtEnd() const;
 
     char advance();
-    void rawAdvance();
     char peek() const;
     char peekNext() const;
     bool match(char expected);
     void skipWhitespace();
 
-    Token scanNumber();
-    Token scanString();
-    Token scanIdentifier();
-    Token scanOperator();
-    Token makeToken(TokenType type) const;
-    Token errorToken(const std::string& msg) const;
-
    private:
-    std::istream& input;
-    size_t start = 0, current = 0;
-    std::string currentLexeme;
+    // Разбирает следующий токен: его текст — [start, current),
+    // значение литерала или имя — в полях ниже
+    TokenType scanToken();
+    TokenType scanNumber();
+    TokenType scanString();
+    TokenType scanIdentifier();
+    TokenType scanOperator();
+    TokenType error(const char* msg);
+
+    std::string_view lexeme() const { return {start, static_cast<size_t>(current - start)}; }
+
+    std::shared_ptr<const SourceBuffer> buffer;
+    const ScanKernels& scan = scanKernels();
+    const char* begin_;
+    const char* end_;
+    const char* start;
+    const char* current;
     int line = 1;
-};
\ No newline at end of file
+
+    double number = 0;
+    bool boolean = false;
+    std::string text;
+    Symbol symbol;
+    const char* errorMessage = nullptr;
+};
@@ -2,6 +2,10 @@
 
 #include <cstdio>
 #include <iostream>
+#include <optional>
+#include <stdexcept>
+
+#include "resolver.h"
 
 static const char* TokenTypeToString(TokenType type) {
     switch (type) {
@@ -117,6 +121,7 @@ static const char* TokenTypeToString(TokenType type) {
 }
 
 std::unique_ptr<ExprAST> Parser::LogError(const char* msg) {
+    if (Quiet) return nullptr;
     fprintf(stderr, "Error at line %d: %s\n", CurTok.line, msg);
     return nullptr;
 }
@@ -125,7 +130,7 @@ std::unique_ptr<PrototypeAST> Parser::LogErrorP(const char* msg) {
     return nullptr;
 }
 
-Parser::Parser(Lexer& lex) : Lex(lex) {
+Parser::Parser(Lexer& lex, bool lazyBodies) : Toks(lex.tokenize()), LazyBodies(lazyBodies) {
     // 0) Булевые операторы
     BinopPrecedence[TokenType::And] = 5;
     BinopPrecedence[TokenType::Or] = 4;
@@ -179,7 +184,7 @@ std::unique_ptr<ExprAST> Parser::ParseParenExpr() {
 }
 
 std::unique_ptr<ExprAST> Parser::ParseIdentifierExpr() {
-    std::string IdName = CurTok.lexeme;
+    Symbol IdName = CurTok.symbol;
     getNextToken();
     return std::make_unique<VariableExprAST>(IdName);
 }
@@ -265,9 +270,10 @@ std::unique_ptr<ExprAST> Parser::ParsePrimary() {
             E = ParseNilExpr();
             break;
         default: {
-            std::cerr << "[Debug] Parser::ParsePrimary - unexpected token '"
-                      << CurTok.lexeme << "' of type "
-                      << TokenTypeToString(CurTok.type) << std::endl;
+            if (!Quiet)
+                std::cerr << "[Debug] Parser::ParsePrimary - unexpected token '"
+                          << CurTok.lexeme << "' of type "
+                          << TokenTypeToString(CurTok.type) << std::endl;
             return LogError("unknown token when expecting an expression");
         }
     }
@@ -348,17 +354,16 @@ std::unique_ptr<ExprAST> Parser::ParseExpression() {
         if (!var)
             return LogError("left side of assignment must be a variable");
 
-        std::string varName = var->getName();
         if (auto* funcLit = dynamic_cast<FunctionLiteralExprAST*>(RHS.get())) {
-            funcLit->getFunctionAST()->getProto().setName(varName);
+            funcLit->getFunctionAST()->getProto().setName(var->getName());
         }
 
         if (op == TokenType::Assign) {
             return std::make_unique<AssignmentExprAST>(
-                var->getName(), std::move(RHS));
+                var->getSymbol(), std::move(RHS));
         } else {
             return std::make_unique<CompoundAssignmentExprAST>(
-                op, var->getName(), std::move(RHS));
+                op, var->getSymbol(), std::move(RHS));
         }
     }
 
@@ -389,16 +394,16 @@ std::unique_ptr<ExprAST> Parser::ParseBinOpRHS(int exprPrec, std::unique_ptr<Exp
 std::unique_ptr<PrototypeAST> Parser::ParsePrototype() {
     if (CurTok.type != TokenType::Identifier)
         return LogErrorP("Expected function name in prototype");
-    std::string FnName = CurTok.lexeme;
+    std::string FnName(CurTok.lexeme);
     getNextToken();
 
     if (CurTok.type != TokenType::LParen)
         return LogErrorP("Expected '(' in prototype");
     getNextToken();
 
-    std::vector<std::string> ArgNames;
+    std::vector<Symbol> ArgNames;
     while (CurTok.type == TokenType::Identifier) {
-        ArgNames.push_back(CurTok.lexeme);
+        ArgNames.push_back(CurTok.symbol);
         getNextToken();
         if (CurTok.type == TokenType::Comma)
             getNextToken();
@@ -417,22 +422,109 @@ std::unique_ptr<FunctionAST> Parser::ParseDefinition() {
     getNextToken();
     auto Proto = ParsePrototype();
     if (!Proto) return nullptr;
+    return ParseFunctionBody(std::move(Proto));
+}
 
+std::unique_ptr<FunctionAST> Parser::ParseFunctionBody(std::unique_ptr<PrototypeAST> Proto, bool Literal) {
+    if (LazyBodies && FunctionDepth == 0) {
+        auto Lazy = SkipFunctionBody(Proto->getArgs(), Literal);
+        if (!Lazy) return nullptr;
+        return std::make_unique<FunctionAST>(std::move(Proto), std::move(Lazy));
+    }
+
+    ++FunctionDepth;
     auto BlockBody = ParseBlockUntil(TokenType::End, TokenType::Function);
+    --FunctionDepth;
     if (!BlockBody) return nullptr;
-
     return std::make_unique<FunctionAST>(std::move(Proto), std::move(BlockBody));
 }
 
+// Находит парный 'end function' по токенам, не строя узлов: каждое 'function'
+// открывает функцию, каждое 'end function' закрывает
+std::shared_ptr<const LazyBody> Parser::SkipFunctionBody(std::vector<Symbol> Params, bool Literal) {
+    auto Lazy = std::make_shared<LazyBody>();
+    size_t first = Pos - 1;
+    size_t i = first;
+    for (int depth = 1; depth > 0;) {
+        switch (Toks.types[i]) {
+            case TokenType::EndOfFile:
+                Pos = i;
+                getNextToken();
+                LogError("Expected 'end' to close block");
+                return nullptr;
+            case TokenType::Function:
+                ++depth;
+                break;
+            case TokenType::End:
+                if (Toks.types[i + 1] == TokenType::Function) {
+                    --depth;
+                    ++i;
+                }
+                break;
+            case TokenType::Identifier:
+                Lazy->names.push_back(Toks.symbols[Toks.payloads[i]]);
+                break;
+            default:
+                break;
+        }
+        ++i;
+    }
+
+    // Текст, которым лексер не владеет, копируется один раз на модуль
+    if (!Toks.buffer) Toks.buffer = std::make_shared<const SourceBuffer>(std::string(Toks.source));
+    Lazy->params = std::move(Params);
+    Lazy->literal = Literal;
+    Lazy->source = Toks.buffer;
+    Lazy->begin = Toks.offsets[first];
+    Lazy->end = Toks.offsets[i - 1] + Toks.lengths[i - 1];
+    Lazy->line = static_cast<int>(Toks.lines[first]);
+    Pos = i;
+    getNextToken();
+    return Lazy;
+}
+
+std::unique_ptr<ExprAST> Parser::parseLazyBody() {
+    ++FunctionDepth;
+    auto Body = ParseBlockUntil(TokenType::End, TokenType::Function);
+    --FunctionDepth;
+    if (Body && CurTok.type != TokenType::EndOfFile) return LogError("Unexpected text after 'end function'");
+    return Body;
+}
+
+void FunctionAST::parseLazyBody() const {
+    // Разбор тела не меняет смысла функции, поэтому метод константный
+    auto& fn = const_cast<FunctionAST&>(*this);
+    bool named = true;
+    if (Lazy) {
+        // Узлы тела живут в арене модуля, как и разобранные сразу
+        std::optional<AstArena::Scope> scope;
+        if (Arena) scope.emplace(*Arena);
+
+        Lexer lexer(Lazy->text(), Lazy->line);
+        auto body = Parser(lexer).parseLazyBody();
+        if (!body) throw std::runtime_error("Syntax error in function '" + Proto->getName() + "'");
+
+        named = !Lazy->literal;
+        fn.Body = std::move(body);
+        fn.Lazy.reset();
+    }
+    GlobalNames& globals = *LazyGlobals;
+    fn.LazyGlobals = nullptr;
+    Resolver(globals).resolveBody(fn, named);
+}
+
 std::unique_ptr<FunctionAST> Parser::ParseTopLevelExpr() {
     auto E = ParseExpression();
     if (!E) return nullptr;
-    auto Proto = std::make_unique<PrototypeAST>("__anon_expr", std::vector<std::string>{});
+    auto Proto = std::make_unique<PrototypeAST>("__anon_expr", std::vector<Symbol>{});
     return std::make_unique<FunctionAST>(std::move(Proto), std::move(E));
 }
 
 bool Parser::parseModule(
     std::vector<std::unique_ptr<FunctionAST>>& Out) {
+    // Узлы модуля создаются в одной арене, её держат разобранные функции
+    auto arena = std::make_shared<AstArena>();
+    AstArena::Scope scope(*arena);
     while (CurTok.type != TokenType::EndOfFile) {
         if (CurTok.type == TokenType::Function) {
             if (auto Fn = ParseDefinition())
@@ -449,6 +541,55 @@ bool Parser::parseModule(
     return true;
 }
 
+bool Parser::parseDefinitions(std::vector<std::unique_ptr<FunctionAST>>& Out) {
+    TokenView first = CurTok;
+    size_t start = Pos;
+    // Определение — 'function имя' вне других функций; остальные 'function'
+    // открывают литералы, их тела закрывает 'end function'
+    int depth = 0;
+    for (size_t i = Pos - 1; Toks.types[i] != TokenType::EndOfFile;) {
+        TokenType type = Toks.types[i];
+        if (type == TokenType::Function && depth == 0 && Toks.types[i + 1] == TokenType::Identifier) {
+            Pos = i;
+            getNextToken();
+            auto Fn = ParseDefinition();
+            if (!Fn) return false;
+            Out.push_back(std::move(Fn));
+            Definitions.push_back({i, Pos - 1, CurTok});
+            i = Pos - 1;
+            continue;
+        }
+        if (type == TokenType::Function) {
+            ++depth;
+        } else if (type == TokenType::End && Toks.types[i + 1] == TokenType::Function) {
+            --depth;
+            ++i;
+        }
+        ++i;
+    }
+    // Токен, взятый из потока, второй раз не берётся: текущий восстанавливается копией
+    Pos = start;
+    CurTok = std::move(first);
+    return true;
+}
+
+bool Parser::parseNext(std::unique_ptr<FunctionAST>& Out) {
+    while (NextDefinition < Definitions.size() && Definitions[NextDefinition].begin == Pos - 1) {
+        const SkippedDefinition& def = Definitions[NextDefinition++];
+        Pos = def.end + 1;
+        CurTok = def.next;
+    }
+    if (CurTok.type == TokenType::EndOfFile) {
+        Out = nullptr;
+        return true;
+    }
+    if (CurTok.type == TokenType::Function && Toks.types[Pos] == TokenType::Identifier)
+        Out = ParseDefinition();
+    else
+        Out = ParseTopLevelExpr();
+    return Out != nullptr;
+}
+
 std::unique_ptr<ExprAST> Parser::ParseStringExpr() {
     auto Val = std::get<std::string>(CurTok.literal);
     getNextToken();
@@ -533,14 +674,15 @@ std::unique_ptr<ExprAST> Parser::ParseStringSlice(std::unique_ptr<ExprAST> StrEx
 }
 
 std::unique_ptr<ExprAST> Parser::ParseFunctionExpr() {
+    ++FunctionLiterals;
     getNextToken();
     if (CurTok.type != TokenType::LParen)
         return LogError("Expected '(' after 'function'");
     getNextToken();
 
-    std::vector<std::string> ArgNames;
+    std::vector<Symbol> ArgNames;
     while (CurTok.type == TokenType::Identifier) {
-        ArgNames.push_back(CurTok.lexeme);
+        ArgNames.push_back(CurTok.symbol);
         getNextToken();
         if (CurTok.type == TokenType::Comma)
             getNextToken();
@@ -550,10 +692,9 @@ std::unique_ptr<ExprAST> Parser::ParseFunctionExpr() {
     if (CurTok.type != TokenType::RParen)
         return LogError("Expected ')' after function arguments");
     getNextToken();
-    auto BlockBody = ParseBlockUntil(TokenType::End, TokenType::Function);
-    if (!BlockBody) return nullptr;
-    return std::make_unique<FunctionLiteralExprAST>(
-        std::move(ArgNames), std::move(BlockBody));
+    auto Fn = ParseFunctionBody(std::make_unique<PrototypeAST>("", std::move(ArgNames)), true);
+    if (!Fn) return nullptr;
+    return std::make_unique<FunctionLiteralExprAST>(std::move(Fn));
 }
 
 std::unique_ptr<ExprAST> Parser::ParseNilExpr() {
@@ -655,7 +796,7 @@ std::unique_ptr<ExprAST> Parser::ParseForExpr() {
 
     if (CurTok.type != TokenType::Identifier)
         return LogError("Expected identifier after 'for'");
-    std::string VarName = CurTok.lexeme;
+    Symbol VarName = CurTok.symbol;
     getNextToken();
 
     while (CurTok.type == TokenType::Semicolon) {
@@ -5,11 +5,28 @@
 #include "lexer.h"
 
 class Parser {
-    Lexer& Lex;
-    Token CurTok;
+    TokenStream Toks;
+    size_t Pos = 0;
+    TokenView CurTok;
     std::map<TokenType, int> BinopPrecedence;
+    bool LazyBodies;
+    // Глубина вложенности разбираемых функций: откладываются только внешние
+    int FunctionDepth = 0;
+    // Определение, уже разобранное parseDefinitions: токены [begin, end) и копия
+    // токена end — сам токен parseDefinitions уже забрал из потока
+    struct SkippedDefinition {
+        size_t begin, end;
+        TokenView next;
+    };
+    std::vector<SkippedDefinition> Definitions;
+    size_t NextDefinition = 0;
+    size_t FunctionLiterals = 0;
+    bool Quiet = false;
 
-    void getNextToken() { CurTok = Lex.nextToken(); }
+    void getNextToken() {
+        // Последний токен — EndOfFile, на нём разбор и остаётся
+        if (Pos < Toks.size()) CurTok = Toks.take(Pos++);
+    }
 
     std::unique_ptr<ExprAST> LogError(const char* msg);
     std::unique_ptr<PrototypeAST> LogErrorP(const char* msg);
@@ -33,6 +50,8 @@ class Parser {
     std::unique_ptr<ExprAST> ParseListExpr();
     std::unique_ptr<ExprAST> ParseStringSlice(std::unique_ptr<ExprAST> StrExpr);
     std::unique_ptr<ExprAST> ParseFunctionExpr();
+    std::unique_ptr<FunctionAST> ParseFunctionBody(std::unique_ptr<PrototypeAST> Proto, bool Literal = false);
+    std::shared_ptr<const LazyBody> SkipFunctionBody(std::vector<Symbol> Params, bool Literal);
     std::unique_ptr<ExprAST> ParseNilExpr();
 
     std::unique_ptr<ExprAST> ParseBlockUntil(TokenType endKeyword, TokenType requiredSuffix);
@@ -48,7 +67,35 @@ class Parser {
     int GetTokPrecedence();
 
    public:
-    Parser(Lexer& lex);
+    // Лексемы токенов указывают в текст лексера: он должен пережить парсер.
+    // С lazyBodies тела функций верхнего уровня только просматриваются до
+    // 'end function' и разбираются при первом вызове; синтаксическая ошибка
+    // в таком теле обнаружится только тогда
+    explicit Parser(Lexer& lex, bool lazyBodies = false);
 
     bool parseModule(std::vector<std::unique_ptr<FunctionAST>>& Out);
+
+    // Потоковый разбор: сначала все именованные функции модуля, затем
+    // топ-левел выражения по одному. parseNext пропускает уже разобранные
+    // определения, остальные возвращает по мере появления, и возвращает
+    // nullptr в Out, когда модуль закончился. false — синтаксическая ошибка
+    bool parseDefinitions(std::vector<std::unique_ptr<FunctionAST>>& Out);
+    bool parseNext(std::unique_ptr<FunctionAST>& Out);
+
+    // Не выводить синтаксические ошибки: разбор начала текста, который ещё дочитывается
+    void setQuiet(bool quiet) { Quiet = quiet; }
+    // Смещение текущего токена в тексте лексера и его строка
+    size_t offset() const { return Toks.offsets[Pos - 1]; }
+    int line() const { return CurTok.line; }
+    // Текущий токен — конец текста или оборванная на нём лексема: дописанный
+    // текст может продолжить разобранное
+    bool atEnd() const { return offset() + Toks.lengths[Pos - 1] == Toks.source.size(); }
+
+    // Сколько литералов функций разобрано до сих пор
+    size_t functionLiterals() const { return FunctionLiterals; }
+    // Имена всех идентификаторов модуля, в порядке появления
+    const std::vector<Symbol>& identifiers() const { return Toks.symbols; }
+
+    // Тело, отложенное при разборе модуля: текст LazyBody::text() целиком
+    std::unique_ptr<ExprAST> parseLazyBody();
 };
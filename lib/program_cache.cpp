@@ -0,0 +1,375 @@
+#include "program_cache.h"
+
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+namespace {
+
+constexpr char kMagic[4] = {'I', 'S', 'C', '\0'};
+
+#define ISCRIPT_COUNT_OPCODE(name) +1
+constexpr uint32_t kOpcodeCount = 0 ISCRIPT_OPCODES(ISCRIPT_COUNT_OPCODE);
+#undef ISCRIPT_COUNT_OPCODE
+
+enum class ConstTag : uint8_t { Nil, Bool, Number, String };
+
+class Writer {
+   public:
+    template <class T>
+    void put(T v) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        out_.append(reinterpret_cast<const char*>(&v), sizeof v);
+    }
+    void putString(std::string_view s) {
+        put(static_cast<uint32_t>(s.size()));
+        out_.append(s);
+    }
+    void putBytes(const void* p, size_t n) { out_.append(static_cast<const char*>(p), n); }
+
+    void putProto(const Proto& proto) {
+        putString(proto.name);
+        put(proto.numParams);
+        put(proto.numRegs);
+        put(static_cast<uint32_t>(proto.code.size()));
+        putBytes(proto.code.data(), proto.code.size() * sizeof(Instruction));
+
+        put(static_cast<uint32_t>(proto.constants.size()));
+        for (const Value& k : proto.constants) {
+            if (k.isNumber()) {
+                put(ConstTag::Number);
+                put(k.asNumber());
+            } else if (k.isString()) {
+                put(ConstTag::String);
+                putString(k.asString());
+            } else if (k.isBool()) {
+                put(ConstTag::Bool);
+                put(static_cast<uint8_t>(k.asBool()));
+            } else {
+                put(ConstTag::Nil);
+            }
+        }
+
+        put(static_cast<uint32_t>(proto.upvalues.size()));
+        for (const UpvalueDesc& up : proto.upvalues) {
+            put(static_cast<uint8_t>(up.source));
+            put(up.index);
+            putString(up.name.name());
+        }
+
+        put(static_cast<uint32_t>(proto.children.size()));
+        for (const auto& child : proto.children) putProto(*child);
+    }
+
+    std::string take() { return std::move(out_); }
+
+   private:
+    std::string out_;
+};
+
+// Читает данные с проверкой границ: при выходе за конец ok() становится false,
+// а дальнейшие чтения возвращают нули
+class Reader {
+   public:
+    explicit Reader(std::string_view data) : data_(data) {}
+
+    bool ok() const { return ok_; }
+
+    template <class T>
+    T get() {
+        T v{};
+        if (std::byte* p = bytes(sizeof v)) std::memcpy(&v, p, sizeof v);
+        return v;
+    }
+    std::string_view getString() {
+        uint32_t n = get<uint32_t>();
+        auto* p = reinterpret_cast<const char*>(bytes(n));
+        return p ? std::string_view(p, n) : std::string_view();
+    }
+
+    std::unique_ptr<Proto> getProto(int depth = 0) {
+        // Вложенность функций в настоящем коде невелика; глубже — испорченный файл
+        if (depth > 1000) ok_ = false;
+        auto proto = std::make_unique<Proto>();
+        proto->name = getString();
+        proto->numParams = get<uint16_t>();
+        proto->numRegs = get<uint16_t>();
+
+        uint32_t codeSize = get<uint32_t>();
+        if (auto* p = bytes(size_t{codeSize} * sizeof(Instruction))) {
+            proto->code.resize(codeSize);
+            std::memcpy(proto->code.data(), p, size_t{codeSize} * sizeof(Instruction));
+        }
+
+        uint32_t numConstants = get<uint32_t>();
+        for (uint32_t i = 0; i < numConstants && ok_; ++i) {
+            switch (get<ConstTag>()) {
+                case ConstTag::Nil:
+                    proto->constants.emplace_back();
+                    break;
+                case ConstTag::Bool:
+                    proto->constants.emplace_back(get<uint8_t>() != 0);
+                    break;
+                case ConstTag::Number:
+                    proto->constants.emplace_back(get<double>());
+                    break;
+                case ConstTag::String:
+                    proto->constants.emplace_back(getString());
+                    break;
+                default:
+                    ok_ = false;
+            }
+        }
+
+        uint32_t numUpvalues = get<uint32_t>();
+        for (uint32_t i = 0; i < numUpvalues && ok_; ++i) {
+            UpvalueDesc up;
+            uint8_t source = get<uint8_t>();
+            if (source > static_cast<uint8_t>(UpvalueSource::Self)) ok_ = false;
+            up.source = static_cast<UpvalueSource>(source);
+            up.index = get<uint32_t>();
+            up.name = Symbol::intern(getString());
+            proto->upvalues.push_back(up);
+        }
+
+        uint32_t numChildren = get<uint32_t>();
+        for (uint32_t i = 0; i < numChildren && ok_; ++i) proto->children.push_back(getProto(depth + 1));
+
+        if (proto->upvalues.empty())
+            proto->sharedClosure = Value(FunctionValue(std::make_shared<Closure>(Closure{proto.get(), {}})));
+        return proto;
+    }
+
+    bool atEnd() const { return pos_ == data_.size(); }
+    std::string_view rest() const { return data_.substr(pos_); }
+
+   private:
+    std::byte* bytes(size_t n) {
+        if (!ok_ || data_.size() - pos_ < n) {
+            ok_ = false;
+            return nullptr;
+        }
+        auto* p = reinterpret_cast<std::byte*>(const_cast<char*>(data_.data() + pos_));
+        pos_ += n;
+        return p;
+    }
+
+    std::string_view data_;
+    size_t pos_ = 0;
+    bool ok_ = true;
+};
+
+// Операнды кода не выходят за регистры, константы, глобалы, upvalue и вложенные
+// функции, переходы ведут внутрь кода, а исполнение не проходит его конец:
+// VM исполняет код без проверок
+class Validator {
+   public:
+    explicit Validator(uint32_t numGlobals) : numGlobals_(numGlobals) {}
+
+    bool proto(const Proto& p) {
+        if (p.numParams > p.numRegs || p.code.empty()) return false;
+        const size_t size = p.code.size();
+        auto reg = [&](uint32_t r) { return r < p.numRegs; };
+        auto konst = [&](uint32_t k) { return k < p.constants.size(); };
+        auto rk = [&](const Instruction& ins, uint8_t flag, uint16_t x) { return ins.flags & flag ? konst(x) : reg(x); };
+        auto target = [&](uint32_t pc) { return pc < size; };
+
+        for (size_t i = 0; i < size; ++i) {
+            const Instruction& ins = p.code[i];
+            if (static_cast<uint32_t>(ins.op) >= kOpcodeCount) return false;
+            bool ok = true;
+            switch (ins.op) {
+                case OpCode::LoadNil:
+                case OpCode::LoadBool:
+                case OpCode::Return:
+                    ok = reg(ins.a);
+                    break;
+                case OpCode::LoadK:
+                    ok = reg(ins.a) && konst(ins.bx());
+                    break;
+                case OpCode::Move:
+                case OpCode::Neg:
+                case OpCode::Not:
+                    ok = reg(ins.a) && reg(ins.b);
+                    break;
+                case OpCode::GetGlobal:
+                case OpCode::SetGlobal:
+                    ok = reg(ins.a) && ins.bx() < numGlobals_;
+                    break;
+                case OpCode::GetUpval:
+                case OpCode::SetUpval:
+                    ok = reg(ins.a) && ins.b < p.upvalues.size();
+                    break;
+                case OpCode::Add:
+                case OpCode::Sub:
+                case OpCode::Mul:
+                case OpCode::Div:
+                case OpCode::Mod:
+                case OpCode::FMod:
+                case OpCode::Pow:
+                case OpCode::Eq:
+                case OpCode::Ne:
+                case OpCode::Lt:
+                case OpCode::Le:
+                case OpCode::Gt:
+                case OpCode::Ge:
+                case OpCode::And:
+                case OpCode::Or:
+                    ok = reg(ins.a) && rk(ins, Instruction::kBConst, ins.b) && rk(ins, Instruction::kCConst, ins.c);
+                    break;
+                case OpCode::NewList:
+                    ok = reg(ins.a) && uint32_t{ins.b} + ins.c <= p.numRegs;
+                    break;
+                case OpCode::Index:
+                    ok = reg(ins.a) && reg(ins.b) && rk(ins, Instruction::kCConst, ins.c);
+                    break;
+                case OpCode::Slice:
+                    ok = reg(ins.a) && reg(ins.b) && ((ins.flags & Instruction::kNoStart) || reg(ins.c)) &&
+                         ((ins.flags & Instruction::kNoEnd) || reg(uint32_t{ins.c} + 1));
+                    break;
+                case OpCode::In:
+                    ok = reg(ins.a) && reg(ins.b) && reg(ins.c);
+                    break;
+                case OpCode::Closure:
+                    ok = reg(ins.a) && ins.bx() < p.children.size();
+                    break;
+                case OpCode::Call:
+                    ok = reg(uint32_t{ins.a} + ins.b);
+                    break;
+                case OpCode::ReturnNil:
+                    break;
+                case OpCode::Jmp:
+                    ok = target(ins.bx());
+                    break;
+                case OpCode::JmpIfFalse:
+                case OpCode::JmpIfTrue:
+                    ok = reg(ins.a) && target(ins.bx());
+                    break;
+                case OpCode::JmpIfNotEq:
+                case OpCode::JmpIfNotNe:
+                case OpCode::JmpIfNotLt:
+                case OpCode::JmpIfNotLe:
+                case OpCode::JmpIfNotGt:
+                case OpCode::JmpIfNotGe:
+                    // Адрес перехода — в следующем слове, которое иначе пропускается
+                    ok = rk(ins, Instruction::kBConst, ins.b) && rk(ins, Instruction::kCConst, ins.c) &&
+                         i + 2 < size && target(p.code[i + 1].bx());
+                    break;
+                case OpCode::ForPrep:
+                    ok = reg(uint32_t{ins.a} + 1);
+                    break;
+                case OpCode::ForLoop:
+                    ok = reg(uint32_t{ins.a} + 1) && reg(ins.b) && i + 2 < size && target(p.code[i + 1].bx());
+                    break;
+                case OpCode::Raise:
+                    ok = konst(ins.bx()) && p.constants[ins.bx()].isString();
+                    break;
+            }
+            if (!ok) return false;
+        }
+        OpCode last = p.code.back().op;
+        if (last != OpCode::Return && last != OpCode::ReturnNil && last != OpCode::Jmp && last != OpCode::Raise)
+            return false;
+
+        for (const auto& child : p.children) {
+            for (const UpvalueDesc& up : child->upvalues) {
+                bool ok = up.source == UpvalueSource::ParentLocal    ? up.index < p.numRegs
+                          : up.source == UpvalueSource::ParentUpvalue ? up.index < p.upvalues.size()
+                                                                      : up.index < numGlobals_;
+                if (!ok) return false;
+            }
+            if (!proto(*child)) return false;
+        }
+        return true;
+    }
+
+   private:
+    uint32_t numGlobals_;
+};
+
+}  // namespace
+
+uint64_t hashSource(std::string_view source) {
+    // Хеш нужен, чтобы заметить правку исходника, а не для защиты от подделки
+    constexpr uint64_t kMul = 0x9E3779B97F4A7C15ull;
+    uint64_t h = 0xCBF29CE484222325ull ^ source.size();
+    auto mix = [&](uint64_t w) {
+        h = (h ^ w) * kMul;
+        h ^= h >> 32;
+    };
+    size_t i = 0;
+    for (; i + 8 <= source.size(); i += 8) {
+        uint64_t w;
+        std::memcpy(&w, source.data() + i, 8);
+        mix(w);
+    }
+    uint64_t tail = 0;
+    std::memcpy(&tail, source.data() + i, source.size() - i);
+    mix(tail);
+    return h;
+}
+
+std::string programCachePath(const std::string& sourcePath) {
+    if (sourcePath.ends_with(".is")) return sourcePath + "c";
+    return sourcePath + ".isc";
+}
+
+std::string serializeProgram(const Program& program, uint64_t sourceHash) {
+    Writer w;
+    w.putBytes(kMagic, sizeof kMagic);
+    w.put(kProgramCacheVersion);
+    w.put(kOpcodeCount);
+    w.put(sourceHash);
+
+    Writer body;
+    body.put(static_cast<uint32_t>(program.globals.names.size()));
+    for (Symbol name : program.globals.names) body.putString(name.name());
+
+    body.put(static_cast<uint32_t>(program.definitions.size()));
+    for (const auto& [idx, proto] : program.definitions) {
+        body.put(idx);
+        body.putProto(*proto);
+    }
+    body.put(static_cast<uint32_t>(program.topLevel.size()));
+    for (const auto& proto : program.topLevel) body.putProto(*proto);
+
+    std::string payload = body.take();
+    w.put(hashSource(payload));
+    w.putBytes(payload.data(), payload.size());
+    return w.take();
+}
+
+std::unique_ptr<Program> deserializeProgram(std::string_view data, uint64_t sourceHash) {
+    Reader r(data);
+    char magic[sizeof kMagic];
+    for (char& c : magic) c = r.get<char>();
+    if (!r.ok() || std::memcmp(magic, kMagic, sizeof kMagic) != 0) return nullptr;
+    if (r.get<uint32_t>() != kProgramCacheVersion || r.get<uint32_t>() != kOpcodeCount) return nullptr;
+    if (r.get<uint64_t>() != sourceHash) return nullptr;
+    uint64_t payloadHash = r.get<uint64_t>();
+    if (!r.ok() || hashSource(r.rest()) != payloadHash) return nullptr;
+
+    auto program = std::make_unique<Program>();
+    uint32_t numGlobals = r.get<uint32_t>();
+    for (uint32_t i = 0; i < numGlobals && r.ok(); ++i) program->globals.intern(r.getString());
+    if (program->globals.names.size() != numGlobals) return nullptr;
+
+    uint32_t numDefinitions = r.get<uint32_t>();
+    for (uint32_t i = 0; i < numDefinitions && r.ok(); ++i) {
+        uint32_t idx = r.get<uint32_t>();
+        if (idx >= numGlobals) return nullptr;
+        program->definitions.emplace_back(idx, r.getProto());
+    }
+    uint32_t numTopLevel = r.get<uint32_t>();
+    for (uint32_t i = 0; i < numTopLevel && r.ok(); ++i) program->topLevel.push_back(r.getProto());
+
+    if (!r.ok() || !r.atEnd()) return nullptr;
+
+    // Функции модуля создаются без upvalue
+    Validator validator(numGlobals);
+    for (const auto& [idx, proto] : program->definitions)
+        if (!proto->upvalues.empty() || !validator.proto(*proto)) return nullptr;
+    for (const auto& proto : program->topLevel)
+        if (!proto->upvalues.empty() || !validator.proto(*proto)) return nullptr;
+    return program;
+}
@@ -0,0 +1,26 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "bytecode.h"
+
+// Скомпилированный модуль на диске — файл .isc рядом с исходником.
+// В заголовке сигнатура, версия формата, число опкодов, хеш исходника и хеш
+// остальных данных: кеш от другой сборки интерпретатора, от другого текста или
+// испорченный на диске не загружается. Код загруженных функций проверяется,
+// прежде чем попасть в VM.
+// Числа пишутся в порядке байт машины — на машине с другим порядком не
+// совпадёт версия, и кеш будет просто пересобран.
+inline constexpr uint32_t kProgramCacheVersion = 3;
+
+uint64_t hashSource(std::string_view source);
+
+// script.is -> script.isc, для остальных имён расширение добавляется
+std::string programCachePath(const std::string& sourcePath);
+
+std::string serializeProgram(const Program& program, uint64_t sourceHash);
+
+// nullptr, если данные повреждены или записаны не для этого исходника
+std::unique_ptr<Program> deserializeProgram(std::string_view data, uint64_t sourceHash);
@@ -0,0 +1,206 @@
+#include "resolver.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+Symbol assignedName(const ExprAST* e) {
+    if (auto* n = dynamic_cast<const AssignmentExprAST*>(e)) return n->getSymbol();
+    if (auto* n = dynamic_cast<const CompoundAssignmentExprAST*>(e)) return n->getSymbol();
+    if (auto* n = dynamic_cast<const ForExprAST*>(e)) return n->getSymbol();
+    const ExprAST* operand = nullptr;
+    if (auto* n = dynamic_cast<const PrefixExprAST*>(e)) operand = n->getOperand();
+    if (auto* n = dynamic_cast<const PostfixExprAST*>(e)) operand = n->getOperand();
+    if (auto* v = dynamic_cast<const VariableExprAST*>(operand)) return v->getSymbol();
+    return Symbol();
+}
+
+static void collectAssigned(const ExprAST* e, std::vector<Symbol>& out) {
+    if (!e) return;
+    if (Symbol name = assignedName(e)) out.push_back(name);
+    forEachChild(e, [&](const ExprAST* child) { collectAssigned(child, out); });
+}
+
+// Глобалы, которые создаёт функция или топ-левел выражение модуля
+void Resolver::bindGlobals(const FunctionAST& fn) {
+    if (fn.getProto().getName() != "__anon_expr") {
+        globals_.bind(Symbol::intern(fn.getProto().getName()));
+        return;
+    }
+    std::vector<Symbol> assigned;
+    collectAssigned(&fn.getBody(), assigned);
+    for (Symbol name : assigned) globals_.bind(name);
+}
+
+void Resolver::resolve(const std::vector<std::unique_ptr<FunctionAST>>& functions) {
+    // Глобалы модуля известны до резолвинга функций, которые их меняют
+    for (auto& fn : functions) bindGlobals(*fn);
+    for (auto& fn : functions) {
+        bool topLevel = fn->getProto().getName() == "__anon_expr";
+        resolveFunction(*fn, nullptr, topLevel, !topLevel);
+    }
+}
+
+void Resolver::resolve(FunctionAST& fn) {
+    bindGlobals(fn);
+    bool topLevel = fn.getProto().getName() == "__anon_expr";
+    resolveFunction(fn, nullptr, topLevel, !topLevel);
+}
+
+static void collectNames(const ExprAST* e, std::vector<Symbol>& out) {
+    if (!e) return;
+    if (auto* v = dynamic_cast<const VariableExprAST*>(e)) out.push_back(v->getSymbol());
+    if (Symbol name = assignedName(e)) out.push_back(name);
+    if (auto* literal = dynamic_cast<const FunctionLiteralExprAST*>(e)) {
+        const FunctionAST& fn = *literal->getFunctionAST();
+        if (fn.isLazy())
+            out.insert(out.end(), fn.getLazyBody()->names.begin(), fn.getLazyBody()->names.end());
+        else
+            collectNames(&fn.getBody(), out);
+        return;
+    }
+    forEachChild(e, [&](const ExprAST* child) { collectNames(child, out); });
+}
+
+void Resolver::resolveOnFirstCall(FunctionAST& fn) {
+    bindGlobals(fn);
+    deferBody(fn);
+}
+
+// Тело резолвится перед первым вызовом функции, сейчас нужны только его имена:
+// таблица глобалов не растёт, пока код исполняется
+void Resolver::deferBody(FunctionAST& fn) {
+    std::vector<Symbol> names;
+    if (fn.isLazy())
+        names = fn.getLazyBody()->names;
+    else
+        collectNames(&fn.getBody(), names);
+    for (Symbol name : names) globals_.intern(name);
+
+    FunctionScope layout;
+    layout.numParams = static_cast<uint16_t>(fn.getProto().getArgs().size());
+    fn.setScope(std::move(layout));
+    fn.setLazyGlobals(&globals_);
+}
+
+void Resolver::resolveFunction(FunctionAST& fn, Scope* enclosing, bool topLevel, bool named) {
+    // Отложенная функция — всегда верхнего уровня, upvalue у неё нет. Тело
+    // резолвится при разборе
+    if (fn.isLazy()) {
+        deferBody(fn);
+        // Литерал получает копии глобалов, которые упоминает его тело, уже сейчас
+        if (enclosing && enclosing->topLevel) {
+            FunctionScope layout = fn.getScope();
+            const auto& params = fn.getProto().getArgs();
+            for (Symbol name : fn.getLazyBody()->names) {
+                if (!globals_.assigned(name) || std::find(params.begin(), params.end(), name) != params.end()) continue;
+                auto same = [&](const UpvalueDesc& up) { return up.name == name; };
+                if (std::any_of(layout.upvalues.begin(), layout.upvalues.end(), same)) continue;
+                if (layout.upvalues.size() >= UINT16_MAX) throw std::runtime_error("Too many captured variables");
+                layout.upvalues.push_back(UpvalueDesc{UpvalueSource::Global, globals_.intern(name), name});
+            }
+            fn.setScope(std::move(layout));
+        }
+        return;
+    }
+
+    Scope scope{enclosing, topLevel, named || (enclosing && enclosing->liveGlobals)};
+    Scope* saved = scope_;
+    scope_ = &scope;
+
+    // Отложенное тело литерала: его upvalue заданы, когда резолвился модуль
+    if (!enclosing) {
+        scope.layout.upvalues = fn.getScope().upvalues;
+        for (size_t i = 0; i < scope.layout.upvalues.size(); ++i)
+            scope.upvalueIndex[scope.layout.upvalues[i].name] = static_cast<uint16_t>(i);
+    }
+
+    if (!topLevel) {
+        const auto& params = fn.getProto().getArgs();
+        for (const auto& name : params) scope.locals[name] = scope.layout.numLocals++;
+        scope.layout.numParams = static_cast<uint16_t>(params.size());
+
+        // Именованная функция и литералы в ней присваивают глобалам модуля,
+        // литерал верхнего уровня — своим копиям глобалов, остальные имена — локальные
+        std::vector<Symbol> assigned;
+        collectAssigned(&fn.getBody(), assigned);
+        for (const auto& name : assigned) {
+            if (scope.locals.count(name) || resolveUpvalue(scope, name) >= 0) continue;
+            if (scope.liveGlobals && globals_.exists(name)) continue;
+            scope.locals[name] = scope.layout.numLocals++;
+        }
+    }
+
+    resolveExpr(&fn.getBody());
+
+    fn.setScope(std::move(scope.layout));
+    scope_ = saved;
+}
+
+void Resolver::resolveExpr(const ExprAST* e) {
+    if (!e) return;
+    // Резолвер владеет деревом и только размечает его
+    auto* node = const_cast<ExprAST*>(e);
+    if (auto* n = dynamic_cast<VariableExprAST*>(node)) {
+        n->setSlot(lookup(n->getSymbol()));
+    } else if (auto* n = dynamic_cast<AssignmentExprAST*>(node)) {
+        n->setSlot(lookup(n->getSymbol()));
+        // Литерал, присваиваемый глобалу, который он сам читает, видит в нём себя
+        auto* literal = dynamic_cast<const FunctionLiteralExprAST*>(n->getExpr());
+        if (literal && n->getSlot().kind == SlotKind::Global) {
+            resolveExpr(literal);
+            FunctionAST& fn = *literal->getFunctionAST();
+            FunctionScope layout = fn.getScope();
+            for (UpvalueDesc& up : layout.upvalues)
+                if (up.source == UpvalueSource::Global && up.index == n->getSlot().index) up.source = UpvalueSource::Self;
+            fn.setScope(std::move(layout));
+            return;
+        }
+    } else if (auto* n = dynamic_cast<CompoundAssignmentExprAST*>(node)) {
+        n->setSlot(lookup(n->getSymbol()));
+    } else if (auto* n = dynamic_cast<ForExprAST*>(node)) {
+        n->setSlot(lookup(n->getSymbol()));
+    } else if (auto* n = dynamic_cast<FunctionLiteralExprAST*>(node)) {
+        resolveFunction(*n->getFunctionAST(), scope_, false, false);
+        return;
+    }
+    forEachChild(e, [this](const ExprAST* child) { resolveExpr(child); });
+}
+
+VarSlot Resolver::lookup(Symbol name) {
+    Scope& scope = *scope_;
+    if (!scope.topLevel) {
+        auto it = scope.locals.find(name);
+        if (it != scope.locals.end()) return VarSlot{SlotKind::Local, it->second};
+        int up = resolveUpvalue(scope, name);
+        if (up >= 0) return VarSlot{SlotKind::Upvalue, static_cast<uint32_t>(up)};
+    }
+    return VarSlot{SlotKind::Global, globals_.intern(name)};
+}
+
+int Resolver::resolveUpvalue(Scope& scope, Symbol name) {
+    auto known = scope.upvalueIndex.find(name);
+    if (known != scope.upvalueIndex.end()) return known->second;
+
+    Scope* parent = scope.enclosing;
+    if (!parent) return -1;
+
+    UpvalueDesc desc;
+    if (parent->topLevel) {
+        // Литерал верхнего уровня, как и раньше, получает копию окружения модуля:
+        // глобалы читаются на момент создания, присваивания остаются в замыкании
+        if (!globals_.assigned(name)) return -1;
+        desc = UpvalueDesc{UpvalueSource::Global, globals_.intern(name), name};
+    } else if (auto local = parent->locals.find(name); local != parent->locals.end()) {
+        desc = UpvalueDesc{UpvalueSource::ParentLocal, local->second, name};
+    } else {
+        int up = resolveUpvalue(*parent, name);
+        if (up < 0) return -1;
+        desc = UpvalueDesc{UpvalueSource::ParentUpvalue, static_cast<uint32_t>(up), name};
+    }
+    auto& upvalues = scope.layout.upvalues;
+    if (upvalues.size() >= UINT16_MAX) throw std::runtime_error("Too many captured variables");
+    upvalues.push_back(std::move(desc));
+    uint16_t idx = static_cast<uint16_t>(upvalues.size() - 1);
+    scope.upvalueIndex[name] = idx;
+    return idx;
+}
@@ -0,0 +1,105 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "AST.h"
+#include "scope.h"
+
+// Связывает имена переменных с местом хранения: размечает VarSlot у узлов,
+// работающих с переменными, и FunctionScope у каждой функции.
+//
+// Код вне функций работает с глобалами. Внутри функции локальными считаются
+// параметры и все имена, которым функция присваивает значение, если это имя
+// не является локальной переменной объемлющей функции. Такие имена (и читаемые
+// имена объемлющих функций) становятся upvalue: значение захватывается в момент
+// создания замыкания. Остальные имена — глобалы, которые читаются в момент обращения.
+// Именованная функция не заводит локальных для глобалов модуля (builtin-ов,
+// имён функций и имён, которым присваивают вне функций): она меняет сам глобал.
+class Resolver {
+   public:
+    explicit Resolver(GlobalNames& globals) : globals_(globals) {}
+
+    void resolve(const std::vector<std::unique_ptr<FunctionAST>>& functions);
+    // Именованная функция или топ-левел выражение модуля
+    void resolve(FunctionAST& fn);
+    // Именованная функция модуля, который исполняется по мере разбора: тело
+    // резолвится при первом вызове, когда известны глобалы, заданные до него
+    void resolveOnFirstCall(FunctionAST& fn);
+    // Тело функции верхнего уровня, разобранное после резолвинга модуля
+    void resolveBody(FunctionAST& fn, bool named) { resolveFunction(fn, nullptr, false, named); }
+
+   private:
+    struct Scope {
+        Scope* enclosing = nullptr;
+        bool topLevel = false;
+        // Функция работает с глобалами модуля напрямую: именованная или литерал внутри неё
+        bool liveGlobals = false;
+        FunctionScope layout = {};
+        std::unordered_map<Symbol, uint32_t> locals = {};
+        std::unordered_map<Symbol, uint16_t> upvalueIndex = {};
+    };
+
+    void bindGlobals(const FunctionAST& fn);
+    void deferBody(FunctionAST& fn);
+    void resolveFunction(FunctionAST& fn, Scope* enclosing, bool topLevel, bool named);
+    void resolveExpr(const ExprAST* e);
+    VarSlot lookup(Symbol name);
+    int resolveUpvalue(Scope& scope, Symbol name);
+
+    GlobalNames& globals_;
+    Scope* scope_ = nullptr;
+};
+
+// Обходит непосредственных потомков узла. Тело вложенного FunctionLiteralExprAST
+// не посещается — это отдельная область видимости.
+template <class F>
+void forEachChild(const ExprAST* e, F&& f) {
+    if (auto* n = dynamic_cast<const BinaryExprAST*>(e)) {
+        f(n->getLHS());
+        f(n->getRHS());
+    } else if (auto* n = dynamic_cast<const UnaryExprAST*>(e)) {
+        f(n->getOperand());
+    } else if (auto* n = dynamic_cast<const CallExprAST*>(e)) {
+        f(n->getCallee());
+        for (auto& arg : n->getArgs()) f(arg.get());
+    } else if (auto* n = dynamic_cast<const AssignmentExprAST*>(e)) {
+        f(n->getExpr());
+    } else if (auto* n = dynamic_cast<const ListExprAST*>(e)) {
+        for (auto& el : n->getElements()) f(el.get());
+    } else if (auto* n = dynamic_cast<const PrefixExprAST*>(e)) {
+        f(n->getOperand());
+    } else if (auto* n = dynamic_cast<const PostfixExprAST*>(e)) {
+        f(n->getOperand());
+    } else if (auto* n = dynamic_cast<const CompoundAssignmentExprAST*>(e)) {
+        f(n->getRHS());
+    } else if (auto* n = dynamic_cast<const IndexExprAST*>(e)) {
+        f(n->getBase());
+        f(n->getIndex());
+    } else if (auto* n = dynamic_cast<const SliceExprAST*>(e)) {
+        f(n->getBase());
+        f(n->getStart());
+        f(n->getEnd());
+    } else if (auto* n = dynamic_cast<const IfExprAST*>(e)) {
+        f(n->getCond());
+        f(n->getThen());
+        f(n->getElse());
+    } else if (auto* n = dynamic_cast<const WhileExprAST*>(e)) {
+        f(n->getCond());
+        f(n->getBody());
+    } else if (auto* n = dynamic_cast<const ForExprAST*>(e)) {
+        f(n->getSeq());
+        f(n->getBody());
+    } else if (auto* n = dynamic_cast<const InExprAST*>(e)) {
+        f(n->getLHS());
+        f(n->getRHS());
+    } else if (auto* n = dynamic_cast<const BlockExprAST*>(e)) {
+        for (auto& s : n->getStatements()) f(s.get());
+    } else if (auto* n = dynamic_cast<const ReturnExprAST*>(e)) {
+        f(n->getExpr());
+    }
+}
+
+// Имя переменной, которой узел присваивает значение, или пустой символ
+Symbol assignedName(const ExprAST* e);
@@ -0,0 +1,62 @@
+#include "scan.h"
+
+#include "scan_kernels.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+#if defined(__SSE2__)
+struct Sse2 {
+    static constexpr int kWidth = 16;
+    static constexpr uint32_t kFull = 0xFFFF;
+
+    static __m128i load(const char* p) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)); }
+    static __m128i eq(__m128i x, char c) { return _mm_cmpeq_epi8(x, _mm_set1_epi8(c)); }
+    static __m128i or_(__m128i a, __m128i b) { return _mm_or_si128(a, b); }
+    // Буквы в нижний регистр; другие байты в диапазон букв не попадают
+    static __m128i lower(__m128i x) { return _mm_or_si128(x, _mm_set1_epi8(0x20)); }
+    // lo <= x <= hi как беззнаковое x - lo <= hi - lo
+    static __m128i inRange(__m128i x, char lo, char hi) {
+        __m128i d = _mm_sub_epi8(x, _mm_set1_epi8(lo));
+        return _mm_cmpeq_epi8(_mm_min_epu8(d, _mm_set1_epi8(static_cast<char>(hi - lo))), d);
+    }
+    static uint32_t mask(__m128i x) { return static_cast<uint32_t>(_mm_movemask_epi8(x)); }
+};
+#endif
+
+constexpr ScanKernels kScalar{"scalar", identEndScalar, digitsEndScalar, spaceEndScalar, quoteOrBackslashScalar};
+
+#if defined(__SSE2__)
+constexpr ScanKernels kSse2 = makeKernels<Sse2>("sse2");
+#endif
+
+}  // namespace
+
+const ScanKernels* scalarScanKernels() { return &kScalar; }
+
+const ScanKernels* sse2ScanKernels() {
+#if defined(__SSE2__)
+    return &kSse2;
+#else
+    return nullptr;
+#endif
+}
+
+const ScanKernels* avx2ScanKernels() {
+#if defined(__x86_64__) || defined(__i386__)
+    if (__builtin_cpu_supports("avx2")) return compiledAvx2Kernels();
+#endif
+    return nullptr;
+}
+
+const ScanKernels& scanKernels() {
+    static const ScanKernels& best = []() -> const ScanKernels& {
+        if (const ScanKernels* k = avx2ScanKernels()) return *k;
+        if (const ScanKernels* k = sse2ScanKernels()) return *k;
+        return kScalar;
+    }();
+    return best;
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include <array>
+#include <cstdint>
+
+// Классы символов без учёта локали: лексер смотрит только на ASCII
+enum CharClass : uint8_t {
+    kCharSpace = 1,  // пробел, табуляция, \r, \n
+    kCharDigit = 2,
+    kCharAlpha = 4,  // буква или '_'
+};
+
+inline constexpr std::array<uint8_t, 256> charClasses = [] {
+    std::array<uint8_t, 256> table{};
+    for (unsigned char c : {' ', '\t', '\r', '\n'}) table[c] = kCharSpace;
+    for (int c = '0'; c <= '9'; ++c) table[c] = kCharDigit;
+    for (int c = 'a'; c <= 'z'; ++c) table[c] = table[c - 'a' + 'A'] = kCharAlpha;
+    table['_'] = kCharAlpha;
+    return table;
+}();
+
+constexpr bool isDigitChar(char c) { return charClasses[static_cast<unsigned char>(c)] & kCharDigit; }
+constexpr bool isIdentStart(char c) { return charClasses[static_cast<unsigned char>(c)] & kCharAlpha; }
+
+// Поиск границ лексем в [p, end) блоками по 16–32 байта. Функции возвращают
+// первый байт, на котором лексема кончается, или end; переводы строк, которые
+// встретились по пути, добавляются к lines.
+struct ScanKernels {
+    const char* name;
+    // Первый байт, не являющийся буквой, цифрой или '_'
+    const char* (*identEnd)(const char* p, const char* end);
+    // Первый байт, не являющийся цифрой
+    const char* (*digitsEnd)(const char* p, const char* end);
+    // Первый байт, не являющийся пробелом, табуляцией или переводом строки
+    const char* (*spaceEnd)(const char* p, const char* end, int& lines);
+    // Первая кавычка или обратная косая черта
+    const char* (*quoteOrBackslash)(const char* p, const char* end, int& lines);
+};
+
+// Лучшие ядра для текущего процессора: AVX2, SSE2 или скалярные
+const ScanKernels& scanKernels();
+
+// Ядра по возрастанию ширины; недоступные на этом процессоре — nullptr
+const ScanKernels* scalarScanKernels();
+const ScanKernels* sse2ScanKernels();
+const ScanKernels* avx2ScanKernels();
@@ -0,0 +1,32 @@
+// Собирается с -mavx2 (см. CMakeLists.txt). Код отсюда вызывается, только
+// если scan.cpp убедился, что процессор поддерживает AVX2
+#include "scan_kernels.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+
+namespace {
+
+struct Avx2 {
+    static constexpr int kWidth = 32;
+    static constexpr uint32_t kFull = 0xFFFFFFFF;
+
+    static __m256i load(const char* p) { return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)); }
+    static __m256i eq(__m256i x, char c) { return _mm256_cmpeq_epi8(x, _mm256_set1_epi8(c)); }
+    static __m256i or_(__m256i a, __m256i b) { return _mm256_or_si256(a, b); }
+    static __m256i lower(__m256i x) { return _mm256_or_si256(x, _mm256_set1_epi8(0x20)); }
+    static __m256i inRange(__m256i x, char lo, char hi) {
+        __m256i d = _mm256_sub_epi8(x, _mm256_set1_epi8(lo));
+        return _mm256_cmpeq_epi8(_mm256_min_epu8(d, _mm256_set1_epi8(static_cast<char>(hi - lo))), d);
+    }
+    static uint32_t mask(__m256i x) { return static_cast<uint32_t>(_mm256_movemask_epi8(x)); }
+};
+
+constexpr ScanKernels kAvx2 = makeKernels<Avx2>("avx2");
+
+}  // namespace
+
+const ScanKernels* compiledAvx2Kernels() { return &kAvx2; }
+#else
+const ScanKernels* compiledAvx2Kernels() { return nullptr; }
+#endif
@@ -0,0 +1,109 @@
+#pragma once
+// Общая часть ядер из scan.h. Подключается из scan.cpp и scan_avx2.cpp: каждая
+// единица трансляции собирается со своими флагами процессора, поэтому всё здесь
+// лежит в анонимном пространстве имён — иначе компоновщик мог бы подставить
+// AVX2-копию функции туда, где AVX2 нет. По той же причине вместо <bit>
+// используются встроенные функции компилятора.
+#include <cstdint>
+
+#include "scan.h"
+
+// Определена в scan_avx2.cpp; nullptr, если он собран без AVX2
+const ScanKernels* compiledAvx2Kernels();
+
+namespace {
+
+const char* identEndScalar(const char* p, const char* end) {
+    while (p < end && (charClasses[static_cast<unsigned char>(*p)] & (kCharAlpha | kCharDigit))) ++p;
+    return p;
+}
+
+const char* digitsEndScalar(const char* p, const char* end) {
+    while (p < end && (charClasses[static_cast<unsigned char>(*p)] & kCharDigit)) ++p;
+    return p;
+}
+
+const char* spaceEndScalar(const char* p, const char* end, int& lines) {
+    for (; p < end && (charClasses[static_cast<unsigned char>(*p)] & kCharSpace); ++p)
+        if (*p == '\n') ++lines;
+    return p;
+}
+
+const char* quoteOrBackslashScalar(const char* p, const char* end, int& lines) {
+    for (; p < end && *p != '"' && *p != '\\'; ++p)
+        if (*p == '\n') ++lines;
+    return p;
+}
+
+// V — набор операций над вектором из V::kWidth байт:
+// load, eq(x, c), inRange(x, lo, hi), lower(x), or_(a, b) и mask(x) — по биту на байт.
+// Хвост короче вектора доходит скалярный код: читать за end нельзя,
+// текст может быть отображённым в память файлом.
+template <class V>
+const char* identEnd(const char* p, const char* end) {
+    while (end - p >= V::kWidth) {
+        auto x = V::load(p);
+        auto ident = V::or_(V::or_(V::inRange(V::lower(x), 'a', 'z'), V::inRange(x, '0', '9')), V::eq(x, '_'));
+        if (uint32_t stop = ~V::mask(ident) & V::kFull) return p + __builtin_ctz(stop);
+        p += V::kWidth;
+    }
+    return identEndScalar(p, end);
+}
+
+template <class V>
+const char* digitsEnd(const char* p, const char* end) {
+    while (end - p >= V::kWidth) {
+        if (uint32_t stop = ~V::mask(V::inRange(V::load(p), '0', '9')) & V::kFull) return p + __builtin_ctz(stop);
+        p += V::kWidth;
+    }
+    return digitsEndScalar(p, end);
+}
+
+// Переводы строк до найденной позиции
+inline int linesBefore(uint32_t newlines, uint32_t stop) {
+    return __builtin_popcount(newlines & ((stop & -stop) - 1));
+}
+
+template <class V>
+const char* spaceEnd(const char* p, const char* end, int& lines) {
+    // Между токенами чаще всего один пробел или перевод строки — их проверяем без векторов
+    for (int i = 0; i < 2; ++i, ++p) {
+        if (p == end || !(charClasses[static_cast<unsigned char>(*p)] & kCharSpace)) return p;
+        if (*p == '\n') ++lines;
+    }
+    while (end - p >= V::kWidth) {
+        auto x = V::load(p);
+        auto nl = V::eq(x, '\n');
+        auto space = V::or_(V::or_(V::eq(x, ' '), V::eq(x, '\t')), V::or_(V::eq(x, '\r'), nl));
+        uint32_t newlines = V::mask(nl);
+        if (uint32_t stop = ~V::mask(space) & V::kFull) {
+            lines += linesBefore(newlines, stop);
+            return p + __builtin_ctz(stop);
+        }
+        lines += __builtin_popcount(newlines);
+        p += V::kWidth;
+    }
+    return spaceEndScalar(p, end, lines);
+}
+
+template <class V>
+const char* quoteOrBackslash(const char* p, const char* end, int& lines) {
+    while (end - p >= V::kWidth) {
+        auto x = V::load(p);
+        uint32_t newlines = V::mask(V::eq(x, '\n'));
+        if (uint32_t stop = V::mask(V::or_(V::eq(x, '"'), V::eq(x, '\\')))) {
+            lines += linesBefore(newlines, stop);
+            return p + __builtin_ctz(stop);
+        }
+        lines += __builtin_popcount(newlines);
+        p += V::kWidth;
+    }
+    return quoteOrBackslashScalar(p, end, lines);
+}
+
+template <class V>
+constexpr ScanKernels makeKernels(const char* name) {
+    return {name, identEnd<V>, digitsEnd<V>, spaceEnd<V>, quoteOrBackslash<V>};
+}
+
+}  // namespace
@@ -0,0 +1,274 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "builtins.h"
+#include "environment.h"
+#include "symbol.h"
+#include "value.h"
+
+// Где живёт переменная после резолвинга: слот кадра функции, upvalue замыкания
+// или глобальная таблица
+enum class SlotKind : uint8_t { Local, Upvalue, Global };
+
+struct VarSlot {
+    SlotKind kind = SlotKind::Global;
+    uint32_t index = 0;
+};
+
+// Откуда замыкание берёт upvalue при создании
+enum class UpvalueSource : uint8_t {
+    ParentLocal,    // копия слота родителя
+    ParentUpvalue,  // общая ячейка upvalue родителя
+    Global,         // копия глобала: литерал верхнего уровня видит глобалы на момент создания
+    Self,           // само замыкание: литерал, присваиваемый этому глобалу
+};
+
+struct UpvalueDesc {
+    UpvalueSource source = UpvalueSource::ParentLocal;
+    uint32_t index = 0;  // слот, upvalue родителя или индекс глобала
+    Symbol name = {};
+};
+
+// Раскладка кадра функции: параметры занимают первые numParams слотов
+struct FunctionScope {
+    uint16_t numParams = 0;
+    uint32_t numLocals = 0;
+    std::vector<UpvalueDesc> upvalues;
+};
+
+// Имена глобальных переменных и их индексы
+struct GlobalNames {
+    std::vector<Symbol> names;
+    std::unordered_map<Symbol, uint32_t> index;
+    // Номер builtin-а с тем же именем или -1
+    std::vector<int> builtins;
+    // Глобал, которому модуль присваивает значение вне функций, или имя функции
+    std::vector<uint8_t> bound;
+
+    uint32_t intern(Symbol name) {
+        auto it = index.find(name);
+        if (it != index.end()) return it->second;
+        uint32_t idx = static_cast<uint32_t>(names.size());
+        names.push_back(name);
+        index.emplace(name, idx);
+        builtins.push_back(findBuiltin(name.name()));
+        bound.push_back(0);
+        return idx;
+    }
+    uint32_t intern(std::string_view name) { return intern(Symbol::intern(name)); }
+
+    void bind(Symbol name) { bound[intern(name)] = 1; }
+
+    // Глобал, который задаёт сам модуль
+    bool assigned(Symbol name) const {
+        auto it = index.find(name);
+        return it != index.end() && bound[it->second];
+    }
+
+    // Присваивание такому имени внутри функции меняет глобал, а не заводит локальную
+    bool exists(Symbol name) const {
+        auto it = index.find(name);
+        return it != index.end() && (bound[it->second] || builtins[it->second] >= 0);
+    }
+};
+
+// Значения глобальных переменных, адресуемые индексами GlobalNames
+class GlobalTable {
+   public:
+    // Глобалы с именами builtin-ов сразу получают встроенные функции
+    explicit GlobalTable(const GlobalNames& names) : names_(names) { grow(); }
+
+    // Заводит места для имён, внесённых в GlobalNames после создания таблицы.
+    // Вызывается между запусками: ссылки на значения таблицы при этом теряют силу
+    void grow() {
+        size_t from = values_.size();
+        values_.resize(names_.names.size());
+        defined_.resize(names_.names.size(), 0);
+        for (size_t i = from; i < values_.size(); ++i)
+            if (names_.builtins[i] >= 0) set(static_cast<uint32_t>(i), builtinValue(names_.builtins[i]));
+    }
+
+    // nullptr, если глобал не задан
+    const Value* find(uint32_t idx) const { return defined_[idx] ? &values_[idx] : nullptr; }
+
+    const Value& get(uint32_t idx) const {
+        if (!defined_[idx]) throw std::runtime_error("Undefined variable '" + names_.names[idx].name() + "'");
+        return values_[idx];
+    }
+
+    void set(uint32_t idx, Value v) {
+        values_[idx] = std::move(v);
+        defined_[idx] = 1;
+    }
+
+    // Копирует переменные окружения, имена которых встречаются в программе
+    void bind(const Environment& env) {
+        env.forEach([this](Symbol name, const Value& v) {
+            auto it = names_.index.find(name);
+            if (it != names_.index.end()) set(it->second, v);
+        });
+    }
+
+   private:
+    const GlobalNames& names_;
+    std::vector<Value> values_;
+    std::vector<char> defined_;
+};
+
+struct UpvalueCell {
+    Value value;
+    // Захваченный глобал, который не был задан: чтение — ошибка, пока ячейке не присвоят
+    Symbol undefined = {};
+
+    const Value& get() const {
+        if (undefined) [[unlikely]]
+            throw std::runtime_error("Undefined variable '" + undefined.name() + "'");
+        return value;
+    }
+    void set(Value v) {
+        value = std::move(v);
+        undefined = Symbol();
+    }
+};
+
+// Ячейки замыкания, которые не берутся у родителя: копия глобала или место для
+// самого замыкания (его заполняет fillSelf)
+inline std::shared_ptr<UpvalueCell> captureOwnUpvalue(const GlobalTable& globals, const UpvalueDesc& d) {
+    if (d.source == UpvalueSource::Self) return std::make_shared<UpvalueCell>();
+    const Value* v = globals.find(d.index);
+    return std::make_shared<UpvalueCell>(v ? UpvalueCell{*v} : UpvalueCell{Value(), d.name});
+}
+
+inline void fillSelf(const std::vector<UpvalueDesc>& descs, const UpvalueList& cells, const Value& self) {
+    for (size_t i = 0; i < descs.size(); ++i)
+        if (descs[i].source == UpvalueSource::Self) cells[i]->value = self;
+}
+
+// Как завершилось последнее вычисление: обычным образом или через return/break/continue
+enum class Completion : uint8_t { Normal, Return, Break, Continue };
+
+// Слоты локальных переменных кадров обхода AST. Кадры берут и возвращают слоты
+// в порядке стека, поэтому память выделяется только при росте глубины вызовов
+// и дальше переиспользуется. Блоки не перемещаются: указатели на слоты
+// внешних кадров остаются верными
+class FrameArena {
+   public:
+    static FrameArena& local() {
+        static thread_local FrameArena arena;
+        return arena;
+    }
+
+    Value* acquire(size_t n) {
+        if (chunks_.empty() || chunks_[current_].used + n > chunks_[current_].size) nextChunk(n);
+        Chunk& chunk = chunks_[current_];
+        Value* slots = chunk.slots.get() + chunk.used;
+        chunk.used += n;
+        return slots;
+    }
+
+    // Возвращает последние выданные слоты, очищая их значения
+    void release(Value* slots, size_t n) {
+        for (size_t i = 0; i < n; ++i) slots[i] = Value();
+        Chunk& chunk = chunks_[current_];
+        chunk.used -= n;
+        if (chunk.used == 0 && current_ > 0 && chunks_[current_ - 1].used > 0) --current_;
+    }
+
+   private:
+    static constexpr size_t kChunkSlots = 4096;
+
+    struct Chunk {
+        std::unique_ptr<Value[]> slots;
+        size_t size;
+        size_t used;
+    };
+
+    void nextChunk(size_t n) {
+        if (!chunks_.empty() && chunks_[current_].used > 0) ++current_;
+        if (current_ < chunks_.size() && chunks_[current_].size < n) chunks_.resize(current_);
+        if (current_ == chunks_.size()) {
+            size_t size = std::max(n, kChunkSlots);
+            chunks_.push_back(Chunk{std::make_unique<Value[]>(size), size, 0});
+        }
+    }
+
+    std::vector<Chunk> chunks_;
+    size_t current_ = 0;
+};
+
+// Аргументы вызова, которые нельзя сразу положить в кадр вызываемой функции
+// (builtin, другое число аргументов): окно на вершине FrameArena
+class ArgWindow {
+   public:
+    explicit ArgWindow(size_t n) : slots_(FrameArena::local().acquire(n)), size_(n) {}
+    ~ArgWindow() { FrameArena::local().release(slots_, size_); }
+
+    ArgWindow(const ArgWindow&) = delete;
+    ArgWindow& operator=(const ArgWindow&) = delete;
+
+    Value* data() const { return slots_; }
+    std::span<Value> span() const { return {slots_, size_}; }
+
+   private:
+    Value* slots_;
+    size_t size_;
+};
+
+// Кадр активации при обходе AST
+struct Frame {
+    GlobalTable& globals;
+    Value* locals;
+    const UpvalueList* upvalues;
+    Completion completion = Completion::Normal;
+
+    Frame(GlobalTable& g, size_t numLocals, const UpvalueList* up)
+        : globals(g), locals(FrameArena::local().acquire(numLocals)), upvalues(up), numLocals_(numLocals) {}
+    ~Frame() { FrameArena::local().release(locals, numLocals_); }
+
+    Frame(const Frame&) = delete;
+    Frame& operator=(const Frame&) = delete;
+
+    // Вычисление прервано return/break/continue — оставшиеся подвыражения пропускаются
+    bool abrupt() const { return completion != Completion::Normal; }
+
+    // break/continue не могут покинуть функцию или топ-левел выражение
+    void checkNoLoopEscape() const {
+        if (completion == Completion::Break) throw std::runtime_error("'break' outside of a loop");
+        if (completion == Completion::Continue) throw std::runtime_error("'continue' outside of a loop");
+    }
+
+    const Value& get(const VarSlot& slot) const {
+        switch (slot.kind) {
+            case SlotKind::Local:
+                return locals[slot.index];
+            case SlotKind::Upvalue:
+                return (*upvalues)[slot.index]->get();
+            default:
+                return globals.get(slot.index);
+        }
+    }
+
+    void set(const VarSlot& slot, Value v) {
+        switch (slot.kind) {
+            case SlotKind::Local:
+                locals[slot.index] = std::move(v);
+                break;
+            case SlotKind::Upvalue:
+                (*upvalues)[slot.index]->set(std::move(v));
+                break;
+            default:
+                globals.set(slot.index, std::move(v));
+                break;
+        }
+    }
+
+   private:
+    size_t numLocals_;
+};
@@ -0,0 +1,65 @@
+#include "source.h"
+
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <utility>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define ISCRIPT_HAVE_MMAP 1
+#endif
+
+SourceBuffer SourceBuffer::open(const std::string& path) {
+#ifdef ISCRIPT_HAVE_MMAP
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) throw std::runtime_error("Cannot open file: " + path);
+    struct stat st {};
+    if (::fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        void* p = ::mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p != MAP_FAILED) {
+            ::close(fd);
+            SourceBuffer buf;
+            buf.data_ = static_cast<const char*>(p);
+            buf.size_ = static_cast<size_t>(st.st_size);
+            buf.mapped_ = true;
+            return buf;
+        }
+    }
+    // Пустой файл, канал или отказ mmap — читаем обычным образом
+    ::close(fd);
+#endif
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) throw std::runtime_error("Cannot open file: " + path);
+    return read(file);
+}
+
+SourceBuffer SourceBuffer::read(std::istream& input) {
+    return SourceBuffer(std::string(std::istreambuf_iterator<char>(input), std::istreambuf_iterator<char>()));
+}
+
+SourceBuffer& SourceBuffer::operator=(SourceBuffer&& other) noexcept {
+    if (this == &other) return *this;
+    unmap();
+    mapped_ = std::exchange(other.mapped_, false);
+    size_ = std::exchange(other.size_, 0);
+    if (mapped_) {
+        data_ = std::exchange(other.data_, "");
+    } else {
+        // Короткая строка при перемещении копируется, поэтому указатель берём заново
+        owned_ = std::move(other.owned_);
+        data_ = owned_.data();
+        other.data_ = "";
+    }
+    return *this;
+}
+
+void SourceBuffer::unmap() {
+#ifdef ISCRIPT_HAVE_MMAP
+    if (mapped_) ::munmap(const_cast<char*>(data_), size_);
+#endif
+    mapped_ = false;
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include <cstddef>
+#include <istream>
+#include <string>
+#include <string_view>
+
+// Текст модуля одним непрерывным куском. Файл отображается в память целиком,
+// поток читается за один проход — лексер потом работает только с указателями.
+class SourceBuffer {
+   public:
+    SourceBuffer() = default;
+    explicit SourceBuffer(std::string text) : owned_(std::move(text)), data_(owned_.data()), size_(owned_.size()) {}
+
+    // Бросает std::runtime_error, если файл не удалось открыть
+    static SourceBuffer open(const std::string& path);
+    static SourceBuffer read(std::istream& input);
+
+    SourceBuffer(SourceBuffer&& other) noexcept { *this = std::move(other); }
+    SourceBuffer& operator=(SourceBuffer&& other) noexcept;
+    SourceBuffer(const SourceBuffer&) = delete;
+    SourceBuffer& operator=(const SourceBuffer&) = delete;
+    ~SourceBuffer() { unmap(); }
+
+    std::string_view text() const { return {data_, size_}; }
+
+   private:
+    void unmap();
+
+    std::string owned_;
+    const char* data_ = "";
+    size_t size_ = 0;
+    bool mapped_ = false;
+};
@@ -0,0 +1,26 @@
+#include "symbol.h"
+
+#include <deque>
+#include <mutex>
+#include <unordered_map>
+
+Symbol Symbol::intern(std::string_view name) {
+    // Записи не перемещаются, поэтому Symbol хранит указатель на свою запись
+    // и читает имя без обращения к таблице
+    static std::mutex mutex;
+    static std::deque<Entry> entries;
+    static std::unordered_map<std::string_view, const Entry*> index;
+
+    std::lock_guard lock(mutex);
+    auto it = index.find(name);
+    if (it != index.end()) return Symbol(it->second);
+    // Номер 0 остаётся за пустым символом
+    const Entry& entry = entries.emplace_back(Entry{std::string(name), static_cast<uint32_t>(entries.size() + 1)});
+    index.emplace(entry.name, &entry);
+    return Symbol(&entry);
+}
+
+const std::string& Symbol::name() const {
+    static const std::string empty;
+    return entry_ ? entry_->name : empty;
+}
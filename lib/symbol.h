@@ -0,0 +1,37 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+
+// Интернированный идентификатор. Одинаковые имена дают один и тот же Symbol,
+// поэтому имена сравниваются как числа, а строка имени хранится один раз.
+// Номера символов плотные: их можно использовать как индексы массивов.
+class Symbol {
+   public:
+    Symbol() = default;
+
+    static Symbol intern(std::string_view name);
+
+    // Номер символа; у пустого символа — 0
+    uint32_t id() const { return entry_ ? entry_->id : 0; }
+    const std::string& name() const;
+
+    explicit operator bool() const { return entry_ != nullptr; }
+    bool operator==(const Symbol& other) const = default;
+
+   private:
+    struct Entry {
+        std::string name;
+        uint32_t id;
+    };
+
+    explicit Symbol(const Entry* e) : entry_(e) {}
+
+    const Entry* entry_ = nullptr;
+};
+
+template <>
+struct std::hash<Symbol> {
+    size_t operator()(const Symbol& s) const noexcept { return s.id(); }
+};
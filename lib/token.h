@@ -1,7 +1,15 @@
 #pragma once
 
+#include <cstdint>
+#include <memory>
 #include <string>
+#include <string_view>
 #include <variant>
+#include <vector>
+
+#include "symbol.h"
+
+class SourceBuffer;
 
 enum class TokenType {
     // end of input
@@ -75,8 +83,64 @@ enum class TokenType {
 using Literal = std::variant<std::monostate, bool, double, std::string>;
 
 struct Token {
-    TokenType type;
+    TokenType type = TokenType::EndOfFile;
     std::string lexeme;
     Literal literal;
-    int line;
+    int line = 0;
+    Symbol symbol = {};  // имя идентификатора
+};
+
+// Токен из TokenStream: лексема указывает в исходный текст
+struct TokenView {
+    TokenType type = TokenType::EndOfFile;
+    std::string_view lexeme;
+    Literal literal;
+    int line = 0;
+    Symbol symbol;
+};
+
+// Токены модуля по столбцам. Вместо копии лексемы хранятся её смещение и длина
+// в исходном тексте, значения литералов и имена — в отдельных таблицах.
+struct TokenStream {
+    static constexpr uint32_t kNoPayload = UINT32_MAX;
+
+    std::string_view source;
+    // Владелец source, если текст принадлежит лексеру
+    std::shared_ptr<const SourceBuffer> buffer;
+    std::vector<TokenType> types;
+    std::vector<uint32_t> offsets;
+    std::vector<uint32_t> lengths;
+    std::vector<uint32_t> lines;
+    // Number, String, Identifier и ошибка — индекс в своей таблице, Boolean — само значение
+    std::vector<uint32_t> payloads;
+
+    std::vector<double> numbers;
+    std::vector<std::string> strings;  // строковые литералы и сообщения об ошибках
+    std::vector<Symbol> symbols;
+
+    size_t size() const { return types.size(); }
+    std::string_view text(size_t i) const { return source.substr(offsets[i], lengths[i]); }
+
+    // Токен целиком; строковый литерал забирается из таблицы, поэтому
+    // каждый токен можно взять только один раз
+    TokenView take(size_t i) {
+        TokenView tok{types[i], text(i), {}, static_cast<int>(lines[i]), {}};
+        uint32_t payload = payloads[i];
+        if (payload == kNoPayload) return tok;
+        switch (tok.type) {
+            case TokenType::Number:
+                tok.literal = numbers[payload];
+                break;
+            case TokenType::Boolean:
+                tok.literal = payload != 0;
+                break;
+            case TokenType::Identifier:
+                tok.symbol = symbols[payload];
+                break;
+            default:
+                tok.literal = std::move(strings[payload]);
+                break;
+        }
+        return tok;
+    }
 };
@@ -1,55 +1,59 @@
 #include "value.h"
 
+#include <array>
+#include <functional>
 #include <iostream>
 
 #include "AST.h"
-#include "environment.h"
+#include "vm.h"
 
-std::vector<std::string> g_callStack;
+std::vector<const std::string*> g_callStack;
 
 std::string Value::toString() const {
-    return std::visit(overloaded{
-                          [](std::monostate) -> std::string { return "nil"; },
-                          [](double d) -> std::string {
-                              if (std::floor(d) == d) return std::to_string((long long)d);
-                              std::ostringstream oss;
-                              oss << d;
-                              return oss.str();
-                          },
-                          [](bool b) -> std::string { return b ? "true" : "false"; },
-                          [](const std::string& s) -> std::string { return s; },
-                          [](const Value::ListPtr& vecPtr) -> std::string {
-                              const auto& vec = *vecPtr;
-                              std::ostringstream oss;
-                              if (vec.size() != 1) oss << '[';
-                              for (size_t i = 0; i < vec.size(); ++i) {
-                                  if (i) oss << ", ";
-                                  if (vec[i].isString())
-                                      oss << '"' << vec[i].toString() << '"';
-                                  else
-                                      oss << vec[i].toString();
-                              }
-                              if (vec.size() != 1) oss << ']';
-                              return oss.str();
-                          },
-                          [](const FunctionValue&) -> std::string { return "<function>"; }},
-                      v);
+    if (isNil()) return "nil";
+    if (isNumber()) {
+        double d = asNumber();
+        if (std::floor(d) == d) return std::to_string((long long)d);
+        std::ostringstream oss;
+        oss << d;
+        return oss.str();
+    }
+    if (isBool()) return asBool() ? "true" : "false";
+    if (isString()) return std::string(asString());
+    if (isList()) {
+        const auto& vec = asList();
+        std::ostringstream oss;
+        if (vec.size() != 1) oss << '[';
+        for (size_t i = 0; i < vec.size(); ++i) {
+            if (i) oss << ", ";
+            if (vec[i].isString())
+                oss << '"' << vec[i].toString() << '"';
+            else
+                oss << vec[i].toString();
+        }
+        if (vec.size() != 1) oss << ']';
+        return oss.str();
+    }
+    return "<function>";
 }
 
 std::string Value::typeName() const {
-    return std::visit(overloaded{
-                          [](std::monostate) -> std::string { return "null"; },
-                          [](double) -> std::string { return "number"; },
-                          [](bool) -> std::string { return "bool"; },
-                          [](const std::string&) -> std::string { return "string"; },
-                          [](const Value::ListPtr&) -> std::string { return "list"; },
-                          [](const FunctionValue&) -> std::string { return "function"; }},
-                      v);
+    if (isNil()) return "null";
+    if (isNumber()) return "number";
+    if (isBool()) return "bool";
+    if (isString()) return "string";
+    if (isList()) return "list";
+    return "function";
 }
 
-Value FunctionValue::invoke(const std::vector<Value>& args) const {
+Value FunctionValue::invoke(std::span<Value> args) const {
     if (isBuiltin) {
-        return builtinFn(args);
+        return native(args);
+    }
+    if (compiled) {
+        VM* vm = VM::active();
+        if (!vm) throw std::runtime_error("Compiled function called outside of VM");
+        return vm->call(*this, args);
     }
 
     const auto& proto = fnAST->getProto();
@@ -61,88 +65,266 @@ Value FunctionValue::invoke(const std::vector<Value>& args) const {
             " arguments, got " + std::to_string(args.size()));
     }
 
-    g_callStack.push_back(proto.getName());
+    fnAST->ensureBody();
+    Frame frame(*globals, fnAST->getScope().numLocals, upvalues.get());
+    std::move(args.begin(), args.end(), frame.locals);
+    return run(frame);
+}
 
-    auto activationEnv = std::make_shared<Environment>(closure);
-    for (size_t i = 0; i < args.size(); ++i) {
-        activationEnv->set(names[i], args[i]);
-    }
+namespace {
+// Имя функции лежит на g_callStack, пока она исполняется, в том числе когда
+// она завершается исключением: после запуска на стеке не остаётся имён из его AST
+struct CallStackEntry {
+    explicit CallStackEntry(const std::string* name) { g_callStack.push_back(name); }
+    ~CallStackEntry() { g_callStack.pop_back(); }
+    CallStackEntry(const CallStackEntry&) = delete;
+    CallStackEntry& operator=(const CallStackEntry&) = delete;
+};
+}  // namespace
+
+Value FunctionValue::run(Frame& frame) const {
+    CallStackEntry entry(&fnAST->getProto().getName());
+    Value result = fnAST->getBody().eval(frame);
+    frame.checkNoLoopEscape();
+    return frame.completion == Completion::Return ? result : Value{};
+}
 
-    try {
-        fnAST->getBody().eval(*activationEnv);
-        g_callStack.pop_back();
-        return Value{};
-    } catch (const ReturnException& ret) {
-        g_callStack.pop_back();
-        return ret.value;
-    }
+// Операторы выбирают обработчик по паре типов операндов: одна проверка
+// на два числа, затем один переход по таблице
+// Обработчикам операторов нужен доступ к объекту строки
+struct ValueAccess {
+    static Value wrap(HeapObject* obj) { return Value(obj); }
+    static const StringObject* string(const Value& v) { return static_cast<const StringObject*>(v.object()); }
+};
+
+namespace {
+
+using Kind = Value::Kind;
+using BinaryFn = Value (*)(const Value&, const Value&);
+using CompareFn = bool (*)(const Value&, const Value&);
+
+template <class Fn>
+using PairTable = std::array<Fn, Value::kKinds * Value::kKinds>;
+
+constexpr int pairOf(Kind a, Kind b) { return static_cast<int>(a) * Value::kKinds + static_cast<int>(b); }
+int pairOf(const Value& a, const Value& b) { return pairOf(a.kind(), b.kind()); }
+
+constexpr Kind kNumericKinds[] = {Kind::Number, Kind::Bool};
+
+// Для пар, где с обеих сторон число или bool
+template <class Fn>
+constexpr void setNumeric(PairTable<Fn>& t, Fn f) {
+    for (Kind a : kNumericKinds)
+        for (Kind b : kNumericKinds) t[pairOf(a, b)] = f;
 }
 
-Value operator+(Value const& a, Value const& b) {
-    if (a.isString() && b.isString())
-        return Value(a.asString() + b.asString());
-
-    if (a.isList() && b.isList()) {
-        auto r = a.asList();
-        auto const& rhs = b.asList();
-        r.insert(r.end(), rhs.begin(), rhs.end());
-        return Value(std::move(r));
+// Для пар, где хотя бы с одной стороны nil; пара nil, nil отдельно
+template <class Fn>
+constexpr void setNil(PairTable<Fn>& t, Fn withNil, Fn bothNil) {
+    for (int k = 0; k < Value::kKinds; ++k) {
+        t[pairOf(Kind::Nil, static_cast<Kind>(k))] = withNil;
+        t[pairOf(static_cast<Kind>(k), Kind::Nil)] = withNil;
     }
+    t[pairOf(Kind::Nil, Kind::Nil)] = bothNil;
+}
 
-    if (a.isBool() && b.isBool())
-        return Value(a.asBool() || b.asBool());
+// Арифметика
 
-    double da = Value::asNumeric(a);
-    double db = Value::asNumeric(b);
-    return Value(da + db);
+Value addNumeric(const Value& a, const Value& b) { return Value(Value::asNumeric(a) + Value::asNumeric(b)); }
+
+Value addStrings(const Value& a, const Value& b) {
+    std::string_view l = a.asString(), r = b.asString();
+    StringObject* str = StringObject::allocate(l.size() + r.size());
+    std::memcpy(str->data(), l.data(), l.size());
+    std::memcpy(str->data() + l.size(), r.data(), r.size());
+    return ValueAccess::wrap(str);
 }
 
-Value operator-(Value const& a, Value const& b) {
-    if (a.isString() && b.isString()) {
-        auto s = a.asString(), suf = b.asString();
-        if (s.size() >= suf.size() &&
-            s.compare(s.size() - suf.size(), suf.size(), suf) == 0)
-            s.erase(s.size() - suf.size(), suf.size());
-        return Value(std::move(s));
-    }
+Value addLists(const Value& a, const Value& b) {
+    auto lhs = a.asList(), rhs = b.asList();
+    if (rhs.empty()) return a.snapshot();
+    if (lhs.empty()) return b.snapshot();
+    Value::RawList r;
+    r.reserve(lhs.size() + rhs.size());
+    r.insert(r.end(), lhs.begin(), lhs.end());
+    r.insert(r.end(), rhs.begin(), rhs.end());
+    return Value(std::move(r));
+}
 
-    double da = Value::asNumeric(a);
-    double db = Value::asNumeric(b);
-    return Value(da - db);
+Value addBools(const Value& a, const Value& b) { return Value(a.asBool() || b.asBool()); }
+
+Value subNumeric(const Value& a, const Value& b) { return Value(Value::asNumeric(a) - Value::asNumeric(b)); }
+
+Value subStrings(const Value& a, const Value& b) {
+    std::string_view s = a.asString(), suf = b.asString();
+    if (suf.empty() || !s.ends_with(suf)) return a;
+    return Value(s.substr(0, s.size() - suf.size()));
 }
 
-Value operator*(Value const& a, Value const& b) {
-    if (a.isString() && (b.isNumber() || b.isBool())) {
-        std::string res;
-        std::string s = a.asString();
-        double times = Value::asNumeric(b);
-        int full = static_cast<int>(times);
-        for (int i = 0; i < full; ++i) res += s;
-        double frac = times - full;
-        int cut = static_cast<int>(frac * s.size());
-        res += s.substr(0, cut);
-        return Value(std::move(res));
-    }
-    if ((a.isNumber() || a.isBool()) && b.isString())
-        return operator*(b, a);
-
-    if (a.isList() && (b.isNumber() || b.isBool())) {
-        std::vector<Value> res;
-        auto lst = a.asList();
-        double times = Value::asNumeric(b);
-        int full = static_cast<int>(times);
-        for (int i = 0; i < full; ++i)
-            res.insert(res.end(), lst.begin(), lst.end());
-        int cut = static_cast<int>((times - full) * lst.size());
-        res.insert(res.end(), lst.begin(), lst.begin() + cut);
-        return Value(std::move(res));
+Value mulNumeric(const Value& a, const Value& b) { return Value(Value::asNumeric(a) * Value::asNumeric(b)); }
+
+Value repeatString(const Value& a, const Value& b) {
+    std::string res;
+    std::string_view s = a.asString();
+    double times = Value::asNumeric(b);
+    int full = static_cast<int>(times);
+    for (int i = 0; i < full; ++i) res += s;
+    double frac = times - full;
+    int cut = static_cast<int>(frac * s.size());
+    res += s.substr(0, cut);
+    return Value(std::move(res));
+}
+
+Value repeatList(const Value& a, const Value& b) {
+    std::vector<Value> res;
+    auto lst = a.asList();
+    double times = Value::asNumeric(b);
+    int full = static_cast<int>(times);
+    for (int i = 0; i < full; ++i)
+        res.insert(res.end(), lst.begin(), lst.end());
+    int cut = static_cast<int>((times - full) * lst.size());
+    res.insert(res.end(), lst.begin(), lst.begin() + cut);
+    return Value(std::move(res));
+}
+
+template <BinaryFn F>
+Value swapped(const Value& a, const Value& b) { return F(b, a); }
+
+constexpr auto addTable = [] {
+    PairTable<BinaryFn> t;
+    t.fill(addNumeric);
+    t[pairOf(Kind::String, Kind::String)] = addStrings;
+    t[pairOf(Kind::List, Kind::List)] = addLists;
+    t[pairOf(Kind::Bool, Kind::Bool)] = addBools;
+    return t;
+}();
+
+constexpr auto subTable = [] {
+    PairTable<BinaryFn> t;
+    t.fill(subNumeric);
+    t[pairOf(Kind::String, Kind::String)] = subStrings;
+    return t;
+}();
+
+constexpr auto mulTable = [] {
+    PairTable<BinaryFn> t;
+    t.fill(mulNumeric);
+    for (Kind k : kNumericKinds) {
+        t[pairOf(Kind::String, k)] = repeatString;
+        t[pairOf(k, Kind::String)] = swapped<repeatString>;
+        t[pairOf(Kind::List, k)] = repeatList;
+        t[pairOf(k, Kind::List)] = swapped<repeatList>;
     }
-    if ((a.isNumber() || a.isBool()) && b.isList())
-        return operator*(b, a);
+    return t;
+}();
 
-    double da = Value::asNumeric(a);
-    double db = Value::asNumeric(b);
-    return Value(da * db);
+// Сравнения. Смысл прежний: '<=' — это (a < b) || (a == b), '>' — !(a <= b),
+// '>=' — !(a < b); с nil '<' всегда ложно, разные типы сравнивать нельзя
+
+bool alwaysFalse(const Value&, const Value&) { return false; }
+bool alwaysTrue(const Value&, const Value&) { return true; }
+
+[[noreturn]] bool cannotCompare(const Value& a, const Value& b) {
+    throw std::runtime_error(
+        "Can't compare '" + a.typeName() + "' и '" + b.typeName() + "'");
+}
+
+bool equalStrings(const Value& a, const Value& b) {
+    auto* x = ValueAccess::string(a);
+    auto* y = ValueAccess::string(b);
+    if (x == y) return true;
+    if (x->length != y->length) return false;
+    if (x->hashed && y->hashed && x->hashValue != y->hashValue) return false;
+    return std::memcmp(x->chars, y->chars, x->length) == 0;
+}
+
+bool equalLists(const Value& a, const Value& b) { return std::ranges::equal(a.asList(), b.asList()); }
+
+bool lessLists(const Value& a, const Value& b) {
+    return std::ranges::lexicographical_compare(a.asList(), b.asList());
+}
+
+template <template <class> class Cmp>
+bool compareNumeric(const Value& a, const Value& b) {
+    return Cmp<double>{}(Value::asNumeric(a), Value::asNumeric(b));
+}
+
+template <template <class> class Cmp>
+bool compareStrings(const Value& a, const Value& b) {
+    return Cmp<std::string_view>{}(a.asString(), b.asString());
+}
+
+template <CompareFn F>
+bool negated(const Value& a, const Value& b) { return !F(a, b); }
+
+bool lessEqualLists(const Value& a, const Value& b) { return lessLists(a, b) || equalLists(a, b); }
+
+constexpr auto equalTable = [] {
+    PairTable<CompareFn> t;
+    t.fill(alwaysFalse);
+    setNil(t, alwaysFalse, alwaysTrue);
+    t[pairOf(Kind::String, Kind::String)] = equalStrings;
+    t[pairOf(Kind::List, Kind::List)] = equalLists;
+    setNumeric<CompareFn>(t, compareNumeric<std::equal_to>);
+    return t;
+}();
+
+constexpr auto lessTable = [] {
+    PairTable<CompareFn> t;
+    t.fill(cannotCompare);
+    setNil(t, alwaysFalse, alwaysFalse);
+    t[pairOf(Kind::String, Kind::String)] = compareStrings<std::less>;
+    t[pairOf(Kind::List, Kind::List)] = lessLists;
+    setNumeric<CompareFn>(t, compareNumeric<std::less>);
+    return t;
+}();
+
+constexpr auto lessEqualTable = [] {
+    PairTable<CompareFn> t;
+    t.fill(cannotCompare);
+    setNil(t, alwaysFalse, alwaysTrue);
+    t[pairOf(Kind::String, Kind::String)] = compareStrings<std::less_equal>;
+    t[pairOf(Kind::List, Kind::List)] = lessEqualLists;
+    setNumeric<CompareFn>(t, compareNumeric<std::less_equal>);
+    return t;
+}();
+
+constexpr auto greaterTable = [] {
+    PairTable<CompareFn> t;
+    t.fill(cannotCompare);
+    setNil(t, alwaysTrue, alwaysFalse);
+    t[pairOf(Kind::String, Kind::String)] = compareStrings<std::greater>;
+    t[pairOf(Kind::List, Kind::List)] = negated<lessEqualLists>;
+    // С NaN '>' истинно, как и !(a <= b)
+    setNumeric<CompareFn>(t, negated<compareNumeric<std::less_equal>>);
+    return t;
+}();
+
+constexpr auto greaterEqualTable = [] {
+    PairTable<CompareFn> t;
+    t.fill(cannotCompare);
+    setNil(t, alwaysTrue, alwaysTrue);
+    t[pairOf(Kind::String, Kind::String)] = compareStrings<std::greater_equal>;
+    t[pairOf(Kind::List, Kind::List)] = negated<lessLists>;
+    setNumeric<CompareFn>(t, negated<compareNumeric<std::less>>);
+    return t;
+}();
+
+}  // namespace
+
+Value operator+(Value const& a, Value const& b) {
+    if (a.isNumber() && b.isNumber()) return Value(a.asNumber() + b.asNumber());
+    return addTable[pairOf(a, b)](a, b);
+}
+
+Value operator-(Value const& a, Value const& b) {
+    if (a.isNumber() && b.isNumber()) return Value(a.asNumber() - b.asNumber());
+    return subTable[pairOf(a, b)](a, b);
+}
+
+Value operator*(Value const& a, Value const& b) {
+    if (a.isNumber() && b.isNumber()) return Value(a.asNumber() * b.asNumber());
+    return mulTable[pairOf(a, b)](a, b);
 }
 
 Value operator/(Value const& a, Value const& b) {
@@ -168,45 +350,31 @@ Value operator^(Value const& a, Value const& b) {
 }
 
 bool operator==(Value const& a, Value const& b) {
-    if (a.isNil() || b.isNil())
-        return a.isNil() && b.isNil();
-
-    if (a.isString() && b.isString())
-        return a.asString() == b.asString();
-
-    if (a.isList() && b.isList())
-        return a.asList() == b.asList();
-
-    if ((a.isNumber() || a.isBool()) && (b.isNumber() || b.isBool()))
-        return Value::asNumeric(a) == Value::asNumeric(b);
-
-    if (a.isFunc() && b.isFunc())
-        return false;
-
-    return false;
+    if (a.isNumber() && b.isNumber()) return a.asNumber() == b.asNumber();
+    return equalTable[pairOf(a, b)](a, b);
 }
 
 bool operator!=(Value const& a, Value const& b) { return !(a == b); }
 
 bool operator<(Value const& a, Value const& b) {
-    if (a.isNil() || b.isNil()) return false;
-
-    if (a.isString() && b.isString())
-        return a.asString() < b.asString();
-
-    if (a.isList() && b.isList())
-        return a.asList() < b.asList();
+    if (a.isNumber() && b.isNumber()) return a.asNumber() < b.asNumber();
+    return lessTable[pairOf(a, b)](a, b);
+}
 
-    if ((a.isNumber() || a.isBool()) && (b.isNumber() || b.isBool()))
-        return Value::asNumeric(a) < Value::asNumeric(b);
+bool operator<=(Value const& a, Value const& b) {
+    if (a.isNumber() && b.isNumber()) return a.asNumber() <= b.asNumber();
+    return lessEqualTable[pairOf(a, b)](a, b);
+}
 
-    throw std::runtime_error(
-        "Can't compare '" + a.typeName() + "' и '" + b.typeName() + "'");
+bool operator>(Value const& a, Value const& b) {
+    if (a.isNumber() && b.isNumber()) return !(a.asNumber() <= b.asNumber());
+    return greaterTable[pairOf(a, b)](a, b);
 }
 
-bool operator<=(Value const& a, Value const& b) { return (a < b) || (a == b); }
-bool operator>(Value const& a, Value const& b) { return !(a <= b); }
-bool operator>=(Value const& a, Value const& b) { return !(a < b); }
+bool operator>=(Value const& a, Value const& b) {
+    if (a.isNumber() && b.isNumber()) return !(a.asNumber() < b.asNumber());
+    return greaterEqualTable[pairOf(a, b)](a, b);
+}
 
 Value operator&&(Value const& a, Value const& b) {
     if (!a.isBool() || !b.isBool())
@@ -223,23 +391,33 @@ Value operator!(Value const& a) {
     return Value(!a.asBool());
 }
 
-Value Value::atIndex(int idx) const {
+Value Value::character(unsigned char c) {
+    // Счётчики ссылок неатомарные, поэтому у каждого потока своя таблица
+    static thread_local const std::vector<Value> table = [] {
+        std::vector<Value> chars;
+        chars.reserve(256);
+        for (int i = 0; i < 256; ++i) {
+            char ch = static_cast<char>(i);
+            chars.emplace_back(std::string_view(&ch, 1));
+        }
+        return chars;
+    }();
+    return table[c];
+}
+
+Value Value::atIndex(int64_t idx) const {
     if (isString()) {
-        auto s = asString();
-        int i = Value::normalizeIndex(idx, (int)s.size());
-        return Value(std::string(1, s[i]));
-    }
-    if (isList()) {
-        auto lst = asList();
-        int i = Value::normalizeIndex(idx, (int)lst.size());
-        return lst[i];
+        std::string_view s = asString();
+        int64_t i = Value::normalizeIndex(idx, (int64_t)s.size());
+        return Value::character(static_cast<unsigned char>(s[i]));
     }
+    if (isList()) return listAt(idx);
     throw std::runtime_error("Type '" + typeName() + "' is not subscriptable");
 }
 
 Value Value::slice(std::optional<int> obegin, std::optional<int> oend) const {
     if (isString()) {
-        auto s = asString();
+        std::string_view s = asString();
         int n = (int)s.size();
         int b = obegin.value_or(0), e = oend.value_or(n);
         if (b < 0) b += n;
@@ -247,7 +425,8 @@ Value Value::slice(std::optional<int> obegin, std::optional<int> oend) const {
         b = std::clamp(b, 0, n);
         e = std::clamp(e, 0, n);
         if (e < b) e = b;
-        return Value(s.substr(b, e - b));
+        auto* str = static_cast<const StringObject*>(object());
+        return Value(static_cast<HeapObject*>(StringObject::slice(str, b, e - b)));
     }
 
     if (isList()) {
@@ -259,9 +438,72 @@ Value Value::slice(std::optional<int> obegin, std::optional<int> oend) const {
         b = std::clamp(b, 0, n);
         e = std::clamp(e, 0, n);
         if (e < b) e = b;
-        RawList out(lst.begin() + b, lst.begin() + e);
-        return Value(std::move(out));
+        auto* list = static_cast<const ListObject*>(object());
+        return Value(static_cast<HeapObject*>(list->window(b, e - b)));
     }
 
     throw std::runtime_error("Type '" + typeName() + "' is not sliceable");
 }
+
+Value Value::snapshot() const {
+    if (!isList()) return *this;
+    auto* list = static_cast<const ListObject*>(object());
+    return Value(static_cast<HeapObject*>(list->window(0, list->items().size())));
+}
+
+Value Value::range(double start, double stop, double step) {
+    if (step == 0.0) throw std::runtime_error("range: step cannot be zero");
+
+    // При целых start и step элементы вычисляются точно, и их можно не хранить
+    if (std::isfinite(start) && std::isfinite(step) && std::floor(start) == start && std::floor(step) == step) {
+        double n = std::ceil((stop - start) / step);
+        if (!(n > 0)) n = 0;
+        if (n > 9007199254740992.0) throw std::runtime_error("range: too many elements");
+        RangeSpec spec{start, step, static_cast<size_t>(n)};
+        return Value(static_cast<HeapObject*>(new ListObject(spec)));
+    }
+
+    RawList result;
+    if (step > 0) {
+        for (double v = start; v < stop; v += step) result.emplace_back(v);
+    } else {
+        for (double v = start; v > stop; v += step) result.emplace_back(v);
+    }
+    return Value(std::move(result));
+}
+
+bool Value::contains(const Value& needle, const Value& hay) {
+    if (hay.isList()) {
+        auto* list = static_cast<const ListObject*>(hay.object());
+        if (list->range) return (needle.isNumber() || needle.isBool()) && list->range->contains(asNumeric(needle));
+        auto items = list->items();
+        return std::find(items.begin(), items.end(), needle) != items.end();
+    }
+    if (!hay.isString())
+        throw std::runtime_error("Operator 'in' expects a list or a string on the right but got '" + hay.typeName() + "'");
+    return hay.asString().find(needle.asString()) != std::string_view::npos;
+}
+
+Value SequenceIterator::prepare(const Value& seq) {
+    if (seq.isString()) return seq;
+    if (!seq.isList()) throw std::runtime_error("For: ожидается список в выражении 'in'");
+    auto* list = static_cast<const ListObject*>(seq.object());
+    if (list->range) return Value(static_cast<HeapObject*>(new ListObject(*list->range)));
+    return seq.snapshot();
+}
+
+bool SequenceIterator::at(const Value& seq, size_t i, Value& out) {
+    if (seq.isString()) {
+        std::string_view s = seq.asString();
+        if (i >= s.size()) return false;
+        out = Value::character(static_cast<unsigned char>(s[i]));
+        return true;
+    }
+    auto* list = static_cast<const ListObject*>(seq.object());
+    if (i >= list->size()) return false;
+    if (list->range)
+        out = Value(list->range->at(i));
+    else
+        out = list->items()[i];
+    return true;
+}
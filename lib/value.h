@@ -1,86 +1,165 @@
 #pragma once
 #include <algorithm>
+#include <bit>
 #include <cmath>
+#include <cstdint>
+#include <cstring>
 #include <functional>
 #include <memory>
 #include <optional>
+#include <span>
 #include <sstream>
 #include <stdexcept>
 #include <string>
-#include <variant>
+#include <string_view>
 #include <vector>
 
-extern std::vector<std::string> g_callStack;
+// Имена вызванных функций; указывают на имена в AST или в скомпилированной программе
+extern std::vector<const std::string*> g_callStack;
 
 class FunctionAST;
-class Environment;
 class Value;
+class GlobalTable;
+struct Frame;
+struct Closure;
+struct UpvalueCell;
 
-template <class... Ts>
-struct overloaded : Ts... {
-    using Ts::operator()...;
-};
+using UpvalueList = std::vector<std::shared_ptr<UpvalueCell>>;
 
-template <class... Ts>
-overloaded(Ts...) -> overloaded<Ts...>;
+// Нативная функция. Аргументы — окно стека вызывающего: функция может менять
+// и забирать их значения, но не должна хранить само окно
+using NativeFn = Value (*)(std::span<Value> args);
 
 struct FunctionValue {
-    using BuiltinFn = std::function<Value(std::vector<Value>)>;
-
     bool isBuiltin;
-    BuiltinFn builtinFn;
+    NativeFn native;
     const FunctionAST* fnAST;
-    std::shared_ptr<Environment> closure;
+    std::shared_ptr<UpvalueList> upvalues;
+    GlobalTable* globals;
+    std::shared_ptr<Closure> compiled;  // функция, скомпилированная в байткод
+
+    FunctionValue(NativeFn fn) : isBuiltin(true), native(fn), fnAST(nullptr), globals(nullptr) {}
+
+    FunctionValue(const FunctionAST* f, std::shared_ptr<UpvalueList> up, GlobalTable* g)
+        : isBuiltin(false), native(nullptr), fnAST(f), upvalues(std::move(up)), globals(g) {}
+
+    FunctionValue(std::shared_ptr<Closure> c)
+        : isBuiltin(false), native(nullptr), fnAST(nullptr), globals(nullptr), compiled(std::move(c)) {}
+
+    // Аргументы перемещаются в кадр вызываемой функции
+    Value invoke(std::span<Value> args) const;
 
-    FunctionValue(BuiltinFn fn)
-        : isBuiltin(true), builtinFn(std::move(fn)), fnAST(nullptr), closure(nullptr) {}
+    // Исполняет тело функции из AST в кадре, первые слоты которого уже заняты аргументами
+    Value run(Frame& frame) const;
+};
+
+// Объект в куче, на который ссылается Value. Счётчиком ссылок управляет Value
+struct HeapObject {
+    enum class Type : uint8_t { String, List, Function };
+
+    explicit HeapObject(Type t) : type(t) {}
+    virtual ~HeapObject() = default;
 
-    FunctionValue(const FunctionAST* f, std::shared_ptr<Environment> env)
-        : isBuiltin(false), builtinFn(), fnAST(f), closure(std::move(env)) {}
+    uint32_t refCount = 0;
+    Type type;
+};
+
+// Список или функция: объекты, которые могут ссылаться друг на друга по кругу.
+// Они регистрируются в Heap текущего потока, чтобы сборщик мог найти циклы
+struct TrackedObject : HeapObject {
+    explicit TrackedObject(Type t);
+    ~TrackedObject() override;
 
-    Value invoke(const std::vector<Value>& args) const;
+    TrackedObject* gcPrev = nullptr;
+    TrackedObject* gcNext = nullptr;
 };
 
+// Значение занимает 8 байт (NaN-boxing): числа хранятся как есть, а nil, bool
+// и указатели на HeapObject — в полезной нагрузке отрицательного quiet NaN.
+// Настоящие NaN приводятся к каноническому положительному.
 class Value {
    public:
     using RawList = std::vector<Value>;
-    using ListPtr = std::shared_ptr<RawList>;
-    using Variant = std::variant<std::monostate, double, bool, std::string, ListPtr, FunctionValue>;
 
-    static int normalizeIndex(int idx, int n) {
+    static int64_t normalizeIndex(int64_t idx, int64_t n) {
         if (idx < 0) idx += n;
         if (idx < 0 || idx >= n) throw std::runtime_error("Index " + std::to_string(idx) + " out of range [0," + std::to_string(n) + ")");
         return idx;
     }
 
-    Value() : v(std::monostate{}) {}
-    Value(double d) : v(d) {}
-    Value(bool b) : v(b) {}
-    Value(const std::string& s) : v(s) {}
-    Value(std::string&& s) : v(std::move(s)) {}
-    Value(RawList xs) : v(std::make_shared<RawList>(std::move(xs))) {}
-    Value(FunctionValue f) : v(std::move(f)) {}
+    Value() : bits_(kNil) {}
+    Value(double d) : bits_(std::isnan(d) ? kCanonicalNaN : std::bit_cast<uint64_t>(d)) {}
+    Value(bool b) : bits_(b ? kTrue : kFalse) {}
+    Value(std::string_view s);
+    Value(const std::string& s) : Value(std::string_view(s)) {}
+    Value(RawList xs);
+    Value(FunctionValue f);
 
-    bool isNil() const { return std::holds_alternative<std::monostate>(v); }
-    bool isNumber() const { return std::holds_alternative<double>(v); }
-    bool isBool() const { return std::holds_alternative<bool>(v); }
-    bool isString() const { return std::holds_alternative<std::string>(v); }
-    bool isList() const { return std::holds_alternative<ListPtr>(v); }
-    bool isFunc() const { return std::holds_alternative<FunctionValue>(v); }
+    Value(const Value& other) : bits_(other.bits_) { retain(); }
+    Value(Value&& other) noexcept : bits_(other.bits_) { other.bits_ = kNil; }
+    Value& operator=(const Value& other) {
+        other.retain();
+        release();
+        bits_ = other.bits_;
+        return *this;
+    }
+    Value& operator=(Value&& other) noexcept {
+        if (this != &other) {
+            release();
+            bits_ = other.bits_;
+            other.bits_ = kNil;
+        }
+        return *this;
+    }
+    ~Value() { release(); }
+
+    // Тип значения одним числом: по паре типов операнды выбирают обработчик
+    // оператора из таблицы (value.cpp)
+    enum class Kind : uint8_t { Number, Bool, Nil, String, List, Function };
+    static constexpr int kKinds = 6;
+
+    Kind kind() const {
+        if (isNumber()) return Kind::Number;
+        if (isObject()) return static_cast<Kind>(static_cast<uint8_t>(Kind::String) + static_cast<uint8_t>(object()->type));
+        return bits_ == kNil ? Kind::Nil : Kind::Bool;
+    }
+
+    bool isNil() const { return bits_ == kNil; }
+    bool isNumber() const { return bits_ < kNil; }
+    bool isBool() const { return (bits_ | 1) == kTrue; }
+    bool isString() const { return isObject(HeapObject::Type::String); }
+    bool isList() const { return isObject(HeapObject::Type::List); }
+    bool isFunc() const { return isObject(HeapObject::Type::Function); }
 
-    double asNumber() const { return std::get<double>(v); }
+    double asNumber() const {
+        if (!isNumber()) throw std::runtime_error("Expected a number but got '" + typeName() + "'");
+        return std::bit_cast<double>(bits_);
+    }
     bool asBool() const {
-        if (isBool()) return std::get<bool>(v);
-        if (isNumber()) return std::get<double>(v) != 0.0;
-        if (isString()) return !std::get<std::string>(v).empty();
-        if (isList()) return !asList().empty();
+        if (isBool()) return bits_ == kTrue;
+        if (isNumber()) return asNumber() != 0.0;
+        if (isString()) return !asString().empty();
+        if (isList()) return listSize() != 0;
         return false;
     }
-    const std::string& asString() const { return std::get<std::string>(v); }
-    std::string& asString() { return std::get<std::string>(v); }
+    std::string_view asString() const;
 
-    RawList& asList() { return *std::get<ListPtr>(v); }
-    const RawList& asList() const { return *std::get<ListPtr>(v); }
+    // Однобуквенные строки не выделяют память: они берутся из общей таблицы
+    static Value character(unsigned char c);
+
+    // Элементы списка. Изменять список можно только через mutableList:
+    // он отделяет список от буфера, разделяемого с другими списками
+    std::span<const Value> asList() const;
+    RawList& mutableList();
+    // Число элементов списка; range при этом не строит свои элементы
+    size_t listSize() const;
+
+    // Список чисел от start до stop (не включая) с шагом step
+    static Value range(double start, double stop, double step);
+
+    // Оператор needle in hay: значение входит в список hay или строка — в строку hay.
+    // Справа от in должен стоять список или строка. Для range элементы не перебираются
+    static bool contains(const Value& needle, const Value& hay);
 
     static double asNumeric(const Value& v) {
         if (v.isNumber()) return v.asNumber();
@@ -88,7 +167,7 @@ class Value {
         throw std::runtime_error("Expected a number or bool but got '" + v.typeName() + "'");
     }
 
-    FunctionValue asFunc() const { return std::get<FunctionValue>(v); }
+    const FunctionValue& asFunc() const;
 
     std::string toString() const;
     std::string typeName() const;
@@ -111,9 +190,245 @@ class Value {
     friend Value operator||(const Value& a, const Value& b);
     friend Value operator!(const Value& a);
 
-    Value atIndex(int idx) const;
+    Value atIndex(int64_t idx) const;
+    // atIndex для значения, которое заведомо список
+    Value listAt(int64_t idx) const;
     Value slice(std::optional<int> begin, std::optional<int> end) const;
 
+    // Неизменяемый снимок списка за O(1): элементы копируются, только если
+    // исходный список изменят, пока снимок жив. Остальные значения возвращаются как есть
+    Value snapshot() const;
+
+   private:
+    friend class SequenceIterator;
+    friend class Heap;
+    friend struct ValueAccess;
+
+    static constexpr uint64_t kCanonicalNaN = 0x7FF8'0000'0000'0000;
+    static constexpr uint64_t kNil = 0xFFF9'0000'0000'0000;
+    static constexpr uint64_t kFalse = 0xFFFA'0000'0000'0000;
+    static constexpr uint64_t kTrue = 0xFFFA'0000'0000'0001;
+    static constexpr uint64_t kObject = 0xFFFC'0000'0000'0000;
+    static constexpr uint64_t kTagMask = 0xFFFF'0000'0000'0000;
+    static constexpr uint64_t kPointerMask = 0x0000'FFFF'FFFF'FFFF;
+
+    explicit Value(HeapObject* obj) : bits_(kObject | reinterpret_cast<uint64_t>(obj)) { ++obj->refCount; }
+
+    bool isObject() const { return (bits_ & kTagMask) == kObject; }
+    bool isObject(HeapObject::Type t) const { return isObject() && object()->type == t; }
+    HeapObject* object() const { return reinterpret_cast<HeapObject*>(bits_ & kPointerMask); }
+
+    void retain() const {
+        if (isObject()) ++object()->refCount;
+    }
+    void release() {
+        if (isObject() && --object()->refCount == 0) delete object();
+    }
+
+    uint64_t bits_;
+};
+
+static_assert(sizeof(Value) == 8, "Value must stay NaN-boxed");
+
+// Неизменяемая строка. Символы лежат в одном блоке памяти с заголовком,
+// хэш вычисляется при первом обращении и запоминается. Срез длинной строки
+// не копирует символы, а ссылается на исходную строку
+struct StringObject : HeapObject {
+    // Срезы короче этого копируются, чтобы не удерживать в памяти большие строки
+    static constexpr size_t kMinView = 32;
+
+    size_t length;
+    const char* chars;
+    StringObject* base = nullptr;  // строка, которой принадлежат символы среза
+    mutable size_t hashValue = 0;
+    mutable bool hashed = false;
+
+    // Выделяет строку длины length, символы заполняет вызывающий
+    static StringObject* allocate(size_t length) {
+        void* mem = ::operator new(sizeof(StringObject) + length);
+        auto* str = new (mem) StringObject(length);
+        str->chars = str->data();
+        return str;
+    }
+
+    static StringObject* create(std::string_view s) {
+        StringObject* str = allocate(s.size());
+        std::memcpy(str->data(), s.data(), s.size());
+        return str;
+    }
+
+    static StringObject* slice(const StringObject* of, size_t offset, size_t length) {
+        if (length < kMinView) return create(of->view().substr(offset, length));
+        StringObject* owner = of->base ? of->base : const_cast<StringObject*>(of);
+        auto* str = new (::operator new(sizeof(StringObject))) StringObject(length);
+        str->chars = of->chars + offset;
+        str->base = owner;
+        ++owner->refCount;
+        return str;
+    }
+
+    ~StringObject() override {
+        if (base && --base->refCount == 0) delete base;
+    }
+
+    static void operator delete(void* p) { ::operator delete(p); }
+
+    // Буфер символов, доступен только у строк, созданных через allocate
+    char* data() { return reinterpret_cast<char*>(this + 1); }
+    std::string_view view() const { return {chars, length}; }
+
+    size_t hash() const {
+        if (!hashed) {
+            hashValue = std::hash<std::string_view>{}(view());
+            hashed = true;
+        }
+        return hashValue;
+    }
+
+   private:
+    explicit StringObject(size_t n) : HeapObject(Type::String), length(n), chars(nullptr) {}
+};
+
+// Элементы списка. Буфер могут разделять несколько списков (срезы и снимки),
+// поэтому перед изменением список получает собственную копию
+struct ListBuffer {
+    uint32_t refCount = 1;
+    Value::RawList items;
+};
+
+// Арифметическая прогрессия с целыми началом и шагом: элемент вычисляется по номеру
+struct RangeSpec {
+    double start;
+    double step;
+    size_t count;
+
+    double at(size_t i) const { return start + static_cast<double>(i) * step; }
+    bool contains(double x) const {
+        double i = (x - start) / step;
+        return i >= 0 && i < static_cast<double>(count) && std::floor(i) == i;
+    }
+};
+
+struct ListObject : TrackedObject {
+    mutable ListBuffer* buffer = nullptr;  // у range строится при первом обращении к элементам
+    size_t offset = 0;
+    size_t length = 0;
+    bool whole = true;  // список занимает буфер целиком, offset и length не используются
+    std::optional<RangeSpec> range;  // список совпадает с этим range, пока его не изменили
+
+    explicit ListObject(Value::RawList xs) : TrackedObject(Type::List), buffer(new ListBuffer{1, std::move(xs)}) {}
+    explicit ListObject(RangeSpec r) : TrackedObject(Type::List), range(r) {}
+
+    // Окно [offset, offset + length) чужого буфера
+    ListObject(ListBuffer* b, size_t off, size_t len)
+        : TrackedObject(Type::List), buffer(b), offset(off), length(len), whole(false) {
+        ++buffer->refCount;
+    }
+
+    ~ListObject() override {
+        if (buffer) releaseBuffer();
+    }
+
+    size_t size() const {
+        if (!buffer) return range->count;
+        return whole ? buffer->items.size() : length;
+    }
+
+    std::span<const Value> items() const {
+        if (!buffer) materialize();
+        if (whole) return buffer->items;
+        return {buffer->items.data() + offset, length};
+    }
+
+    // Новый список, разделяющий с этим элементы [from, from + count)
+    ListObject* window(size_t from, size_t count) const {
+        if (!buffer) materialize();
+        return new ListObject(buffer, (whole ? 0 : offset) + from, count);
+    }
+
+    Value::RawList& mutableItems() {
+        if (!buffer) materialize();
+        range.reset();
+        if (!whole || buffer->refCount > 1) {
+            auto xs = items();
+            auto* own = new ListBuffer{1, Value::RawList(xs.begin(), xs.end())};
+            releaseBuffer();
+            buffer = own;
+            whole = true;
+        }
+        return buffer->items;
+    }
+
+   private:
+    void materialize() const {
+        Value::RawList xs;
+        xs.reserve(range->count);
+        for (size_t i = 0; i < range->count; ++i) xs.emplace_back(range->at(i));
+        buffer = new ListBuffer{1, std::move(xs)};
+    }
+
+    void releaseBuffer() {
+        if (--buffer->refCount == 0) delete buffer;
+    }
+};
+
+struct FunctionObject : TrackedObject {
+    FunctionValue fn;
+    explicit FunctionObject(FunctionValue f) : TrackedObject(Type::Function), fn(std::move(f)) {}
+};
+
+inline Value::Value(std::string_view s) : Value(static_cast<HeapObject*>(StringObject::create(s))) {}
+inline Value::Value(RawList xs) : Value(static_cast<HeapObject*>(new ListObject(std::move(xs)))) {}
+inline Value::Value(FunctionValue f) : Value(static_cast<HeapObject*>(new FunctionObject(std::move(f)))) {}
+
+inline std::string_view Value::asString() const {
+    if (!isString()) throw std::runtime_error("Expected a string but got '" + typeName() + "'");
+    return static_cast<const StringObject*>(object())->view();
+}
+
+inline std::span<const Value> Value::asList() const {
+    if (!isList()) throw std::runtime_error("Expected a list but got '" + typeName() + "'");
+    return static_cast<const ListObject*>(object())->items();
+}
+
+inline Value::RawList& Value::mutableList() {
+    if (!isList()) throw std::runtime_error("Expected a list but got '" + typeName() + "'");
+    return static_cast<ListObject*>(object())->mutableItems();
+}
+
+inline size_t Value::listSize() const {
+    if (!isList()) throw std::runtime_error("Expected a list but got '" + typeName() + "'");
+    return static_cast<const ListObject*>(object())->size();
+}
+
+inline Value Value::listAt(int64_t idx) const {
+    auto* list = static_cast<const ListObject*>(object());
+    int64_t i = normalizeIndex(idx, (int64_t)list->size());
+    if (list->range) return Value(list->range->at(i));
+    return list->items()[i];
+}
+
+inline const FunctionValue& Value::asFunc() const {
+    if (!isFunc()) throw std::runtime_error("Expected a function but got '" + typeName() + "'");
+    return static_cast<const FunctionObject*>(object())->fn;
+}
+
+// Обход последовательности в цикле for: список (по снимку), строка (по символам)
+// или range (без построения элементов). Состояние обхода — подготовленная
+// последовательность и номер следующего элемента, поэтому VM хранит его в регистрах
+class SequenceIterator {
+   public:
+    explicit SequenceIterator(const Value& seq) : seq_(prepare(seq)) {}
+
+    bool next(Value& out) { return at(seq_, index_++, out); }
+
+    // Снимок последовательности, который не меняется при изменении исходного списка
+    static Value prepare(const Value& seq);
+
+    // Элемент подготовленной последовательности с номером i; false, если элементы кончились
+    static bool at(const Value& seq, size_t i, Value& out);
+
    private:
-    Variant v;
+    Value seq_;
+    size_t index_ = 0;
 };
@@ -0,0 +1,436 @@
+#include "vm.h"
+
+#include <cmath>
+#include <stdexcept>
+
+#include "compiler.h"
+
+#if defined(__GNUC__)
+#define ISCRIPT_COMPUTED_GOTO 1
+#endif
+
+static thread_local VM* t_activeVM = nullptr;
+
+VM::VM(const Program& program)
+    : program_(program),
+      ownGlobals_(std::make_unique<GlobalTable>(program.globals)),
+      globals_(*ownGlobals_),
+      previous_(t_activeVM) {
+    bindDefinitions();
+    t_activeVM = this;
+}
+
+VM::VM(const Program& program, GlobalTable& globals)
+    : program_(program), globals_(globals), previous_(t_activeVM) {
+    bindDefinitions();
+    t_activeVM = this;
+}
+
+// Именованные функции перекрывают одноимённые builtin-ы
+void VM::bindDefinitions() {
+    for (auto& [idx, proto] : program_.definitions) globals_.set(idx, proto->sharedClosure);
+}
+
+VM::~VM() {
+    t_activeVM = previous_;
+}
+
+VM* VM::active() {
+    return t_activeVM;
+}
+
+void VM::run() {
+    for (auto& proto : program_.topLevel) {
+        Closure chunk{proto.get(), {}};
+        size_t callDepth = g_callStack.size();
+        try {
+            pushFrame(&chunk, stackTop() + 1, 0, false);
+            execute(0);
+        } catch (...) {
+            frames_.clear();
+            g_callStack.resize(callDepth);
+            throw;
+        }
+    }
+}
+
+Value VM::call(const FunctionValue& fn, std::span<Value> args) {
+    size_t depth = frames_.size();
+    size_t callDepth = g_callStack.size();
+    size_t base = stackTop() + 1;
+    ensureStack(base + args.size());
+    for (size_t i = 0; i < args.size(); ++i) stack_[base + i] = std::move(args[i]);
+    try {
+        pushFrame(fn.compiled.get(), base, args.size(), true);
+        return execute(depth);
+    } catch (...) {
+        frames_.resize(depth);
+        g_callStack.resize(callDepth);
+        throw;
+    }
+}
+
+size_t VM::stackTop() const {
+    if (frames_.empty()) return 0;
+    const CallFrame& f = frames_.back();
+    return f.base + f.proto->numRegs;
+}
+
+void VM::ensureStack(size_t size) {
+    if (stack_.size() < size) stack_.resize(std::max(size, stack_.size() * 2));
+}
+
+void VM::pushFrame(const Closure* closure, size_t base, size_t argc, bool tracked) {
+    const Proto* proto = closure->proto;
+    // Отложенное тело компилируется при первом вызове. Программа при этом
+    // меняется только так: код, которого ещё не было, никто не исполняет
+    if (proto->lazy) [[unlikely]]
+        Compiler::compileLazy(const_cast<Proto&>(*proto), program_.globals);
+    if (argc != proto->numParams) {
+        throw std::runtime_error(
+            "Function '" + proto->name +
+            "' expects " + std::to_string(proto->numParams) +
+            " arguments, got " + std::to_string(argc));
+    }
+    if (frames_.size() >= kMaxFrames) throw std::runtime_error("Stack overflow");
+    ensureStack(base + proto->numRegs);
+    for (size_t i = base + argc; i < base + proto->numRegs; ++i) stack_[i] = Value();
+    if (tracked) g_callStack.push_back(&proto->name);
+    frames_.push_back(CallFrame{proto, closure, proto->code.data(), base, tracked});
+}
+
+// Сравнения повторяют value.cpp: '<=' — это (a < b) || (a == b), '>' — !(a <= b), '>=' — !(a < b)
+static inline bool lessThan(const Value& a, const Value& b) {
+    if (a.isNumber() && b.isNumber()) return a.asNumber() < b.asNumber();
+    return a < b;
+}
+
+static inline bool lessEqual(const Value& a, const Value& b) {
+    if (a.isNumber() && b.isNumber()) return a.asNumber() <= b.asNumber();
+    return a <= b;
+}
+
+static inline bool equal(const Value& a, const Value& b) {
+    if (a.isNumber() && b.isNumber()) return a.asNumber() == b.asNumber();
+    return a == b;
+}
+
+Value VM::execute(size_t stopDepth) {
+    CallFrame* frame;
+    const Instruction* code;
+    const Instruction* pc;
+    const Value* K;
+    Value* R;
+    Instruction ins;
+
+    auto reload = [&] {
+        frame = &frames_.back();
+        code = frame->proto->code.data();
+        pc = frame->pc;
+        K = frame->proto->constants.data();
+        R = stack_.data() + frame->base;
+    };
+    reload();
+
+#define RKB ((ins.flags & Instruction::kBConst) ? K[ins.b] : R[ins.b])
+#define RKC ((ins.flags & Instruction::kCConst) ? K[ins.c] : R[ins.c])
+#define NUMERIC_OP(expr, slow)                          \
+    {                                                   \
+        const Value& a = RKB;                           \
+        const Value& b = RKC;                           \
+        if (a.isNumber() && b.isNumber()) {             \
+            double x = a.asNumber(), y = b.asNumber();  \
+            R[ins.a] = Value(expr);                     \
+        } else {                                        \
+            R[ins.a] = slow;                            \
+        }                                               \
+    }
+#define COND_JUMP(cond)                     \
+    {                                       \
+        const Value& a = RKB;               \
+        const Value& b = RKC;               \
+        if (!(cond))                        \
+            pc = code + pc->bx();           \
+        else                                \
+            ++pc;                           \
+    }
+
+#ifdef ISCRIPT_COMPUTED_GOTO
+    static void* const kDispatch[] = {
+#define ISCRIPT_OPCODE_LABEL(name) &&op_##name,
+        ISCRIPT_OPCODES(ISCRIPT_OPCODE_LABEL)
+#undef ISCRIPT_OPCODE_LABEL
+    };
+    // Переход по computed goto не вызывает деструкторы локальных переменных
+    // обработчика: переменные с деструктором живут во вложенном блоке
+#define CASE(name) op_##name:
+#define DISPATCH()                                          \
+    do {                                                    \
+        ins = *pc++;                                        \
+        goto *kDispatch[static_cast<uint8_t>(ins.op)];      \
+    } while (0)
+    DISPATCH();
+#else
+#define CASE(name) case OpCode::name:
+#define DISPATCH() continue
+    for (;;) {
+        ins = *pc++;
+        switch (ins.op) {
+#endif
+
+    CASE(LoadNil) {
+        R[ins.a] = Value();
+        DISPATCH();
+    }
+    CASE(LoadBool) {
+        R[ins.a] = Value(ins.b != 0);
+        DISPATCH();
+    }
+    CASE(LoadK) {
+        R[ins.a] = K[ins.bx()];
+        DISPATCH();
+    }
+    CASE(Move) {
+        R[ins.a] = R[ins.b];
+        DISPATCH();
+    }
+    CASE(GetGlobal) {
+        R[ins.a] = globals_.get(ins.bx());
+        DISPATCH();
+    }
+    CASE(SetGlobal) {
+        globals_.set(ins.bx(), R[ins.a]);
+        DISPATCH();
+    }
+    CASE(GetUpval) {
+        R[ins.a] = frame->closure->upvalues[ins.b]->get();
+        DISPATCH();
+    }
+    CASE(SetUpval) {
+        frame->closure->upvalues[ins.b]->set(R[ins.a]);
+        DISPATCH();
+    }
+    CASE(Add) {
+        NUMERIC_OP(x + y, a + b);
+        DISPATCH();
+    }
+    CASE(Sub) {
+        NUMERIC_OP(x - y, a - b);
+        DISPATCH();
+    }
+    CASE(Mul) {
+        NUMERIC_OP(x * y, a * b);
+        DISPATCH();
+    }
+    CASE(Div) {
+        R[ins.a] = RKB / RKC;
+        DISPATCH();
+    }
+    CASE(Mod) {
+        R[ins.a] = RKB % RKC;
+        DISPATCH();
+    }
+    CASE(FMod) {
+        R[ins.a] = Value(std::fmod(Value::asNumeric(RKB), Value::asNumeric(RKC)));
+        DISPATCH();
+    }
+    CASE(Pow) {
+        NUMERIC_OP(std::pow(x, y), a ^ b);
+        DISPATCH();
+    }
+    CASE(Eq) {
+        R[ins.a] = Value(equal(RKB, RKC));
+        DISPATCH();
+    }
+    CASE(Ne) {
+        R[ins.a] = Value(!equal(RKB, RKC));
+        DISPATCH();
+    }
+    CASE(Lt) {
+        R[ins.a] = Value(lessThan(RKB, RKC));
+        DISPATCH();
+    }
+    CASE(Le) {
+        R[ins.a] = Value(lessEqual(RKB, RKC));
+        DISPATCH();
+    }
+    CASE(Gt) {
+        R[ins.a] = Value(!lessEqual(RKB, RKC));
+        DISPATCH();
+    }
+    CASE(Ge) {
+        R[ins.a] = Value(!lessThan(RKB, RKC));
+        DISPATCH();
+    }
+    CASE(And) {
+        R[ins.a] = RKB && RKC;
+        DISPATCH();
+    }
+    CASE(Or) {
+        R[ins.a] = RKB || RKC;
+        DISPATCH();
+    }
+    CASE(Neg) {
+        const Value& v = R[ins.b];
+        R[ins.a] = v.isNumber() ? Value(0.0 - v.asNumber()) : Value(0.0) - v;
+        DISPATCH();
+    }
+    CASE(Not) {
+        R[ins.a] = Value(!R[ins.b].asBool());
+        DISPATCH();
+    }
+    CASE(NewList) {
+        R[ins.a] = Value(Value::RawList(R + ins.b, R + ins.b + ins.c));
+        DISPATCH();
+    }
+    CASE(Index) {
+        R[ins.a] = R[ins.b].atIndex(static_cast<int64_t>(RKC.asNumber()));
+        DISPATCH();
+    }
+    CASE(Slice) {
+        std::optional<int> b, e;
+        if (!(ins.flags & Instruction::kNoStart)) b = static_cast<int>(R[ins.c].asNumber());
+        if (!(ins.flags & Instruction::kNoEnd)) e = static_cast<int>(R[ins.c + 1].asNumber());
+        R[ins.a] = R[ins.b].slice(b, e);
+        DISPATCH();
+    }
+    CASE(In) {
+        R[ins.a] = Value(Value::contains(R[ins.b], R[ins.c]));
+        DISPATCH();
+    }
+    CASE(Closure) {
+        const Proto* proto = frame->proto->children[ins.bx()].get();
+        if (proto->upvalues.empty()) {
+            R[ins.a] = proto->sharedClosure;
+            DISPATCH();
+        }
+        {
+            auto closure = std::make_shared<Closure>(Closure{proto, {}});
+            closure->upvalues.reserve(proto->upvalues.size());
+            for (const auto& up : proto->upvalues) {
+                if (up.source == UpvalueSource::ParentLocal)
+                    closure->upvalues.push_back(std::make_shared<UpvalueCell>(UpvalueCell{R[up.index]}));
+                else if (up.source == UpvalueSource::ParentUpvalue)
+                    closure->upvalues.push_back(frame->closure->upvalues[up.index]);
+                else
+                    closure->upvalues.push_back(captureOwnUpvalue(globals_, up));
+            }
+            Value fn{FunctionValue(closure)};
+            // Функция, присваиваемая локальной переменной или своему глобалу, видит в ней саму себя
+            for (size_t i = 0; i < proto->upvalues.size(); ++i) {
+                const auto& up = proto->upvalues[i];
+                if (up.source == UpvalueSource::ParentLocal && up.index == ins.a) closure->upvalues[i]->value = fn;
+            }
+            fillSelf(proto->upvalues, closure->upvalues, fn);
+            R[ins.a] = std::move(fn);
+        }
+        DISPATCH();
+    }
+    CASE(Call) {
+        Value& callee = R[ins.a];
+        if (!callee.isFunc()) throw std::runtime_error("Attempt to call a non-function value");
+        const FunctionValue& fn = callee.asFunc();
+        if (fn.compiled) {
+            frame->pc = pc;
+            pushFrame(fn.compiled.get(), frame->base + ins.a + 1, ins.b, true);
+            reload();
+        } else {
+            // Аргументы — временные регистры; они переезжают в FrameArena, потому
+            // что стек VM переместится, если builtin снова войдёт в VM
+            ArgWindow args(ins.b);
+            std::move(R + ins.a + 1, R + ins.a + 1 + ins.b, args.data());
+            frame->pc = pc;
+            Value result = fn.invoke(args.span());
+            // Builtin мог повторно войти в VM и увеличить стек
+            reload();
+            R[ins.a] = std::move(result);
+        }
+        DISPATCH();
+    }
+    CASE(Return) {
+        CallFrame done = frames_.back();
+        frames_.pop_back();
+        if (done.tracked) g_callStack.pop_back();
+        stack_[done.base - 1] = R[ins.a];
+        if (frames_.size() == stopDepth) return stack_[done.base - 1];
+        reload();
+        DISPATCH();
+    }
+    CASE(ReturnNil) {
+        CallFrame done = frames_.back();
+        frames_.pop_back();
+        if (done.tracked) g_callStack.pop_back();
+        stack_[done.base - 1] = Value();
+        if (frames_.size() == stopDepth) return Value();
+        reload();
+        DISPATCH();
+    }
+    CASE(Jmp) {
+        pc = code + ins.bx();
+        DISPATCH();
+    }
+    CASE(JmpIfFalse) {
+        if (!R[ins.a].asBool()) pc = code + ins.bx();
+        DISPATCH();
+    }
+    CASE(JmpIfTrue) {
+        if (R[ins.a].asBool()) pc = code + ins.bx();
+        DISPATCH();
+    }
+    CASE(JmpIfNotEq) {
+        COND_JUMP(equal(a, b));
+        DISPATCH();
+    }
+    CASE(JmpIfNotNe) {
+        COND_JUMP(!equal(a, b));
+        DISPATCH();
+    }
+    CASE(JmpIfNotLt) {
+        COND_JUMP(lessThan(a, b));
+        DISPATCH();
+    }
+    CASE(JmpIfNotLe) {
+        COND_JUMP(lessEqual(a, b));
+        DISPATCH();
+    }
+    CASE(JmpIfNotGt) {
+        COND_JUMP(!lessEqual(a, b));
+        DISPATCH();
+    }
+    CASE(JmpIfNotGe) {
+        COND_JUMP(!lessThan(a, b));
+        DISPATCH();
+    }
+    CASE(ForPrep) {
+        R[ins.a] = SequenceIterator::prepare(R[ins.a]);
+        R[ins.a + 1] = Value(0.0);
+        DISPATCH();
+    }
+    CASE(ForLoop) {
+        size_t i = static_cast<size_t>(R[ins.a + 1].asNumber());
+        if (SequenceIterator::at(R[ins.a], i, R[ins.b])) {
+            R[ins.a + 1] = Value(static_cast<double>(i + 1));
+            pc = code + pc->bx();
+        } else {
+            // Снимок больше не нужен: иначе следующий push в список скопирует его
+            R[ins.a] = Value();
+            ++pc;
+        }
+        DISPATCH();
+    }
+    CASE(Raise) {
+        throw std::runtime_error(std::string(K[ins.bx()].asString()));
+    }
+
+#ifndef ISCRIPT_COMPUTED_GOTO
+        }
+    }
+#endif
+
+#undef RKB
+#undef RKC
+#undef NUMERIC_OP
+#undef COND_JUMP
+#undef CASE
+#undef DISPATCH
+}
@@ -0,0 +1,57 @@
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <span>
+#include <vector>
+
+#include "bytecode.h"
+#include "scope.h"
+#include "value.h"
+
+// Исполняет скомпилированную программу. Регистры всех кадров лежат в общем стеке:
+// вызываемая функция получает окно, начинающееся сразу за регистром с её значением.
+class VM {
+   public:
+    // Свежие глобалы: builtin-ы и функции программы
+    explicit VM(const Program& program);
+    // Глобалы принадлежат вызывающему и сохраняют значения между запусками.
+    // Таблица должна быть создана по program.globals
+    VM(const Program& program, GlobalTable& globals);
+    ~VM();
+
+    VM(const VM&) = delete;
+    VM& operator=(const VM&) = delete;
+
+    // Исполняет топ-левел выражения программы по порядку
+    void run();
+
+    // Вызов скомпилированной функции из нативного кода (например, из builtin-а)
+    Value call(const FunctionValue& fn, std::span<Value> args);
+
+    // VM, исполняющая программу в текущем потоке
+    static VM* active();
+
+   private:
+    struct CallFrame {
+        const Proto* proto;
+        const Closure* closure;
+        const Instruction* pc;
+        size_t base;
+        bool tracked;  // кадр учтён в g_callStack
+    };
+
+    static constexpr size_t kMaxFrames = 200000;
+
+    void bindDefinitions();
+    Value execute(size_t stopDepth);
+    void pushFrame(const Closure* closure, size_t base, size_t argc, bool tracked);
+    size_t stackTop() const;
+    void ensureStack(size_t size);
+
+    const Program& program_;
+    std::unique_ptr<GlobalTable> ownGlobals_;
+    GlobalTable& globals_;
+    std::vector<Value> stack_;
+    std::vector<CallFrame> frames_;
+    VM* previous_;
+};
@@ -0,0 +1,88 @@
+#include <gtest/gtest.h>
+#include <lib/bind.h>
+#include <lib/interpreter.h>
+
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+namespace {
+
+double hypot2(double x, double y) {
+    return x * x + y * y;
+}
+
+std::string repeat(std::string_view s, int n) {
+    std::string out;
+    for (int i = 0; i < n; ++i) out += s;
+    return out;
+}
+
+size_t count(std::span<const Value> list) {
+    return list.size();
+}
+
+int calls = 0;
+void touch() {
+    ++calls;
+}
+
+std::string describe(const Value& v) {
+    return v.isNil() ? "nil" : v.toString();
+}
+
+Value call(NativeFn fn, std::span<Value> args) {
+    return fn(args);
+}
+
+std::string errorOf(NativeFn fn, std::span<Value> args) {
+    try {
+        fn(args);
+    } catch (const std::runtime_error& e) {
+        return e.what();
+    }
+    return "";
+}
+
+}  // namespace
+
+TEST(BindTestSuite, ConvertsArgumentsAndResult) {
+    Value args[] = {Value(3.0), Value(true)};
+    EXPECT_EQ(call(bindNative<"hypot2", hypot2>(), args).asNumber(), 10.0);
+
+    Value rep[] = {Value(std::string_view("ab")), Value(3.0)};
+    EXPECT_EQ(call(bindNative<"repeat", repeat>(), rep).asString(), "ababab");
+
+    Value list[] = {Value(Value::RawList{Value(1.0), Value(2.0)})};
+    EXPECT_EQ(call(bindNative<"count", count>(), list).asNumber(), 2.0);
+
+    Value nil[] = {Value()};
+    EXPECT_EQ(call(bindNative<"describe", describe>(), nil).asString(), "nil");
+}
+
+TEST(BindTestSuite, VoidReturnsNil) {
+    calls = 0;
+    EXPECT_TRUE(call(bindNative<"touch", touch>(), {}).isNil());
+    EXPECT_EQ(calls, 1);
+}
+
+TEST(BindTestSuite, OverloadedFunctionBySignature) {
+    Value args[] = {Value(2.0), Value(10.0)};
+    EXPECT_EQ(call(bindNative<"pow", double(double, double), std::pow>(), args).asNumber(), 1024.0);
+}
+
+TEST(BindTestSuite, ArityAndTypeErrors) {
+    Value one[] = {Value(1.0)};
+    EXPECT_EQ(errorOf(bindNative<"hypot2", hypot2>(), one), "hypot2: expected 2 arguments, got 1");
+    EXPECT_EQ(errorOf(bindNative<"touch", touch>(), one), "touch: expected 0 arguments, got 1");
+
+    Value str[] = {Value(std::string_view("x")), Value(1.0)};
+    EXPECT_FALSE(errorOf(bindNative<"hypot2", hypot2>(), str).empty());
+}
+
+TEST(BindTestSuite, BoundBuiltinsCheckArity) {
+    std::istringstream input("print(sqrt(16)) print(upper(\"ab\")) sqrt(1, 2)");
+    std::ostringstream output;
+    EXPECT_FALSE(interpret(input, output));
+    EXPECT_EQ(output.str(), "4ABError: sqrt: expected 1 argument, got 2");
+}
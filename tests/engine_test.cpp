@@ -0,0 +1,68 @@
+#include "lib/engine.h"
+
+#include <gtest/gtest.h>
+
+#include <sstream>
+
+TEST(EngineTestSuite, CompiledScriptRunsRepeatedly) {
+    Engine engine;
+    auto script = engine.compile("function sq(x) return x * x end function print(sq(7))");
+    for (int i = 0; i < 3; ++i) {
+        std::ostringstream output;
+        script->run(output);
+        EXPECT_EQ(output.str(), "49");
+    }
+}
+
+TEST(EngineTestSuite, StateKeepsGlobalsBetweenRuns) {
+    Engine engine;
+    auto script = engine.compile("count = count + 1 print(count)");
+    auto state = script->newState();
+    state->set("count", Value(10.0));
+    state->set("unused", Value(1.0));
+    std::ostringstream output;
+    script->run(*state, output);
+    script->run(*state, output);
+    EXPECT_EQ(output.str(), "1112");
+    EXPECT_DOUBLE_EQ(state->get("count").asNumber(), 12);
+
+    // Свежее состояние ничего не знает о прошлых запусках
+    EXPECT_THROW(script->newState()->get("count"), std::runtime_error);
+    EXPECT_THROW(script->run(output), std::runtime_error);
+}
+
+TEST(EngineTestSuite, HostStreams) {
+    Engine engine;
+    auto script = engine.compile("name = read() print(\"hi \", name)");
+    std::istringstream first("ann\n"), second("bob\n");
+    std::ostringstream out1, out2;
+    script->run(out1, first);
+    script->run(out2, second);
+    EXPECT_EQ(out1.str(), "hi ann");
+    EXPECT_EQ(out2.str(), "hi bob");
+}
+
+TEST(EngineTestSuite, CacheKeepsRecentlyUsedScripts) {
+    Engine engine(2);
+    auto a = engine.compile("print(1)");
+    auto b = engine.compile("print(2)");
+    EXPECT_EQ(engine.compile("print(1)"), a);
+    engine.compile("print(3)");
+    EXPECT_EQ(engine.cachedScripts(), 2);
+    EXPECT_EQ(engine.compile("print(1)"), a);
+    EXPECT_NE(engine.compile("print(2)"), b);
+}
+
+TEST(EngineTestSuite, Errors) {
+    Engine engine;
+    EXPECT_THROW(engine.compile("x = (1 + "), std::runtime_error);
+    EXPECT_EQ(engine.cachedScripts(), 0);
+
+    std::ostringstream output;
+    EXPECT_THROW(engine.run("print(1) y = 1 / nil", output), std::runtime_error);
+    EXPECT_EQ(output.str(), "1");
+
+    auto script = engine.compile("print(2)");
+    auto other = engine.compile("print(3)")->newState();
+    EXPECT_THROW(script->run(*other, output), std::runtime_error);
+}
@@ -0,0 +1,27 @@
+#include "environment.h"
+
+#include <gtest/gtest.h>
+
+TEST(EnvironmentTestSuite, FindReturnsNullForUnknownName) {
+    auto globals = std::make_shared<Environment>();
+    Environment local(globals);
+    EXPECT_EQ(local.find("missing"), nullptr);
+    EXPECT_FALSE(local.lookup("missing"));
+    EXPECT_THROW(local.get("missing"), std::runtime_error);
+}
+
+TEST(EnvironmentTestSuite, SetUpdatesOwningScope) {
+    auto globals = std::make_shared<Environment>();
+    globals->set("x", Value(1.0));
+    Environment local(globals);
+
+    local.set("x", Value(2.0));
+    local.set("y", Value(3.0));
+
+    auto found = local.lookup("x");
+    ASSERT_TRUE(found);
+    EXPECT_EQ(found.scope, globals.get());
+    EXPECT_EQ(globals->get("x").asNumber(), 2.0);
+    EXPECT_EQ(globals->find("y"), nullptr);
+    EXPECT_EQ(local.get("y").asNumber(), 3.0);
+}
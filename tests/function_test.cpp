@@ -531,3 +531,70 @@ TEST(FunctionEdgeCaseSuite, LocalVariableShadowsGlobal2) {
     std::ostringstream output;
     ASSERT_FALSE(interpret(input, output));
 }
+
+TEST(FunctionEdgeCaseSuite, BodiesAreParsedOnFirstCall) {
+    // С lazyBodies тела функций верхнего уровня разбираются при первом вызове:
+    // ошибка в функции, которую не вызывают, запуску не мешает
+    std::string code = R"(
+        function unused()
+            return 1 +
+        end function
+        function make(base)
+            add = function(x) return base + x end function
+            return add
+        end function
+        print(make(40)(2))
+    )";
+    for (auto mode : {ExecutionMode::Bytecode, ExecutionMode::TreeWalker}) {
+        std::istringstream input(code);
+        std::ostringstream output;
+        ASSERT_TRUE(interpret(input, output, mode, true));
+        EXPECT_EQ(output.str(), "42");
+
+        std::istringstream broken(code + "unused()");
+        std::ostringstream brokenOutput;
+        EXPECT_FALSE(interpret(broken, brokenOutput, mode, true));
+        EXPECT_EQ(brokenOutput.str(), "42Error: Syntax error in function 'unused'");
+    }
+}
+
+TEST(FunctionEdgeCaseSuite, SyntaxErrorInUncalledFunctionIsReported) {
+    std::string code = R"(
+        function unused()
+            return 1 +
+        end function
+        print(42)
+    )";
+    for (auto mode : {ExecutionMode::Bytecode, ExecutionMode::TreeWalker, ExecutionMode::Streaming}) {
+        std::istringstream input(code);
+        std::ostringstream output;
+        EXPECT_FALSE(interpret(input, output, mode));
+        EXPECT_EQ(output.str(), "");
+    }
+}
+
+TEST(FunctionEdgeCaseSuite, LazyLiteralCopiesGlobals) {
+    // Отложенное тело литерала видит те же копии глобалов, что и разобранное сразу
+    std::string code = R"(
+        counter = 0
+        f = function() counter = counter + 1 return counter end function
+        x = 1
+        g = function() return x end function
+        x = 2
+        fact = function(n) if n <= 1 then return 1 end if return n * fact(n - 1) end function
+        print(f(), f(), counter, " ", g(), " ", fact(5))
+    )";
+    for (auto mode : {ExecutionMode::Bytecode, ExecutionMode::TreeWalker, ExecutionMode::Streaming}) {
+        std::istringstream input(code);
+        std::ostringstream output;
+        EXPECT_TRUE(interpret(input, output, mode, true));
+        EXPECT_EQ(output.str(), "120 1 120");
+        // Потоковый режим не знает глобалов, заданных ниже по тексту
+        if (mode == ExecutionMode::Streaming) continue;
+
+        std::istringstream later("h = function() return z end function z = 1 print(h())");
+        std::ostringstream laterOutput;
+        EXPECT_FALSE(interpret(later, laterOutput, mode, true));
+        EXPECT_EQ(laterOutput.str(), "Error: Undefined variable 'z'");
+    }
+}
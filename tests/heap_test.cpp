@@ -0,0 +1,64 @@
+#include "lib/heap.h"
+
+#include <gtest/gtest.h>
+
+#include "lib/interpreter.h"
+
+TEST(HeapTestSuite, SelfContainingListIsCollected) {
+    Heap& heap = Heap::local();
+    heap.collect();
+    size_t baseline = heap.size();
+
+    Value list(Value::RawList{Value(1.0)});
+    list.mutableList().push_back(list);
+    EXPECT_EQ(heap.size(), baseline + 1);
+    EXPECT_EQ(heap.collect(), 0);
+
+    list = Value();
+    EXPECT_EQ(heap.size(), baseline + 1);
+    EXPECT_EQ(heap.collect(), 1);
+    EXPECT_EQ(heap.size(), baseline);
+}
+
+TEST(HeapTestSuite, ReachableCycleSurvives) {
+    Heap& heap = Heap::local();
+    Value a(Value::RawList{});
+    Value b(Value::RawList{a});
+    a.mutableList().push_back(b);
+    Value outer(Value::RawList{a});
+    a = Value();
+    b = Value();
+
+    heap.collect();
+    EXPECT_EQ(outer.atIndex(0).atIndex(0).atIndex(0).listSize(), 1);
+    outer = Value();
+    EXPECT_EQ(heap.collect(), 2);
+}
+
+TEST(HeapTestSuite, RecursiveClosuresDoNotLeak) {
+    std::string code = R"(
+        make = function(n)
+            count = function(k)
+                if k == 0 then
+                    return 0
+                end if
+                return 1 + count(k - 1)
+            end function
+            return count(n)
+        end function
+        s = 0
+        for i in range(30000)
+            s += make(3)
+        end for
+        print(s)
+    )";
+    for (auto mode : {ExecutionMode::Bytecode, ExecutionMode::TreeWalker}) {
+        Heap::local().collect();
+        size_t baseline = Heap::local().size();
+        std::istringstream input(code);
+        std::ostringstream output;
+        ASSERT_TRUE(interpret(input, output, mode));
+        EXPECT_EQ(output.str(), "90000");
+        EXPECT_EQ(Heap::local().size(), baseline);
+    }
+}
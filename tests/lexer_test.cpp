@@ -2,6 +2,7 @@
 
 #include <gtest/gtest.h>
 
+#include <fstream>
 #include <sstream>
 #include <variant>
 
@@ -71,6 +72,17 @@ TEST(LexerTestSuite, IdentifierAndKeyword) {
     EXPECT_EQ(tokens[4].lexeme, "my_var");
 }
 
+TEST(LexerTestSuite, IdentifiersAreInterned) {
+    auto tokens = lexAll("foo bar foo if");
+    ASSERT_GE(tokens.size(), 4);
+    EXPECT_EQ(tokens[0].symbol, tokens[2].symbol);
+    EXPECT_NE(tokens[0].symbol, tokens[1].symbol);
+    EXPECT_EQ(tokens[0].symbol, Symbol::intern("foo"));
+    EXPECT_EQ(tokens[1].symbol.name(), "bar");
+    EXPECT_NE(tokens[0].symbol.id(), 0);
+    EXPECT_FALSE(tokens[3].symbol);
+}
+
 TEST(LexerTestSuite, OperatorsAndDelimiters) {
     const std::vector<std::pair<std::string, TokenType>> tests = {
         {"+", TokenType::Plus},
@@ -121,6 +133,43 @@ TEST(LexerTestSuite, CommentSkipping) {
     EXPECT_EQ(tokens[1].type, TokenType::EndOfFile);
 }
 
+TEST(LexerTestSuite, TokenStreamPointsIntoSource) {
+    std::string_view source = "x = 1.5 // c\ns = \"a\\tb\" true";
+    Lexer lexer(source);
+    TokenStream tokens = lexer.tokenize();
+    ASSERT_EQ(tokens.size(), 8);
+    EXPECT_EQ(tokens.types[0], TokenType::Identifier);
+    EXPECT_EQ(tokens.text(0).data(), source.data());
+    EXPECT_EQ(tokens.text(2), "1.5");
+    EXPECT_EQ(tokens.offsets[2], 4);
+    EXPECT_EQ(tokens.lines[3], 2);
+    EXPECT_EQ(tokens.text(5), "\"a\\tb\"");
+    EXPECT_EQ(tokens.types[7], TokenType::EndOfFile);
+
+    TokenView str = tokens.take(5);
+    EXPECT_EQ(std::get<std::string>(str.literal), "a\tb");
+    EXPECT_DOUBLE_EQ(std::get<double>(tokens.take(2).literal), 1.5);
+    EXPECT_TRUE(std::get<bool>(tokens.take(6).literal));
+    EXPECT_EQ(tokens.take(3).symbol, Symbol::intern("s"));
+}
+
+TEST(LexerTestSuite, TokenStreamStopsAtError) {
+    Lexer lexer(std::string_view("x = \"open"));
+    TokenStream tokens = lexer.tokenize();
+    ASSERT_EQ(tokens.size(), 3);
+    EXPECT_EQ(tokens.types[2], TokenType::EndOfFile);
+    EXPECT_EQ(std::get<std::string>(tokens.take(2).literal), "Unclosed string");
+}
+
+TEST(LexerTestSuite, MappedFile) {
+    std::string path = ::testing::TempDir() + "lexer_mapped.is";
+    std::ofstream(path) << "print(42)";
+    std::ostringstream output;
+    EXPECT_TRUE(interpret(SourceBuffer::open(path), output));
+    EXPECT_EQ(output.str(), "42");
+    EXPECT_THROW(SourceBuffer::open(path + ".missing"), std::runtime_error);
+}
+
 TEST(NumberExponentialSuite, PositiveExponent) {
     std::string program =
         "x = 1e3\n"
@@ -2,6 +2,8 @@
 
 #include <gtest/gtest.h>
 
+#include <algorithm>
+
 #include "lexer.h"
 
 // Вспомогательная функция: пытается распарсить последовательность топ-левел выражений.
@@ -51,3 +53,66 @@ TEST(ParserTestSuite, InvalidExpression) {
     std::vector<std::unique_ptr<FunctionAST>> functions;
     EXPECT_FALSE(parser.parseModule(functions));
 }
+
+TEST(ParserTestSuite, ModuleNodesShareOneArena) {
+    std::istringstream in(R"(
+        function add(a, b)
+            return a + b
+        end function
+        f = function(x) return x * 2 end function
+        print(add(1, f(2)))
+    )");
+    Lexer lexer(in);
+    Parser parser(lexer);
+    std::vector<std::unique_ptr<FunctionAST>> functions;
+    ASSERT_TRUE(parser.parseModule(functions));
+    ASSERT_EQ(functions.size(), 3);
+
+    const AstArena* arena = functions[0]->getArena();
+    ASSERT_NE(arena, nullptr);
+    EXPECT_EQ(arena->blockCount(), 1);
+    for (auto& fn : functions) EXPECT_EQ(fn->getArena(), arena);
+
+    // Арена переживает функции, разобранные раньше других
+    functions.erase(functions.begin());
+    EXPECT_EQ(functions[0]->getArena(), arena);
+    EXPECT_NE(dynamic_cast<const AssignmentExprAST*>(&functions[0]->getBody()), nullptr);
+}
+
+TEST(ParserTestSuite, LazyBodiesAreSkipped) {
+    std::istringstream in(R"(
+        function outer(a)
+            inner = function(b) return a + b end function
+            return inner(count)
+        end function
+        f = function() return broken + end function
+        print(outer(1))
+    )");
+    Lexer lexer(in);
+    Parser parser(lexer, true);
+    std::vector<std::unique_ptr<FunctionAST>> functions;
+    ASSERT_TRUE(parser.parseModule(functions));
+    ASSERT_EQ(functions.size(), 3);
+
+    ASSERT_TRUE(functions[0]->isLazy());
+    const LazyBody& body = *functions[0]->getLazyBody();
+    EXPECT_EQ(body.line, 3);
+    EXPECT_TRUE(body.text().starts_with("inner = function(b)"));
+    EXPECT_TRUE(body.text().ends_with("end function"));
+    EXPECT_NE(std::find(body.names.begin(), body.names.end(), Symbol::intern("count")), body.names.end());
+
+    // Синтаксическая ошибка в отложенном теле при разборе модуля не видна
+    auto* assign = dynamic_cast<const AssignmentExprAST*>(&functions[1]->getBody());
+    ASSERT_NE(assign, nullptr);
+    auto* literal = dynamic_cast<const FunctionLiteralExprAST*>(assign->getExpr());
+    ASSERT_NE(literal, nullptr);
+    EXPECT_TRUE(literal->getFunctionAST()->isLazy());
+}
+
+TEST(ParserTestSuite, LazyBodyStillNeedsEnd) {
+    std::istringstream in("function f() return 1");
+    Lexer lexer(in);
+    Parser parser(lexer, true);
+    std::vector<std::unique_ptr<FunctionAST>> functions;
+    EXPECT_FALSE(parser.parseModule(functions));
+}
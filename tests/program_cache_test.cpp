@@ -0,0 +1,172 @@
+#include "lib/program_cache.h"
+
+#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+#include "lib/interpreter.h"
+
+namespace {
+
+const char* kScript = R"(
+function counter()
+    n = 0
+    inc = function()
+        n += 1
+        return n
+    end function
+    return inc
+end function
+
+c = counter()
+c()
+flags = [true, false, nil, 2.5, "a\tb"]
+print(c(), " ", flags, " ", "x" in "xyz")
+)";
+
+std::string readFile(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    std::stringstream ss;
+    ss << in.rdbuf();
+    return ss.str();
+}
+
+void writeFile(const std::string& path, const std::string& text) {
+    std::ofstream(path, std::ios::binary | std::ios::trunc) << text;
+}
+
+std::string runFile(const std::string& path) {
+    std::ostringstream output;
+    EXPECT_TRUE(interpretFile(path, output));
+    return output.str();
+}
+
+class ProgramCacheTest : public ::testing::Test {
+   protected:
+    void SetUp() override {
+        path = ::testing::TempDir() + ::testing::UnitTest::GetInstance()->current_test_info()->name() + ".is";
+        std::filesystem::remove(programCachePath(path));
+        writeFile(path, kScript);
+        std::istringstream input(kScript);
+        std::ostringstream output;
+        ASSERT_TRUE(interpret(input, output));
+        expected = output.str();
+    }
+
+    std::string path;
+    std::string expected;
+};
+
+}  // namespace
+
+TEST(ProgramCacheTestSuite, CachePathReplacesExtension) {
+    EXPECT_EQ(programCachePath("dir/job.is"), "dir/job.isc");
+    EXPECT_EQ(programCachePath("job.txt"), "job.txt.isc");
+}
+
+TEST_F(ProgramCacheTest, SecondRunLoadsCache) {
+    EXPECT_EQ(runFile(path), expected);
+    std::string cache = readFile(programCachePath(path));
+    ASSERT_FALSE(cache.empty());
+
+    auto program = deserializeProgram(cache, hashSource(kScript));
+    ASSERT_NE(program, nullptr);
+    EXPECT_EQ(serializeProgram(*program, hashSource(kScript)), cache);
+
+    EXPECT_EQ(runFile(path), expected);
+}
+
+TEST_F(ProgramCacheTest, ChangedSourceIsRecompiled) {
+    EXPECT_EQ(runFile(path), expected);
+    writeFile(path, std::string(kScript) + "print(\"!\")");
+    EXPECT_EQ(runFile(path), expected + "!");
+    EXPECT_EQ(runFile(path), expected + "!");
+}
+
+TEST_F(ProgramCacheTest, DamagedCacheIsIgnored) {
+    EXPECT_EQ(runFile(path), expected);
+    std::string cache = readFile(programCachePath(path));
+    uint64_t hash = hashSource(kScript);
+    EXPECT_EQ(deserializeProgram(cache, hash + 1), nullptr);
+    for (size_t len : {size_t{0}, size_t{3}, size_t{20}, cache.size() / 2, cache.size() - 1})
+        EXPECT_EQ(deserializeProgram(std::string_view(cache).substr(0, len), hash), nullptr) << len;
+    EXPECT_EQ(deserializeProgram(cache + "x", hash), nullptr);
+
+    writeFile(programCachePath(path), cache.substr(0, cache.size() / 2));
+    EXPECT_EQ(runFile(path), expected);
+    EXPECT_EQ(readFile(programCachePath(path)), cache);
+}
+
+TEST_F(ProgramCacheTest, FlippedBitIsDetected) {
+    EXPECT_EQ(runFile(path), expected);
+    std::string cache = readFile(programCachePath(path));
+    uint64_t hash = hashSource(kScript);
+    for (size_t i = 0; i < cache.size(); ++i) {
+        for (int bit = 0; bit < 8; ++bit) {
+            std::string damaged = cache;
+            damaged[i] ^= static_cast<char>(1 << bit);
+            EXPECT_EQ(deserializeProgram(damaged, hash), nullptr) << i << ":" << bit;
+        }
+    }
+}
+
+TEST_F(ProgramCacheTest, InvalidOperandsAreRejected) {
+    // Данные с верным хешем, но с кодом, который вышел бы за пределы функции
+    EXPECT_EQ(runFile(path), expected);
+    uint64_t hash = hashSource(kScript);
+    std::string cache = readFile(programCachePath(path));
+
+    auto damage = [&](auto&& change) {
+        auto program = deserializeProgram(cache, hash);
+        EXPECT_NE(program, nullptr);
+        if (!program) return std::string();
+        Proto& counter = *program->definitions[0].second;
+        change(*program, counter);
+        return serializeProgram(*program, hash);
+    };
+    auto find = [](Proto& proto, OpCode op) -> Instruction& {
+        for (auto& ins : proto.code)
+            if (ins.op == op) return ins;
+        ADD_FAILURE() << "no such instruction";
+        return proto.code[0];
+    };
+
+    std::vector<std::string> damaged = {
+        damage([](Program&, Proto& p) { p.code[0].a = p.numRegs; }),
+        damage([&](Program&, Proto& p) { find(p, OpCode::LoadK).setBx(static_cast<uint32_t>(p.constants.size())); }),
+        damage([&](Program&, Proto& p) { find(p, OpCode::Closure).setBx(static_cast<uint32_t>(p.children.size())); }),
+        damage([&](Program& program, Proto&) {
+            Proto& top = *program.topLevel[0];
+            find(top, OpCode::SetGlobal).setBx(static_cast<uint32_t>(program.globals.names.size()));
+        }),
+        damage([&](Program&, Proto& p) { find(*p.children[0], OpCode::GetUpval).b = 1; }),
+        damage([](Program&, Proto& p) { p.children[0]->upvalues[0].index = p.numRegs; }),
+        damage([](Program&, Proto& p) { p.code.back() = Instruction{OpCode::LoadNil}; }),
+        damage([&](Program& program, Proto&) {
+            Proto& top = *program.topLevel.back();
+            top.code.back().op = OpCode::Jmp;
+            top.code.back().setBx(static_cast<uint32_t>(top.code.size()));
+        }),
+        damage([](Program&, Proto& p) { p.numParams = p.numRegs + 1; }),
+    };
+    for (size_t i = 0; i < damaged.size(); ++i) EXPECT_EQ(deserializeProgram(damaged[i], hash), nullptr) << i;
+}
+
+TEST_F(ProgramCacheTest, CacheIsWrittenThroughUniqueTempFile) {
+    // Временный файл другого запуска с тем же скриптом не трогается
+    std::string cachePath = programCachePath(path);
+    std::string other = cachePath + ".tmp";
+    writeFile(other, "other");
+    EXPECT_EQ(runFile(path), expected);
+    EXPECT_EQ(readFile(other), "other");
+    EXPECT_NE(deserializeProgram(readFile(cachePath), hashSource(kScript)), nullptr);
+
+    std::filesystem::remove(other);
+    auto dir = std::filesystem::path(cachePath).parent_path();
+    for (const auto& entry : std::filesystem::directory_iterator(dir)) {
+        std::string name = entry.path().filename().string();
+        EXPECT_FALSE(name.starts_with(std::filesystem::path(cachePath).filename().string() + ".")) << name;
+    }
+}
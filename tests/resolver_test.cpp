@@ -0,0 +1,155 @@
+#include "resolver.h"
+
+#include <gtest/gtest.h>
+
+#include "lexer.h"
+#include "parser.h"
+
+// Разбирает и резолвит модуль, возвращает функции с размеченными слотами
+static std::vector<std::unique_ptr<FunctionAST>> resolveCode(const std::string& code, GlobalNames& names) {
+    std::istringstream in(code);
+    Lexer lexer(in);
+    Parser parser(lexer);
+    std::vector<std::unique_ptr<FunctionAST>> functions;
+    EXPECT_TRUE(parser.parseModule(functions));
+    Resolver(names).resolve(functions);
+    return functions;
+}
+
+static const FunctionAST* literalOf(const FunctionAST& topLevel) {
+    auto* assign = dynamic_cast<const AssignmentExprAST*>(&topLevel.getBody());
+    EXPECT_NE(assign, nullptr);
+    auto* lit = dynamic_cast<const FunctionLiteralExprAST*>(assign->getExpr());
+    EXPECT_NE(lit, nullptr);
+    return lit->getFunctionAST();
+}
+
+TEST(ResolverTestSuite, TopLevelNamesAreGlobals) {
+    GlobalNames names;
+    auto functions = resolveCode("x = 1 y = x", names);
+    ASSERT_EQ(functions.size(), 2);
+    auto* assign = dynamic_cast<const AssignmentExprAST*>(&functions[1]->getBody());
+    ASSERT_NE(assign, nullptr);
+    EXPECT_EQ(assign->getSlot().kind, SlotKind::Global);
+    EXPECT_EQ(assign->getSlot().index, names.index.at(Symbol::intern("y")));
+    auto* var = dynamic_cast<const VariableExprAST*>(assign->getExpr());
+    ASSERT_NE(var, nullptr);
+    EXPECT_EQ(var->getSlot().kind, SlotKind::Global);
+    EXPECT_EQ(var->getSlot().index, names.index.at(Symbol::intern("x")));
+}
+
+TEST(ResolverTestSuite, ParamsAndAssignedNamesAreLocals) {
+    GlobalNames names;
+    auto functions = resolveCode(R"(
+        f = function(a, b)
+            c = a + b
+            return c * k
+        end function
+    )", names);
+    const FunctionScope& scope = literalOf(*functions[0])->getScope();
+    EXPECT_EQ(scope.numParams, 2);
+    EXPECT_EQ(scope.numLocals, 3);
+    EXPECT_TRUE(scope.upvalues.empty());
+    EXPECT_EQ(names.index.count(Symbol::intern("k")), 1);
+    EXPECT_EQ(names.index.count(Symbol::intern("c")), 0);
+}
+
+TEST(ResolverTestSuite, EnclosingLocalsBecomeUpvalues) {
+    GlobalNames names;
+    auto functions = resolveCode(R"(
+        outer = function()
+            count = 0
+            inner = function()
+                count += 1
+                return count
+            end function
+            return inner
+        end function
+    )", names);
+    auto* outer = literalOf(*functions[0]);
+    EXPECT_EQ(outer->getScope().numLocals, 2);
+
+    auto* block = dynamic_cast<const BlockExprAST*>(&outer->getBody());
+    ASSERT_NE(block, nullptr);
+    auto* innerAssign = dynamic_cast<const AssignmentExprAST*>(block->getStatements()[1].get());
+    ASSERT_NE(innerAssign, nullptr);
+    auto* inner = dynamic_cast<const FunctionLiteralExprAST*>(innerAssign->getExpr())->getFunctionAST();
+
+    const FunctionScope& scope = inner->getScope();
+    EXPECT_EQ(scope.numLocals, 0);
+    ASSERT_EQ(scope.upvalues.size(), 1);
+    EXPECT_EQ(scope.upvalues[0].source, UpvalueSource::ParentLocal);
+    EXPECT_EQ(scope.upvalues[0].name.name(), "count");
+}
+
+TEST(ResolverTestSuite, OnlyReferencedNamesAreCaptured) {
+    GlobalNames names;
+    auto functions = resolveCode(R"(
+        outer = function(a, b, c)
+            d = a + b
+            inner = function()
+                return c + k
+            end function
+            noCapture = function(x)
+                return x * 2
+            end function
+            return inner
+        end function
+    )", names);
+    auto* outer = literalOf(*functions[0]);
+    EXPECT_EQ(outer->getScope().numLocals, 6);
+
+    auto* block = dynamic_cast<const BlockExprAST*>(&outer->getBody());
+    ASSERT_NE(block, nullptr);
+    auto literalAt = [&](size_t i) {
+        auto* assign = dynamic_cast<const AssignmentExprAST*>(block->getStatements()[i].get());
+        return dynamic_cast<const FunctionLiteralExprAST*>(assign->getExpr())->getFunctionAST();
+    };
+    const auto& upvalues = literalAt(1)->getScope().upvalues;
+    ASSERT_EQ(upvalues.size(), 1);
+    EXPECT_EQ(upvalues[0].name.name(), "c");
+    EXPECT_EQ(upvalues[0].index, 2);
+    EXPECT_TRUE(literalAt(2)->getScope().upvalues.empty());
+}
+
+TEST(ResolverTestSuite, NamedFunctionAssignsModuleGlobals) {
+    GlobalNames names;
+    auto functions = resolveCode("function inc() counter = counter + 1 tmp = 1 end function counter = 0", names);
+    ASSERT_EQ(functions.size(), 2);
+    EXPECT_EQ(functions[0]->getScope().numLocals, 1);
+    auto* block = dynamic_cast<const BlockExprAST*>(&functions[0]->getBody());
+    ASSERT_NE(block, nullptr);
+    auto* assign = dynamic_cast<const AssignmentExprAST*>(block->getStatements()[0].get());
+    ASSERT_NE(assign, nullptr);
+    EXPECT_EQ(assign->getSlot().kind, SlotKind::Global);
+}
+
+TEST(ResolverTestSuite, TopLevelLiteralCapturesModuleGlobals) {
+    GlobalNames names;
+    auto functions = resolveCode("x = 1 f = function() x = x + 1 y = 2 return f end function", names);
+    ASSERT_EQ(functions.size(), 2);
+    const FunctionAST* lit = literalOf(*functions[1]);
+    // x и сам f — копии глобалов, y — локальная литерала
+    const auto& upvalues = lit->getScope().upvalues;
+    ASSERT_EQ(upvalues.size(), 2);
+    EXPECT_EQ(upvalues[0].source, UpvalueSource::Global);
+    EXPECT_EQ(upvalues[0].index, names.index.at(Symbol::intern("x")));
+    EXPECT_EQ(upvalues[1].source, UpvalueSource::Self);
+    EXPECT_EQ(lit->getScope().numLocals, 1);
+}
+
+TEST(ResolverTestSuite, LiteralInNamedFunctionAssignsModuleGlobals) {
+    GlobalNames names;
+    auto functions =
+        resolveCode("function run() f = function() counter = counter + 1 end function f() end function counter = 0",
+                    names);
+    ASSERT_EQ(functions.size(), 2);
+    auto* block = dynamic_cast<const BlockExprAST*>(&functions[0]->getBody());
+    ASSERT_NE(block, nullptr);
+    auto* assign = dynamic_cast<const AssignmentExprAST*>(block->getStatements()[0].get());
+    ASSERT_NE(assign, nullptr);
+    auto* lit = dynamic_cast<const FunctionLiteralExprAST*>(assign->getExpr());
+    ASSERT_NE(lit, nullptr);
+    EXPECT_TRUE(lit->getFunctionAST()->getScope().upvalues.empty());
+    EXPECT_EQ(lit->getFunctionAST()->getScope().numLocals, 0);
+}
@@ -0,0 +1,51 @@
+#include "lib/scan.h"
+
+#include <gtest/gtest.h>
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include "lib/keywords.h"
+
+static std::vector<const ScanKernels*> kernels() {
+    std::vector<const ScanKernels*> out;
+    for (const ScanKernels* k : {sse2ScanKernels(), avx2ScanKernels()})
+        if (k) out.push_back(k);
+    return out;
+}
+
+// Векторные ядра должны находить ту же границу и считать те же строки, что и
+// скалярные, в том числе когда граница или конец текста лежат внутри блока
+TEST(ScanTestSuite, KernelsMatchScalar) {
+    const ScanKernels& scalar = *scalarScanKernels();
+    const std::string alphabet = "aZ_9 \t\r\n\"\\.+\x80";
+    std::mt19937 rng(42);
+    for (int iter = 0; iter < 2000; ++iter) {
+        std::string text(1 + rng() % 100, ' ');
+        // Длинные однородные участки, чтобы граница оказывалась в разных блоках
+        size_t run = rng() % text.size() + 1;
+        char common = alphabet[rng() % alphabet.size()];
+        for (size_t i = 0; i < text.size(); ++i)
+            text[i] = i < run ? common : alphabet[rng() % alphabet.size()];
+        const char* begin = text.data();
+        const char* end = begin + text.size();
+        for (const ScanKernels* k : kernels()) {
+            SCOPED_TRACE(std::string(k->name) + " on \"" + text + "\"");
+            EXPECT_EQ(k->identEnd(begin, end), scalar.identEnd(begin, end));
+            EXPECT_EQ(k->digitsEnd(begin, end), scalar.digitsEnd(begin, end));
+            int lines = 0, expected = 0;
+            EXPECT_EQ(k->spaceEnd(begin, end, lines), scalar.spaceEnd(begin, end, expected));
+            EXPECT_EQ(lines, expected);
+            lines = expected = 0;
+            EXPECT_EQ(k->quoteOrBackslash(begin, end, lines), scalar.quoteOrBackslash(begin, end, expected));
+            EXPECT_EQ(lines, expected);
+        }
+    }
+}
+
+TEST(ScanTestSuite, KeywordLookup) {
+    for (const Keyword& k : keywords) EXPECT_EQ(keywordType(k.text), k.type) << k.text;
+    for (std::string_view word : {"iff", "e", "nill", "functions", "x", "End", "fo", "_"})
+        EXPECT_EQ(keywordType(word), TokenType::Identifier) << word;
+}
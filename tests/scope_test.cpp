@@ -0,0 +1,42 @@
+#include "lib/scope.h"
+
+#include <gtest/gtest.h>
+
+TEST(ScopeTestSuite, FrameSlotsAreReusedInStackOrder) {
+    GlobalNames names;
+    GlobalTable globals(names);
+    Value* first;
+    {
+        Frame outer(globals, 3, nullptr);
+        outer.locals[0] = Value(1.0);
+        {
+            Frame inner(globals, 2, nullptr);
+            EXPECT_EQ(inner.locals, outer.locals + 3);
+            EXPECT_TRUE(inner.locals[0].isNil());
+            inner.locals[1] = Value(std::string("x"));
+        }
+        Frame next(globals, 2, nullptr);
+        EXPECT_EQ(next.locals, outer.locals + 3);
+        EXPECT_TRUE(next.locals[1].isNil());
+        EXPECT_EQ(outer.locals[0].asNumber(), 1.0);
+        first = outer.locals;
+    }
+    Frame again(globals, 1, nullptr);
+    EXPECT_EQ(again.locals, first);
+}
+
+TEST(ScopeTestSuite, LargeFramesDoNotMoveOuterSlots) {
+    GlobalNames names;
+    GlobalTable globals(names);
+    Frame outer(globals, 2, nullptr);
+    outer.locals[1] = Value(std::string("kept"));
+    {
+        Frame big(globals, 100000, nullptr);
+        big.locals[99999] = Value(2.0);
+        Frame small(globals, 1, nullptr);
+        small.locals[0] = Value(3.0);
+    }
+    EXPECT_EQ(outer.locals[1].asString(), "kept");
+    Frame after(globals, 1, nullptr);
+    EXPECT_EQ(after.locals, outer.locals + 2);
+}
@@ -0,0 +1,94 @@
+#include <gtest/gtest.h>
+
+#include <limits>
+#include <sstream>
+
+#include "builtins.h"
+#include "lexer.h"
+#include "parser.h"
+#include "resolver.h"
+
+// Топ-левел выражение, разобранное и размеченное резолвером. Глобалы
+// создаются после разбора, их значения тест задаёт сам
+struct Snippet {
+    GlobalNames names;
+    std::vector<std::unique_ptr<FunctionAST>> functions;
+    std::unique_ptr<GlobalTable> globals;
+
+    explicit Snippet(const std::string& code) {
+        std::istringstream in(code);
+        Lexer lexer(in);
+        Parser parser(lexer);
+        EXPECT_TRUE(parser.parseModule(functions));
+        Resolver(names).resolve(functions);
+        globals = std::make_unique<GlobalTable>(names);
+    }
+
+    void set(std::string_view name, Value v) { globals->set(names.intern(name), std::move(v)); }
+
+    template <class Node>
+    const Node& body() const {
+        auto* node = dynamic_cast<const Node*>(&functions.back()->getBody());
+        EXPECT_NE(node, nullptr);
+        return *node;
+    }
+
+    Value eval() {
+        Frame frame(*globals, 0, nullptr);
+        return functions.back()->getBody().eval(frame);
+    }
+};
+
+TEST(SpecializeTestSuite, BinaryFallsBackWhenOperandsChange) {
+    Snippet s("x + 1");
+    s.set("x", Value(2.0));
+    EXPECT_EQ(s.eval().asNumber(), 3.0);
+    EXPECT_TRUE(s.body<BinaryExprAST>().isNumberSpecialized());
+
+    s.set("x", Value(std::string("a")));
+    EXPECT_THROW(s.eval(), std::runtime_error);
+    EXPECT_FALSE(s.body<BinaryExprAST>().isNumberSpecialized());
+
+    s.set("x", Value(true));
+    EXPECT_EQ(s.eval().asNumber(), 2.0);
+}
+
+TEST(SpecializeTestSuite, ComparisonKeepsNaNSemantics) {
+    Snippet s("x > 1");
+    s.set("x", Value(std::numeric_limits<double>::quiet_NaN()));
+    EXPECT_TRUE(s.eval().asBool());
+    EXPECT_TRUE(s.body<BinaryExprAST>().isNumberSpecialized());
+}
+
+TEST(SpecializeTestSuite, IndexFallsBackForStrings) {
+    Snippet s("xs[i]");
+    s.set("xs", Value(Value::RawList{Value(1.0), Value(2.0)}));
+    s.set("i", Value(-1.0));
+    EXPECT_EQ(s.eval().asNumber(), 2.0);
+    EXPECT_TRUE(s.body<IndexExprAST>().isListSpecialized());
+
+    s.set("xs", Value(std::string("abc")));
+    EXPECT_EQ(s.eval().toString(), "c");
+    EXPECT_FALSE(s.body<IndexExprAST>().isListSpecialized());
+}
+
+TEST(SpecializeTestSuite, CallFollowsTheObservedCallee) {
+    Snippet s("function twice(x) return x * 2 end function\nf(-3)");
+    const FunctionAST& twice = *s.functions.front();
+    s.set("f", Value(FunctionValue{&twice, nullptr, s.globals.get()}));
+    EXPECT_EQ(s.eval().asNumber(), -6.0);
+    EXPECT_TRUE(s.body<CallExprAST>().isFunctionSpecialized());
+
+    // Другая функция в той же точке вызова: узел возвращается к общему вызову
+    s.set("f", builtinValue(findBuiltin("abs")));
+    EXPECT_EQ(s.eval().asNumber(), 3.0);
+    EXPECT_FALSE(s.body<CallExprAST>().isFunctionSpecialized());
+    EXPECT_FALSE(s.body<CallExprAST>().isBuiltinSpecialized());
+}
+
+TEST(SpecializeTestSuite, BuiltinCallIsSpecialized) {
+    Snippet s("abs(x)");
+    s.set("x", Value(-2.0));
+    EXPECT_EQ(s.eval().asNumber(), 2.0);
+    EXPECT_TRUE(s.body<CallExprAST>().isBuiltinSpecialized());
+}
@@ -1,4 +1,5 @@
 #include <gtest/gtest.h>
+#include <lib/builtins.h>
 #include <lib/interpreter.h>
 
 // Для простоты: макрос, который упрощает вызов interpret и сравнение результата.
@@ -91,6 +92,13 @@ TEST(NumberLibEdgeSuite, RndEdgeCases) {
     }
 }
 
+TEST(NumberLibEdgeSuite, MaxMinNegativeNumbers) {
+    // Только отрицательные аргументы: максимум — наибольший из них, а не ноль
+    RUN("print(max(-3, -5))", "-3");
+    RUN("print(max([-7, -2, -4]))", "-2");
+    RUN("print(min(-3, -5), \" \", min([2, 7]))", "-5 2");
+}
+
 TEST(NumberLibEdgeSuite, ParseNumAndToStringEdgeCases) {
     // 1. parse_num на строку, содержащую число
     RUN(
@@ -315,3 +323,34 @@ TEST(CompositeLibEdgeSuite, MixedStringListNumberOperations) {
         )",
         "abcabc:x");
 }
+
+// 6. ТАБЛИЦА BUILTIN-ОВ
+
+TEST(BuiltinTableSuite, LookupByName) {
+    for (const char* name : {"print", "println", "len", "range", "stacktrace", "read"}) {
+        int id = findBuiltin(name);
+        ASSERT_GE(id, 0) << name;
+        EXPECT_TRUE(builtinValue(id).isFunc()) << name;
+    }
+    EXPECT_EQ(findBuiltin("prin"), -1);
+    EXPECT_EQ(findBuiltin("printx"), -1);
+    EXPECT_EQ(findBuiltin(""), -1);
+}
+
+TEST(BuiltinTableSuite, ScriptOverridesBuiltin) {
+    // Глобал и функция с именем builtin-а перекрывают его только в своей программе
+    RUN("len = 5 print(len)", "5");
+    RUN("function abs(x) return 42 end function print(abs(-1))", "42");
+    RUN("print(abs(-1))", "1");
+}
+
+TEST(BuiltinTableSuite, NativeCallTakesArgumentWindow) {
+    Value args[] = {Value(-2.5)};
+    EXPECT_EQ(builtinValue(findBuiltin("abs")).asFunc().invoke(args).asNumber(), 2.5);
+
+    // Окно аргументов указывает на значения вызывающего: список меняется на месте
+    Value list = Value(Value::RawList{Value(1.0)});
+    Value pushArgs[] = {list, Value(2.0)};
+    builtinValue(findBuiltin("push")).asFunc().invoke(pushArgs);
+    EXPECT_EQ(list.listSize(), 2);
+}
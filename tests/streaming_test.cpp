@@ -0,0 +1,155 @@
+#include <gtest/gtest.h>
+#include <lib/interpreter.h>
+#include <lib/parser.h>
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Исполняет код и как поток, и как текст целиком: результаты должны совпасть
+static std::string runStreaming(const std::string& code, bool expectOk = true) {
+    std::ostringstream whole;
+    EXPECT_EQ(interpret(SourceBuffer(code), whole, ExecutionMode::Streaming), expectOk);
+    std::istringstream input(code);
+    std::ostringstream output;
+    EXPECT_EQ(interpret(input, output, ExecutionMode::Streaming), expectOk);
+    EXPECT_EQ(output.str(), whole.str());
+    return output.str();
+}
+
+// Отдаёт текст по строкам и перед каждой строкой запоминает, что уже выведено
+class LineFeed : public std::streambuf {
+   public:
+    LineFeed(std::vector<std::string> lines, const std::ostringstream& output)
+        : lines_(std::move(lines)), output_(output) {}
+
+    std::vector<std::string> seen;
+
+   protected:
+    int_type underflow() override {
+        if (next_ == lines_.size()) return traits_type::eof();
+        seen.push_back(output_.str());
+        std::string& line = lines_[next_++];
+        setg(line.data(), line.data(), line.data() + line.size());
+        return traits_type::to_int_type(line[0]);
+    }
+
+   private:
+    std::vector<std::string> lines_;
+    const std::ostringstream& output_;
+    size_t next_ = 0;
+};
+
+TEST(StreamingTestSuite, DefinitionsAreBoundBeforeFirstStatement) {
+    // Текст модуля целиком: определения известны до первого выражения
+    std::string code = R"(
+        print(twice(3))
+        make = function(n)
+            inner = function(x) return x + n end function
+            return inner
+        end function
+        function twice(x)
+            return x * 2
+        end function
+        add = make(10)
+        print(" ", add(twice(1)))
+    )";
+    std::istringstream input(code);
+    std::ostringstream expected;
+    ASSERT_TRUE(interpret(input, expected, ExecutionMode::TreeWalker));
+    std::ostringstream output;
+    ASSERT_TRUE(interpret(SourceBuffer(code), output, ExecutionMode::Streaming));
+    EXPECT_EQ(output.str(), expected.str());
+    EXPECT_EQ(expected.str(), "6 12");
+}
+
+TEST(StreamingTestSuite, StatementsRunBeforeSyntaxError) {
+    EXPECT_EQ(runStreaming("print(1) x = (", false), "1");
+    EXPECT_EQ(runStreaming("print(1) y = 1 / nil print(2)", false).substr(0, 8), "1Error: ");
+}
+
+TEST(StreamingTestSuite, ParserReturnsStatementsOneByOne) {
+    std::istringstream in("x = 1 function f() return 1 end function print(f()) function g() end function");
+    Lexer lexer(in);
+    Parser parser(lexer, true);
+    std::vector<std::unique_ptr<FunctionAST>> definitions;
+    ASSERT_TRUE(parser.parseDefinitions(definitions));
+    ASSERT_EQ(definitions.size(), 2);
+    EXPECT_EQ(definitions[0]->getProto().getName(), "f");
+    EXPECT_EQ(definitions[1]->getProto().getName(), "g");
+
+    std::unique_ptr<FunctionAST> fn;
+    int statements = 0;
+    while (parser.parseNext(fn) && fn) {
+        EXPECT_EQ(fn->getProto().getName(), "__anon_expr");
+        ++statements;
+    }
+    EXPECT_EQ(fn, nullptr);
+    EXPECT_EQ(statements, 2);
+}
+
+TEST(StreamingTestSuite, StringAfterDefinitionKeepsItsText) {
+    // Токен после определения уже разобран: его строка не должна потеряться
+    EXPECT_EQ(runStreaming("function f() return 1 end function\n\"abc\"[5]", false),
+              "Error: Index 5 out of range [0,3)");
+    EXPECT_EQ(runStreaming("function f() return 1 end function \"abc\" + \"d\" print(\"ok\")"), "ok");
+}
+
+TEST(StreamingTestSuite, InputRunsBeforeItEnds) {
+    std::ostringstream output;
+    LineFeed feed({"print(1)\n", "print(2)\n", "x = (\n"}, output);
+    std::istream input(&feed);
+    EXPECT_FALSE(interpret(input, output, ExecutionMode::Streaming));
+    EXPECT_EQ(output.str(), "12");
+    // Выражение исполняется, как только после него появился следующий токен
+    EXPECT_EQ(feed.seen, (std::vector<std::string>{"", "", "1"}));
+}
+
+TEST(StreamingTestSuite, InputStatementsSpanLines) {
+    std::ostringstream output;
+    LineFeed feed({"x = 1 +\n", "2\n", "function f(v)\n", "return v * x\n", "end function\n",
+                   "print(f(2), \"a\n", "b\")\n"},
+                  output);
+    std::istream input(&feed);
+    EXPECT_TRUE(interpret(input, output, ExecutionMode::Streaming));
+    EXPECT_EQ(output.str(), "6a\nb");
+}
+
+TEST(StreamingTestSuite, InputDefinitionIsBoundWhenRead) {
+    EXPECT_EQ(runStreaming("function f() return g() end function\nfunction g() return 1 end function\nprint(f())"),
+              "1");
+    std::istringstream input("print(1)\nprint(g())\nfunction g() return 1 end function");
+    std::ostringstream output;
+    EXPECT_FALSE(interpret(input, output, ExecutionMode::Streaming));
+    EXPECT_EQ(output.str(), "1Error: Undefined variable 'g'");
+}
+
+TEST(StreamingTestSuite, NamedFunctionsAssignGlobalsSetLater) {
+    // Тело функции резолвится при вызове: глобалы, заданные выражениями
+    // после определения, она меняет, а не заводит одноимённые локальные
+    EXPECT_EQ(runStreaming(R"(
+        counter = 0
+        function inc()
+            counter = counter + 1
+        end function
+        inc()
+        inc()
+        println(counter)
+    )"),
+              "2\n");
+    EXPECT_EQ(runStreaming(R"(
+        function add(x)
+            total += x
+            seen = [x, x]
+        end function
+        total = 10
+        seen = []
+        add(5)
+        print(total, " ", seen)
+    )"),
+              "15 [5, 5]");
+    std::istringstream input("function inc() counter = counter + 1 end function\ncounter = 0\ninc()\nprint(counter)");
+    std::ostringstream output;
+    EXPECT_TRUE(interpret(input, output, ExecutionMode::Streaming, true));
+    EXPECT_EQ(output.str(), "1");
+}
@@ -0,0 +1,176 @@
+#include "value.h"
+
+#include <gtest/gtest.h>
+
+#include <limits>
+#include <span>
+#include <thread>
+#include <vector>
+
+TEST(ValueTestSuite, FitsInEightBytes) {
+    EXPECT_EQ(sizeof(Value), 8);
+}
+
+TEST(ValueTestSuite, NumbersRoundTrip) {
+    for (double d : {0.0, -0.0, 1.5, -1e300, std::numeric_limits<double>::infinity(),
+                     -std::numeric_limits<double>::infinity(), std::numeric_limits<double>::denorm_min()}) {
+        Value v(d);
+        ASSERT_TRUE(v.isNumber());
+        EXPECT_EQ(std::bit_cast<uint64_t>(v.asNumber()), std::bit_cast<uint64_t>(d));
+    }
+}
+
+TEST(ValueTestSuite, NaNStaysANumber) {
+    double negativeNaN = -std::numeric_limits<double>::quiet_NaN();
+    Value v(negativeNaN);
+    EXPECT_TRUE(v.isNumber());
+    EXPECT_FALSE(v.isNil());
+    EXPECT_TRUE(std::isnan(v.asNumber()));
+}
+
+TEST(ValueTestSuite, TagsAreDistinct) {
+    Value nil, t(true), f(false), n(0.0), s(std::string("x")), l(Value::RawList{});
+    EXPECT_TRUE(nil.isNil());
+    EXPECT_TRUE(t.isBool() && t.asBool());
+    EXPECT_TRUE(f.isBool() && !f.asBool());
+    EXPECT_TRUE(n.isNumber() && !n.isBool());
+    EXPECT_TRUE(s.isString() && !s.isList());
+    EXPECT_TRUE(l.isList() && !l.isString());
+    EXPECT_THROW(s.asNumber(), std::runtime_error);
+}
+
+TEST(ValueTestSuite, CopiesShareListStorage) {
+    Value a(Value::RawList{Value(1.0)});
+    Value b = a;
+    b.mutableList().push_back(Value(2.0));
+    EXPECT_EQ(a.asList().size(), 2);
+    Value c = std::move(b);
+    EXPECT_TRUE(b.isNil());
+    EXPECT_EQ(c.toString(), "[1, 2]");
+}
+
+TEST(ValueTestSuite, StringCopiesShareCharacters) {
+    Value a(std::string(1 << 20, 'a'));
+    Value b = a;
+    EXPECT_EQ(a.asString().data(), b.asString().data());
+    EXPECT_EQ(Value::character('x').asString().data(), Value(std::string("abcx")).atIndex(3).asString().data());
+}
+
+TEST(ValueTestSuite, CharacterTableIsPerThread) {
+    // Копии символа меняют его счётчик ссылок: потоки не должны делить таблицу
+    const char* mine = Value::character('x').asString().data();
+    const char* other = nullptr;
+    std::thread([&] { other = Value::character('x').asString().data(); }).join();
+    EXPECT_NE(mine, other);
+}
+
+TEST(ValueTestSuite, StringEquality) {
+    Value a(std::string("hello")), b(std::string("hello")), c(std::string("hellO"));
+    EXPECT_TRUE(a == b);
+    EXPECT_FALSE(a == c);
+    EXPECT_EQ((a + b).asString(), "hellohello");
+    EXPECT_EQ((Value(std::string("file.txt")) - Value(std::string(".txt"))).asString(), "file");
+}
+
+TEST(ValueTestSuite, LongStringSliceIsAView) {
+    Value s(std::string(100, 'a') + std::string(100, 'b'));
+    Value tail = s.slice(100, std::nullopt);
+    EXPECT_EQ(tail.asString(), std::string(100, 'b'));
+    EXPECT_EQ(tail.asString().data(), s.asString().data() + 100);
+
+    Value inner = tail.slice(10, 60);
+    EXPECT_EQ(inner.asString().data(), s.asString().data() + 110);
+    s = Value();
+    EXPECT_EQ(inner.asString(), std::string(50, 'b'));
+    EXPECT_EQ(inner.slice(-3, std::nullopt).asString(), "bbb");
+}
+
+TEST(ValueTestSuite, ListSliceSharesElementsUntilWritten) {
+    Value::RawList xs;
+    for (int i = 0; i < 10; ++i) xs.emplace_back(static_cast<double>(i));
+    Value list(std::move(xs));
+
+    Value part = list.slice(2, 5);
+    EXPECT_EQ(part.toString(), "[2, 3, 4]");
+    EXPECT_EQ(part.asList().data(), list.asList().data() + 2);
+    EXPECT_EQ(part.atIndex(-1).asNumber(), 4);
+
+    part.mutableList().push_back(Value(42.0));
+    EXPECT_EQ(part.toString(), "[2, 3, 4, 42]");
+    EXPECT_EQ(list.asList().size(), 10);
+
+    list.mutableList().push_back(Value(10.0));
+    Value tail = list.slice(-2, std::nullopt);
+    EXPECT_EQ(tail.toString(), "[9, 10]");
+}
+
+TEST(ValueTestSuite, SnapshotCopiesOnlyWhenSourceChanges) {
+    Value list(Value::RawList{Value(1.0), Value(2.0)});
+    Value snap = list.snapshot();
+    EXPECT_EQ(snap.asList().data(), list.asList().data());
+
+    list.mutableList().push_back(Value(3.0));
+    EXPECT_EQ(snap.toString(), "[1, 2]");
+    EXPECT_EQ(list.toString(), "[1, 2, 3]");
+
+    const Value::RawList* storage = &list.mutableList();
+    snap = Value();
+    list.mutableList().push_back(Value(4.0));
+    EXPECT_EQ(&list.mutableList(), storage);
+}
+
+namespace {
+
+Value noop(std::span<Value>) { return Value(); }
+
+// Результат сравнения: 0/1 или 2, если сравнение бросило исключение
+template <class F>
+int outcome(F f) {
+    try {
+        return f() ? 1 : 0;
+    } catch (const std::runtime_error&) {
+        return 2;
+    }
+}
+
+}  // namespace
+
+TEST(ValueTestSuite, ComparisonsKeepDerivedMeaning) {
+    // '<=', '>' и '>=' выбирают обработчик сами, но значат то же, что и раньше,
+    // когда выражались через '<' и '=='
+    std::vector<Value> values = {
+        Value(),
+        Value(1.0),
+        Value(2.0),
+        Value(std::numeric_limits<double>::quiet_NaN()),
+        Value(true),
+        Value(false),
+        Value(std::string("a")),
+        Value(std::string("b")),
+        Value(Value::RawList{Value(1.0)}),
+        Value(Value::RawList{Value(1.0), Value(std::string("a"))}),
+        Value(FunctionValue(noop)),
+    };
+    for (auto& a : values) {
+        for (auto& b : values) {
+            SCOPED_TRACE(a.toString() + " vs " + b.toString());
+            int lt = outcome([&] { return a < b; });
+            int eq = outcome([&] { return a == b; });
+            int le = lt == 2 ? 2 : lt || eq;
+            EXPECT_EQ(outcome([&] { return a <= b; }), le);
+            EXPECT_EQ(outcome([&] { return a > b; }), le == 2 ? 2 : !le);
+            EXPECT_EQ(outcome([&] { return a >= b; }), lt == 2 ? 2 : !lt);
+        }
+    }
+}
+
+TEST(ValueTestSuite, ArithmeticByTypePair) {
+    EXPECT_EQ((Value(1.5) + Value(true)).asNumber(), 2.5);
+    EXPECT_TRUE((Value(false) + Value(true)).asBool());
+    EXPECT_EQ((Value(std::string("ab")) + Value(std::string("c"))).toString(), "abc");
+    EXPECT_EQ((Value(2.0) * Value(std::string("ab"))).toString(), "abab");
+    EXPECT_EQ((Value(Value::RawList{Value(1.0), Value(2.0)}) * Value(1.5)).toString(), "[1, 2, 1]");
+    EXPECT_EQ((Value(std::string("file.txt")) - Value(std::string(".txt"))).toString(), "file");
+    EXPECT_THROW(Value(std::string("a")) + Value(1.0), std::runtime_error);
+    EXPECT_THROW(Value() - Value(1.0), std::runtime_error);
+}
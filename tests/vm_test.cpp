@@ -0,0 +1,337 @@
+#include <gtest/gtest.h>
+#include <lib/interpreter.h>
+
+// Прогоняет скрипт в обоих режимах и проверяет, что результаты совпадают
+static std::string runBoth(const std::string& code, bool expectOk = true) {
+    std::istringstream vmInput(code);
+    std::ostringstream vmOutput;
+    EXPECT_EQ(interpret(vmInput, vmOutput, ExecutionMode::Bytecode), expectOk);
+
+    std::istringstream treeInput(code);
+    std::ostringstream treeOutput;
+    EXPECT_EQ(interpret(treeInput, treeOutput, ExecutionMode::TreeWalker), expectOk);
+
+    if (expectOk) {
+        EXPECT_EQ(vmOutput.str(), treeOutput.str());
+    }
+    return vmOutput.str();
+}
+
+TEST(VMTestSuite, ArithmeticAndComparisons) {
+    std::string code = R"(
+        a = 7
+        b = 2
+        print(a + b, " ", a - b, " ", a * b, " ", a / b, " ", a % b, " ", a ^ b)
+        print(" ", a < b, a <= b, a > b, a >= b, a == b, a != b)
+        x = 5
+        x %= 3
+        x ^= 2
+        print(" ", x)
+    )";
+    ASSERT_EQ(runBoth(code), "9 5 14 3.5 1 49 falsefalsetruetruefalsetrue 4");
+}
+
+TEST(VMTestSuite, LoopsWithBreakAndContinue) {
+    std::string code = R"(
+        s = 0
+        for i in range(0, 20, 1)
+            if i % 2 == 0 then
+                continue
+            end if
+            if i > 11 then
+                break
+            end if
+            s += i
+        end for
+        i = 0
+        while true
+            i++
+            if i == 5 then break end if
+        end while
+        print(s, " ", i)
+    )";
+    ASSERT_EQ(runBoth(code), "36 5");
+}
+
+TEST(VMTestSuite, NestedClosuresShareCapturedState) {
+    std::string code = R"(
+        makeCounter = function()
+            count = 0
+            inc = function()
+                count += 1
+                return count
+            end function
+            return inc
+        end function
+
+        c1 = makeCounter()
+        c2 = makeCounter()
+        c1()
+        c1()
+        print(c1(), c2())
+    )";
+    ASSERT_EQ(runBoth(code), "31");
+}
+
+TEST(VMTestSuite, LocalRecursiveFunction) {
+    std::string code = R"(
+        outer = function(n)
+            fact = function(k)
+                if k <= 1 then return 1 end if
+                return k * fact(k - 1)
+            end function
+            return fact(n)
+        end function
+        print(outer(6))
+    )";
+    ASSERT_EQ(runBoth(code), "720");
+}
+
+TEST(VMTestSuite, DeepRecursion) {
+    std::string code = R"(
+        sum = function(n)
+            if n == 0 then return 0 end if
+            return n + sum(n - 1)
+        end function
+        print(sum(100000))
+    )";
+    // Кадры VM живут в куче, поэтому глубина рекурсии не ограничена стеком процесса
+    std::istringstream input(code);
+    std::ostringstream output;
+    ASSERT_TRUE(interpret(input, output, ExecutionMode::Bytecode));
+    ASSERT_EQ(output.str(), "5000050000");
+}
+
+TEST(VMTestSuite, StacktraceInsideCalls) {
+    std::string code = R"(
+        inner = function()
+            return stacktrace()
+        end function
+        outer = function()
+            return inner()
+        end function
+        print(outer())
+    )";
+    ASSERT_EQ(runBoth(code), R"(["outer", "inner"])");
+}
+
+TEST(VMTestSuite, StacktraceAfterFailedRun) {
+    // Функция, завершившаяся ошибкой, не оставляет своего имени на стеке вызовов
+    runBoth("fail = function() return 1 / 0 end function fail()", false);
+    ASSERT_EQ(runBoth("f = function() return stacktrace() end function s = f() print(len(s), s[0])"), "1f");
+}
+
+TEST(VMTestSuite, RuntimeErrors) {
+    runBoth("x = 1 / 0", false);
+    runBoth("f = function(a) return a end function f(1, 2)", false);
+    runBoth("print(undefinedName)", false);
+    runBoth("x = 5 x()", false);
+}
+
+TEST(VMTestSuite, InfiniteRecursionIsAnError) {
+    std::string code = R"(
+        f = function(n)
+            return f(n + 1)
+        end function
+        f(0)
+    )";
+    std::istringstream input(code);
+    std::ostringstream output;
+    ASSERT_FALSE(interpret(input, output, ExecutionMode::Bytecode));
+}
+
+TEST(VMTestSuite, ReturnFromNestedLoops) {
+    std::string code = R"(
+        find = function(xs, target)
+            for row in xs
+                for x in row
+                    if x == target then
+                        return x * 10
+                    end if
+                end for
+            end for
+            return -1
+        end function
+        print(find([[1, 2], [3, 4]], 3), " ", find([[1]], 5))
+    )";
+    ASSERT_EQ(runBoth(code), "30 -1");
+}
+
+TEST(VMTestSuite, BreakOutsideLoopIsAnError) {
+    runBoth("f = function() break end function f()", false);
+    runBoth("continue", false);
+}
+
+TEST(VMTestSuite, ForIteratesSnapshotOfList) {
+    std::string code = R"(
+        xs = [1, 2, 3]
+        ys = xs
+        for x in xs
+            push(xs, x * 10)
+        end for
+        print(ys, " ", len(ys))
+        s = xs[1:3] + []
+        push(s, 0)
+        print(" ", xs, " ", sort(s))
+    )";
+    ASSERT_EQ(runBoth(code), "[1, 2, 3, 10, 20, 30] 6 [1, 2, 3, 10, 20, 30] [0, 2, 3]");
+}
+
+TEST(VMTestSuite, RangesAreLazy) {
+    std::string code = R"(
+        r = range(1000000000000)
+        print(len(r), " ", r[-1], " ", 999 in r, " ", (-1) in r, " ", 2.5 in r)
+        s = 0
+        for i in r
+            if i == 5 then
+                break
+            end if
+            s += i
+        end for
+        print(" ", s, " ", range(5, 0, -2), " ", range(0, 1, 0.25))
+        small = range(3)
+        for i in small
+            push(small, i)
+        end for
+        print(" ", small, " ", 1 in small)
+    )";
+    ASSERT_EQ(runBoth(code), "1000000000000 999999999999 true false false 10 [5, 3, 1] [0, 0.25, 0.5, 0.75] [0, 1, 2, 0, 1, 2] true");
+}
+
+TEST(VMTestSuite, InLooksForLeftOperandInRightOperand) {
+    EXPECT_EQ(runBoth(R"(print(2 in [1, 2, 3], " ", [2] in [[2]], " ", "x" in "xyz", " ", "xyz" in "x", " ", 3 in range(3)))"),
+              "true true true false false");
+    EXPECT_EQ(runBoth("print([1, 2, 3] in 2)", false), "Error: Operator 'in' expects a list or a string on the right but got 'number'");
+    runBoth("print(\"a\" in nil)", false);
+    runBoth("print(1 in \"123\")", false);
+}
+
+TEST(VMTestSuite, ForIteratesStringCharacters) {
+    std::string code = R"(
+        out = ""
+        for c in "abc"
+            out = c + out
+        end for
+        print(out)
+    )";
+    ASSERT_EQ(runBoth(code), "cba");
+}
+
+TEST(VMTestSuite, RecursionAcrossFrameChunks) {
+    std::string code = R"(
+        walk = function(n, acc)
+            a = n * 2
+            b = a + acc
+            if n == 0 then
+                return b
+            end if
+            return walk(n - 1, b)
+        end function
+        print(walk(2000, 0))
+    )";
+    ASSERT_EQ(runBoth(code), "4002000");
+}
+
+TEST(VMTestSuite, SpecializedNodesFollowTypeChanges) {
+    // Одни и те же узлы видят сначала числа, потом строки, списки и bool
+    std::string code = R"(
+        function add(a, b)
+            return a + b
+        end function
+        function at(xs, i)
+            return xs[i]
+        end function
+        for v in [1, "x", [3], true]
+            print(add(v, v), at([v, 7], 1), " ")
+        end for
+        s = 1
+        for v in [2, "x", "y"]
+            if v == "x" then s = to_string(s) end if
+            s += v
+        end for
+        n = 10
+        n %= 0
+        print(s, " ", n)
+    )";
+    EXPECT_EQ(runBoth(code), "27 xx7 [3, 3]7 true7 3xy nan");
+}
+
+TEST(VMTestSuite, NamedFunctionAssignsExistingGlobal) {
+    // Именованная функция меняет глобал модуля, а литерал функции — свою локальную
+    std::string code = R"(
+        counter = 0
+        function inc()
+            counter = counter + 1
+        end function
+        function add(x)
+            total += x
+        end function
+        total = 10
+        reset = function()
+            counter = 100
+        end function
+        inc() inc() add(5) reset()
+        print(counter, " ", total)
+    )";
+    EXPECT_EQ(runBoth(code), "2 15");
+}
+
+TEST(VMTestSuite, TopLevelLiteralCopiesGlobals) {
+    // Литерал верхнего уровня получает копию окружения модуля: читает глобалы
+    // на момент создания, а присваивает своей копии, которая живёт между вызовами
+    EXPECT_EQ(runBoth(R"(
+        counter = 0
+        f = function() counter = counter + 1 return counter end function
+        print(f(), f(), counter)
+    )"),
+              "120");
+    EXPECT_EQ(runBoth(R"(
+        x = 1
+        g = function() return x end function
+        x = 2
+        print(g())
+    )"),
+              "1");
+    EXPECT_EQ(runBoth(R"(
+        total = 0
+        add = function(v) total += v return total end function
+        print(add(2), add(3), total)
+    )"),
+              "250");
+}
+
+TEST(VMTestSuite, LiteralInNamedFunctionAssignsGlobals) {
+    // Литерал внутри именованной функции, как и она сама, работает с глобалами модуля
+    std::string code = R"(
+        function run()
+            f = function() counter = counter + 1 fresh = 3 return fresh end function
+            return f()
+        end function
+        counter = 0
+        print(run(), run(), counter)
+    )";
+    EXPECT_EQ(runBoth(code), "332");
+    EXPECT_EQ(runBoth(code + "print(fresh)", false), "332Error: Undefined variable 'fresh'");
+}
+
+TEST(VMTestSuite, NestedLiteralSharesEnclosingCopy) {
+    std::string code = R"(
+        x = 1
+        f = function()
+            g = function() x = x + 10 return x end function
+            return g() + x
+        end function
+        print(f(), " ", f(), " ", x)
+    )";
+    EXPECT_EQ(runBoth(code), "22 42 1");
+}
+
+TEST(VMTestSuite, TopLevelLiteralSeesItselfAndNotLaterGlobals) {
+    EXPECT_EQ(runBoth(R"(
+        fact = function(n) if n <= 1 then return 1 end if return n * fact(n - 1) end function
+        print(fact(5))
+    )"),
+              "120");
+    EXPECT_EQ(runBoth("f = function() return z end function z = 1 print(f())", false),
+              "Error: Undefined variable 'z'");
+}